@@ -0,0 +1,491 @@
+// lite3client_bench: throughput and latency of Client / SmartClient.
+//
+// Runs against a live cluster (--host/--port) or, by default, against
+// in-process mock nodes so request-path regressions (copies, allocations,
+// locking) show up without any deployment.
+//
+//   lite3client_bench --threads 8 --dist zipf --read-ratio 0.9
+//                     --value-sizes 16,1024,65536,4194304 --pipeline 16
+
+#include "lite3/smart_client.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// --- Options ---
+
+struct Options {
+  std::string host;  // Empty: start mock nodes
+  int port = 0;
+  int mock_nodes = 1;
+  bool smart = false; // SmartClient instead of Client
+  int threads = 4;
+  double seconds = 5.0;
+  std::size_t keys = 10000; // Capped so the prefill stays under 256 MiB
+  bool zipf = false;
+  double zipf_theta = 0.99;
+  double read_ratio = 0.9;
+  std::size_t pipeline = 1; // Ops per pipeline()/multi_* batch
+  bool key_refs = false;    // Single ops through prepared lite3::KeyRefs
+  std::size_t shards = 1;   // PoolOptions::shards
+  bool pin = false;         // Worker t on CPU t, pools sharded by CPU
+  std::vector<std::size_t> value_sizes{16, 1024, 65536};
+};
+
+[[noreturn]] void usage(const char *argv0) {
+  std::fprintf(
+      stderr,
+      "usage: %s [options]\n"
+      "  --host H --port P     benchmark a live node (default: mock nodes)\n"
+      "  --mock-nodes N        in-process mock nodes (default 1)\n"
+      "  --smart               use SmartClient (routes over all nodes)\n"
+      "  --threads N           worker threads (default 4)\n"
+      "  --seconds S           measured duration per value size (default 5)\n"
+      "  --keys N              key space (default 10000)\n"
+      "  --dist uniform|zipf   key distribution (default uniform)\n"
+      "  --zipf-theta T        zipf skew (default 0.99)\n"
+      "  --read-ratio R        fraction of GETs, 0..1 (default 0.9)\n"
+      "  --pipeline N          ops per batch; >1 uses pipeline()/multi_*\n"
+      "  --key-refs            single ops on prepared KeyRefs\n"
+      "  --shards N            pool shards per node (default 1)\n"
+      "  --pin                 pin workers to CPUs, shard pools by CPU\n"
+      "  --value-sizes A,B,..  bytes per value, swept in order\n",
+      argv0);
+  std::exit(2);
+}
+
+std::vector<std::size_t> parse_sizes(const std::string &list) {
+  std::vector<std::size_t> out;
+  std::size_t pos = 0;
+  while (pos < list.size()) {
+    auto comma = list.find(',', pos);
+    if (comma == std::string::npos)
+      comma = list.size();
+    out.push_back(std::stoull(list.substr(pos, comma - pos)));
+    pos = comma + 1;
+  }
+  return out;
+}
+
+Options parse_options(int argc, char **argv) {
+  Options o;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc)
+        usage(argv[0]);
+      return argv[++i];
+    };
+    if (arg == "--host")
+      o.host = next();
+    else if (arg == "--port")
+      o.port = std::stoi(next());
+    else if (arg == "--mock-nodes")
+      o.mock_nodes = std::max(1, std::stoi(next()));
+    else if (arg == "--smart")
+      o.smart = true;
+    else if (arg == "--threads")
+      o.threads = std::max(1, std::stoi(next()));
+    else if (arg == "--seconds")
+      o.seconds = std::stod(next());
+    else if (arg == "--keys")
+      o.keys = std::max<std::size_t>(1, std::stoull(next()));
+    else if (arg == "--dist")
+      o.zipf = next() == "zipf";
+    else if (arg == "--zipf-theta")
+      o.zipf_theta = std::stod(next());
+    else if (arg == "--read-ratio")
+      o.read_ratio = std::clamp(std::stod(next()), 0.0, 1.0);
+    else if (arg == "--pipeline")
+      o.pipeline = std::max<std::size_t>(1, std::stoull(next()));
+    else if (arg == "--key-refs")
+      o.key_refs = true;
+    else if (arg == "--shards")
+      o.shards = std::max<std::size_t>(1, std::stoull(next()));
+    else if (arg == "--pin")
+      o.pin = true;
+    else if (arg == "--value-sizes")
+      o.value_sizes = parse_sizes(next());
+    else
+      usage(argv[0]);
+  }
+  if (!o.host.empty() && o.port == 0)
+    usage(argv[0]);
+  return o;
+}
+
+// --- Mock Node ---
+
+// Minimal in-memory lite3 node: /kv/<key> GET/PUT/POST/DELETE and a
+// /cluster/map listing every mock node. One detached thread per connection,
+// so nodes are never destroyed; they live until the process exits.
+class MockNode {
+public:
+  MockNode() : acceptor_(ioc_, {net::ip::make_address("127.0.0.1"), 0}) {}
+
+  int port() const { return acceptor_.local_endpoint().port(); }
+
+  void start(std::string cluster_map) {
+    cluster_map_ = std::move(cluster_map);
+    std::thread([this] { accept_loop(); }).detach();
+  }
+
+private:
+  void accept_loop() {
+    for (;;) {
+      tcp::socket socket(ioc_);
+      beast::error_code ec;
+      acceptor_.accept(socket, ec);
+      if (ec)
+        continue;
+      std::thread([this, s = std::move(socket)]() mutable {
+        serve(std::move(s));
+      }).detach();
+    }
+  }
+
+  void serve(tcp::socket socket) {
+    socket.set_option(tcp::no_delay(true));
+    beast::flat_buffer buffer;
+    beast::error_code ec;
+    for (;;) {
+      http::request_parser<http::vector_body<uint8_t>> parser;
+      parser.body_limit(64 * 1024 * 1024);
+      http::read(socket, buffer, parser, ec);
+      if (ec)
+        return;
+      auto req = parser.release();
+
+      http::response<http::vector_body<uint8_t>> res;
+      res.version(11);
+      res.keep_alive(req.keep_alive());
+      handle(req, res);
+      res.prepare_payload();
+      http::write(socket, res, ec);
+      if (ec || !res.keep_alive())
+        return;
+    }
+  }
+
+  void handle(http::request<http::vector_body<uint8_t>> &req,
+              http::response<http::vector_body<uint8_t>> &res) {
+    std::string target(req.target());
+    if (target == "/cluster/map") {
+      res.result(http::status::ok);
+      res.body().assign(cluster_map_.begin(), cluster_map_.end());
+      return;
+    }
+    if (target.rfind("/kv/", 0) != 0) {
+      res.result(http::status::not_found);
+      return;
+    }
+    auto key = target.substr(0, target.find('?'));
+
+    std::lock_guard lock(mutex_);
+    switch (req.method()) {
+    case http::verb::get: {
+      auto it = store_.find(key);
+      if (it == store_.end()) {
+        res.result(http::status::not_found);
+      } else {
+        res.result(http::status::ok);
+        res.body() = it->second;
+      }
+      break;
+    }
+    case http::verb::put:
+    case http::verb::post:
+      store_[key] = std::move(req.body());
+      res.result(http::status::ok);
+      break;
+    case http::verb::delete_:
+      res.result(store_.erase(key) ? http::status::ok
+                                   : http::status::not_found);
+      break;
+    default:
+      res.result(http::status::bad_request);
+    }
+  }
+
+  net::io_context ioc_;
+  tcp::acceptor acceptor_;
+  std::string cluster_map_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::vector<uint8_t>> store_;
+};
+
+// --- Key Distributions ---
+
+// Zipfian ranks over [0, n) (Gray et al., "Quickly Generating Billion-Record
+// Synthetic Databases"), as used by YCSB.
+class Zipf {
+public:
+  Zipf(std::size_t n, double theta) : n_(n), theta_(theta) {
+    for (std::size_t i = 1; i <= n; ++i)
+      zeta_n_ += 1.0 / std::pow(static_cast<double>(i), theta);
+    double zeta2 = 1.0 + 1.0 / std::pow(2.0, theta);
+    alpha_ = 1.0 / (1.0 - theta);
+    eta_ = (1.0 - std::pow(2.0 / static_cast<double>(n), 1.0 - theta)) /
+           (1.0 - zeta2 / zeta_n_);
+  }
+
+  template <class Rng> std::size_t operator()(Rng &rng) {
+    double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+    double uz = u * zeta_n_;
+    if (uz < 1.0)
+      return 0;
+    if (uz < 1.0 + std::pow(0.5, theta_))
+      return 1;
+    auto rank = static_cast<std::size_t>(
+        static_cast<double>(n_) * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+    return std::min(rank, n_ - 1);
+  }
+
+private:
+  std::size_t n_;
+  double theta_;
+  double zeta_n_ = 0;
+  double alpha_ = 0;
+  double eta_ = 0;
+};
+
+// --- Workload ---
+
+// Either client type behind one interface, so the loop below is shared.
+struct Target {
+  std::unique_ptr<lite3::Client> client;
+  std::unique_ptr<lite3::SmartClient> smart;
+
+  // Key: std::string_view or lite3::KeyRef.
+  template <typename Key> bool put(const Key &key, std::string_view value) {
+    return client ? bool(client->put(key, value))
+                  : bool(smart->put(key, value));
+  }
+  template <typename Key> bool get(const Key &key) {
+    return client ? bool(client->get_pooled(key))
+                  : bool(smart->get_pooled(key));
+  }
+  // Mixed batch: GETs and PUTs in one pipeline (Client) or as one
+  // multi_get plus one multi_put (SmartClient). Returns failures.
+  std::size_t batch(std::span<const lite3::PipelineOp> ops) {
+    std::size_t failed = 0;
+    if (client) {
+      for (auto &res : client->pipeline(ops))
+        failed += !res;
+      return failed;
+    }
+    std::vector<std::string_view> gets;
+    std::vector<std::pair<std::string_view, std::string_view>> puts;
+    for (const auto &op : ops) {
+      if (op.kind == lite3::PipelineOp::Kind::Get)
+        gets.push_back(op.key);
+      else
+        puts.emplace_back(op.key, op.value);
+    }
+    if (!gets.empty())
+      for (auto &res : smart->multi_get(gets))
+        failed += !res;
+    if (!puts.empty())
+      for (auto &res : smart->multi_put(puts))
+        failed += !res;
+    return failed;
+  }
+};
+
+struct ThreadResult {
+  uint64_t ops = 0;
+  uint64_t errors = 0;
+  std::vector<uint32_t> latency_us; // Per op, or per batch when pipelining
+};
+
+std::string key_name(std::size_t rank) {
+  return "bench:" + std::to_string(rank);
+}
+
+uint64_t percentile(const std::vector<uint32_t> &sorted, double q) {
+  if (sorted.empty())
+    return 0;
+  auto idx = static_cast<std::size_t>(q * static_cast<double>(sorted.size()));
+  return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+// `refs`: one per key with --key-refs, else empty.
+ThreadResult run_worker(Target &target, const Options &o, std::size_t keys,
+                        std::span<const lite3::KeyRef> refs,
+                        const std::string &value, Clock::time_point until,
+                        unsigned seed) {
+  ThreadResult out;
+  out.latency_us.reserve(1 << 16);
+  std::mt19937_64 rng(seed);
+  std::uniform_int_distribution<std::size_t> uniform(0, keys - 1);
+  std::uniform_real_distribution<double> coin(0.0, 1.0);
+  std::unique_ptr<Zipf> zipf;
+  if (o.zipf)
+    zipf = std::make_unique<Zipf>(keys, o.zipf_theta);
+
+  std::vector<std::string> names(o.pipeline);
+  std::vector<lite3::PipelineOp> ops(o.pipeline, lite3::PipelineOp::get(""));
+  while (Clock::now() < until) {
+    Clock::time_point start;
+    if (!refs.empty()) {
+      const auto &key = refs[zipf ? (*zipf)(rng) : uniform(rng)];
+      const bool read = coin(rng) < o.read_ratio;
+      start = Clock::now();
+      out.errors += !(read ? target.get(key) : target.put(key, value));
+    } else {
+      for (std::size_t i = 0; i < o.pipeline; ++i) {
+        names[i] = key_name(zipf ? (*zipf)(rng) : uniform(rng));
+        ops[i] = coin(rng) < o.read_ratio
+                     ? lite3::PipelineOp::get(names[i])
+                     : lite3::PipelineOp::put(names[i], value);
+      }
+      start = Clock::now();
+      if (o.pipeline == 1) {
+        bool ok = ops[0].kind == lite3::PipelineOp::Kind::Get
+                      ? target.get(ops[0].key)
+                      : target.put(ops[0].key, value);
+        out.errors += !ok;
+      } else {
+        out.errors += target.batch(ops);
+      }
+    }
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                  Clock::now() - start)
+                  .count();
+    out.latency_us.push_back(static_cast<uint32_t>(
+        std::min<int64_t>(us, std::numeric_limits<uint32_t>::max())));
+    out.ops += refs.empty() ? o.pipeline : 1;
+  }
+  return out;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options o = parse_options(argc, argv);
+
+  std::vector<MockNode *> nodes; // Leaked, see MockNode
+  if (o.host.empty()) {
+    std::string peers;
+    for (int i = 0; i < o.mock_nodes; ++i) {
+      nodes.push_back(new MockNode());
+      if (i)
+        peers += ',';
+      peers += "{\"id\":" + std::to_string(i + 1) +
+               ",\"host\":\"127.0.0.1\",\"http_port\":" +
+               std::to_string(nodes.back()->port()) + "}";
+    }
+    std::string map = "{\"peers\":[" + peers + "]}";
+    for (auto &node : nodes)
+      node->start(map);
+    o.host = "127.0.0.1";
+    o.port = nodes.front()->port();
+  }
+
+  lite3::PoolOptions pool;
+  pool.shards = o.shards;
+  pool.shard_by_cpu = o.pin;
+  pool.max_connections =
+      (static_cast<std::size_t>(o.threads) + o.shards - 1) / o.shards;
+  pool.pipeline_depth = o.pipeline;
+
+  Target target;
+  if (o.smart) {
+    target.smart = std::make_unique<lite3::SmartClient>(o.host, o.port, pool);
+    if (auto res = target.smart->connect(); !res) {
+      std::cerr << "connect failed: " << res.error().message << "\n";
+      return 1;
+    }
+  } else {
+    target.client = std::make_unique<lite3::Client>(o.host, o.port, pool);
+  }
+
+  std::printf("%s, %d threads, %s keys, %.0f%% reads, %s%s\n",
+              o.smart ? "SmartClient" : "Client", o.threads,
+              o.zipf ? "zipf" : "uniform", o.read_ratio * 100.0,
+              o.key_refs ? "KeyRefs"
+                         : ("pipeline " + std::to_string(o.pipeline)).c_str(),
+              nodes.empty() ? "" : ", mock nodes");
+  std::printf("%10s %12s %10s %10s %10s %10s %8s\n", "value_B", "ops/s",
+              "MB/s", "p50_us", "p99_us", "p999_us", "errors");
+
+  for (std::size_t size : o.value_sizes) {
+    const std::size_t keys = std::max<std::size_t>(
+        1, std::min(o.keys, (256u << 20) / std::max<std::size_t>(size, 1)));
+    const std::string value(size, 'x');
+
+    // Prefill so reads hit.
+    std::vector<lite3::KeyRef> refs;
+    for (std::size_t k = 0; k < keys; ++k) {
+      target.put(key_name(k), value);
+      if (o.key_refs)
+        refs.emplace_back(key_name(k));
+    }
+
+    const auto until =
+        Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                           std::chrono::duration<double>(o.seconds));
+    std::vector<ThreadResult> results(static_cast<std::size_t>(o.threads));
+    std::vector<std::thread> workers;
+    const auto start = Clock::now();
+    for (int t = 0; t < o.threads; ++t)
+      workers.emplace_back([&, t] {
+        if (o.pin)
+          lite3::pin_thread(static_cast<unsigned>(t) %
+                            std::max(1u, std::thread::hardware_concurrency()));
+        results[static_cast<std::size_t>(t)] =
+            run_worker(target, o, keys, refs, value, until, 1234u + t);
+      });
+    for (auto &w : workers)
+      w.join();
+    const double elapsed =
+        std::chrono::duration<double>(Clock::now() - start).count();
+
+    uint64_t ops = 0;
+    uint64_t errors = 0;
+    std::vector<uint32_t> latency;
+    for (auto &r : results) {
+      ops += r.ops;
+      errors += r.errors;
+      latency.insert(latency.end(), r.latency_us.begin(), r.latency_us.end());
+    }
+    std::sort(latency.begin(), latency.end());
+
+    const double rate = static_cast<double>(ops) / elapsed;
+    std::printf("%10zu %12.0f %10.1f %10llu %10llu %10llu %8llu\n", size, rate,
+                rate * static_cast<double>(size) / (1024.0 * 1024.0),
+                static_cast<unsigned long long>(percentile(latency, 0.5)),
+                static_cast<unsigned long long>(percentile(latency, 0.99)),
+                static_cast<unsigned long long>(percentile(latency, 0.999)),
+                static_cast<unsigned long long>(errors));
+  }
+  if (o.pipeline > 1 && !o.key_refs)
+    std::printf("(latencies are per batch of %zu ops)\n", o.pipeline);
+  return 0;
+}
@@ -1,14 +1,30 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <concepts>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
 #include <memory>
 #include <optional>
+#include <span>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <system_error>
+#include <type_traits>
+#include <utility>
 #include <variant>
 #include <vector>
 
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/use_future.hpp>
+#include <future>
+
 #include <buffer.hpp>
 
 namespace lite3 {
@@ -25,30 +41,112 @@ enum class ErrorCode {
   SerializationError,
   Unknown
 };
+inline constexpr std::size_t error_code_count =
+    static_cast<std::size_t>(ErrorCode::Unknown) + 1;
 
 struct Error {
   ErrorCode code;
   std::string message;
 };
 
+template <typename T> class Result;
+
+namespace detail {
+template <typename R> struct is_result : std::false_type {};
+template <typename U> struct is_result<Result<U>> : std::true_type {};
+} // namespace detail
+
 template <typename T> class Result {
   std::variant<T, Error> val_;
 
+  [[noreturn]] void throw_empty() const {
+    throw std::runtime_error("Result has no value: " +
+                             std::get<Error>(val_).message);
+  }
+
 public:
+  using value_type = T;
+
+  // Empty results are errors; asio needs a default-constructible value type
+  // to co_spawn an awaitable<Result<T>>.
+  Result() : val_(Error{ErrorCode::Unknown, "Empty result"}) {}
   Result(T val) : val_(std::move(val)) {}
   Result(Error err) : val_(std::move(err)) {}
 
   bool has_value() const { return std::holds_alternative<T>(val_); }
-  const T &value() const {
+  // Throw if there is no value. The rvalue overloads move the payload out,
+  // so `std::move(res).value()` or `*std::move(res)` never copies.
+  T &value() & {
     if (!has_value())
-      throw std::runtime_error("Result has no value: " +
-                               std::get<Error>(val_).message);
+      throw_empty();
     return std::get<T>(val_);
   }
+  const T &value() const & {
+    if (!has_value())
+      throw_empty();
+    return std::get<T>(val_);
+  }
+  T &&value() && {
+    if (!has_value())
+      throw_empty();
+    return std::get<T>(std::move(val_));
+  }
   const Error &error() const { return std::get<Error>(val_); }
 
+  // Unchecked access, like std::optional: the Result must hold a value.
+  T &operator*() & { return *std::get_if<T>(&val_); }
+  const T &operator*() const & { return *std::get_if<T>(&val_); }
+  T &&operator*() && { return std::move(*std::get_if<T>(&val_)); }
+  T *operator->() { return std::get_if<T>(&val_); }
+  const T *operator->() const { return std::get_if<T>(&val_); }
+
+  template <typename U> T value_or(U &&fallback) const & {
+    return has_value() ? **this : static_cast<T>(std::forward<U>(fallback));
+  }
+  template <typename U> T value_or(U &&fallback) && {
+    return has_value() ? std::move(**this)
+                       : static_cast<T>(std::forward<U>(fallback));
+  }
+
+  // f(value) -> Result<U>; errors pass through without calling f.
+  template <typename F> auto and_then(F &&f) const & {
+    using R = std::invoke_result_t<F, const T &>;
+    static_assert(detail::is_result<R>::value, "f must return a Result");
+    return has_value() ? std::invoke(std::forward<F>(f), **this)
+                       : R(error());
+  }
+  template <typename F> auto and_then(F &&f) && {
+    using R = std::invoke_result_t<F, T &&>;
+    static_assert(detail::is_result<R>::value, "f must return a Result");
+    return has_value() ? std::invoke(std::forward<F>(f), std::move(**this))
+                       : R(error());
+  }
+
+  // f(value) -> U, wrapped as Result<U> (Result<void> if f returns void).
+  template <typename F> auto transform(F &&f) const & {
+    return map_value<std::invoke_result_t<F, const T &>>(std::forward<F>(f),
+                                                         **this);
+  }
+  template <typename F> auto transform(F &&f) && {
+    return map_value<std::invoke_result_t<F, T &&>>(std::forward<F>(f),
+                                                    std::move(**this));
+  }
+
   // Monadic-like check
   operator bool() const { return has_value(); }
+
+private:
+  template <typename U, typename F, typename V>
+  Result<U> map_value(F &&f, V &&v) const {
+    if (!has_value())
+      return error();
+    if constexpr (std::is_void_v<U>) {
+      std::invoke(std::forward<F>(f), std::forward<V>(v));
+      return {};
+    } else {
+      return std::invoke(std::forward<F>(f), std::forward<V>(v));
+    }
+  }
 };
 
 // Void specialization
@@ -56,6 +154,8 @@ template <> class Result<void> {
   std::optional<Error> err_;
 
 public:
+  using value_type = void;
+
   Result() {}
   Result(Error err) : err_(std::move(err)) {}
 
@@ -66,19 +166,401 @@ public:
   }
   const Error &error() const { return *err_; }
   operator bool() const { return has_value(); }
+
+  // f() -> Result<U>, called only on success.
+  template <typename F> auto and_then(F &&f) const {
+    using R = std::invoke_result_t<F>;
+    static_assert(detail::is_result<R>::value, "f must return a Result");
+    return has_value() ? std::invoke(std::forward<F>(f)) : R(error());
+  }
+  // f() -> U, wrapped as Result<U>.
+  template <typename F> auto transform(F &&f) const {
+    using U = std::invoke_result_t<F>;
+    if (!has_value())
+      return Result<U>(error());
+    if constexpr (std::is_void_v<U>) {
+      std::invoke(std::forward<F>(f));
+      return Result<U>();
+    } else {
+      return Result<U>(std::invoke(std::forward<F>(f)));
+    }
+  }
+};
+
+// --- Connection Pooling ---
+
+// Bounds for the per-endpoint keep-alive pool owned by each Client.
+// A Client may be shared between threads; each in-flight request checks out
+// its own connection, so concurrency per node is capped by max_connections.
+struct PoolOptions {
+  std::size_t min_connections = 0; // Idle connections kept past idle_timeout
+  std::size_t max_connections = 8;
+  std::chrono::milliseconds idle_timeout{30000};
+  std::chrono::milliseconds checkout_timeout{5000}; // -> ErrorCode::Timeout
+  // Per-connection read buffers and recycled response bodies that grow past
+  // this many bytes are freed rather than kept for the next request.
+  std::size_t buffer_high_water = 256 * 1024;
+  // Requests Client::pipeline() writes ahead on one connection before reading
+  // responses. 1 disables pipelining (one round trip per request).
+  std::size_t pipeline_depth = 1;
+  // Thread-per-core mode: splits each endpoint's connection and body-buffer
+  // pools into this many shards, each with its own lock, idle connections
+  // and buffers. A thread keeps to one shard, so threads on different shards
+  // share nothing on the request path. min/max_connections apply per shard.
+  std::size_t shards = 1;
+  // Picks the shard from the CPU the thread is running on instead of
+  // round-robin per thread. Pair with pin_thread() so each core (and, by
+  // first touch, its NUMA node) keeps its own connections and buffers.
+  bool shard_by_cpu = false;
+};
+
+// Pins the calling thread to one CPU. Linux only; elsewhere returns
+// ErrorCode::Unknown.
+Result<void> pin_thread(unsigned cpu);
+
+// --- Compression ---
+
+// Opt-in zlib compression of request and response bodies. Responses are
+// decoded whenever the server sets Content-Encoding; streaming calls
+// (get_to/put_from/put_file) always move raw bytes. In a build without zlib,
+// calls with `enabled` set fail with ErrorCode::BadRequest.
+struct CompressionOptions {
+  bool enabled = false;        // Also sends Accept-Encoding: gzip, deflate
+  std::size_t min_size = 1024; // Smaller request bodies are sent raw
+  int level = 1;               // zlib level: 1 fastest .. 9 smallest
+  // Preset dictionary shared with the server. When set, request bodies are
+  // sent as Content-Encoding: deflate (a zlib stream naming the dictionary)
+  // instead of gzip, so small similar values compress too.
+  std::vector<uint8_t> dictionary;
+  // Compressed responses that would inflate past this fail with
+  // ErrorCode::SerializationError.
+  std::size_t max_decompressed = 64 * 1024 * 1024;
+};
+
+// --- Wire Protocol ---
+
+// How get, put, get_pooled and del reach a node. Every other call, and any
+// node that declines the Binary upgrade, uses HTTP.
+enum class Protocol {
+  Http, // One HTTP/1.1 exchange per request on a pooled connection
+  // Length-prefixed frames tagged with request IDs on one connection per
+  // node, upgraded from HTTP. Responses may arrive in any order, so a slow
+  // request does not hold up the ones behind it.
+  Binary,
 };
 
+// --- TLS ---
+
+// Opt-in TLS (1.2 or later) on every connection. All endpoints of a Client,
+// or of a SmartClient and the nodes it is redirected to, share one context.
+// Each endpoint remembers the latest session its server issued and offers
+// it on every new connection, so pooled connections rebuilt after an error
+// or redirect resume with an abbreviated handshake. With TLS on,
+// Protocol::Binary requests use HTTP, and redirects are only followed to
+// https:// locations; without it, only to http:// ones. In a build without
+// OpenSSL, every connect with `enabled` set fails with ErrorCode::NetworkError.
+struct TlsOptions {
+  bool enabled = false;
+  // Check the certificate chain and that it names the host connected to.
+  bool verify_peer = true;
+  std::string ca_file;   // PEM trust anchors. Empty: the system's
+  std::string cert_file; // PEM client certificate chain, for mutual TLS
+  std::string key_file;  // Its private key. Empty: read from cert_file
+  bool resume_sessions = true;
+};
+
+// --- Failure Handling ---
+
+// Automatic retries of requests that failed without an answer from the
+// server (ErrorCode::NetworkError or ConnectionRefused). Backoff is
+// exponential with full jitter and never sleeps past the call's deadline.
+// Each endpoint keeps a retry budget: a failed attempt costs one token, an
+// answered one earns back budget_ratio, and retries stop while fewer than
+// half of budget_tokens remain, so an outage cannot multiply the load.
+// Streaming calls and pipeline() (which resends unanswered requests itself)
+// are not retried.
+struct RetryOptions {
+  std::size_t max_attempts = 1; // Including the first. 1: no retries
+  std::chrono::milliseconds base_backoff{5}; // Cap before the 2nd attempt
+  std::chrono::milliseconds max_backoff{500};
+  uint32_t budget_tokens = 10;
+  double budget_ratio = 0.1;
+  // patch_int/patch_str/patch: an add_int applied twice adds twice, so
+  // these are retried only when set. get, put and del always may be.
+  bool retry_patches = false;
+};
+
+// Per-endpoint circuit breaker over connection attempts. After
+// failure_threshold consecutive connect failures, requests that need a new
+// connection fail at once with ErrorCode::ConnectionRefused instead of each
+// waiting out a connect. When the open period ends, one connect goes
+// through as a probe: success closes the circuit, failure reopens it for
+// twice as long (jittered, up to max_open_for). SmartClient reads prefer
+// replicas whose circuit is closed.
+struct CircuitBreakerOptions {
+  uint32_t failure_threshold = 5; // 0: never open
+  std::chrono::milliseconds open_for{100};
+  std::chrono::milliseconds max_open_for{10000};
+};
+
+// --- Timeouts ---
+
+// Opening connections before the first request. See Client::warm_up() and
+// SmartClient::connect().
+struct WarmupOptions {
+  // SmartClient: warm every new node on each topology refresh, before any
+  // request is routed to it.
+  bool on_connect = false;
+  std::size_t max_parallel = 16; // Nodes connecting at once
+};
+
+// Everything a Client is configured with. Converts from PoolOptions, so
+// callers that only tune the pool can keep passing one.
+struct ClientOptions {
+  ClientOptions() = default;
+  ClientOptions(PoolOptions p) : pool(p) {}
+
+  PoolOptions pool; // Idle keep-alive connections close after idle_timeout
+  // Resolve + TCP connect of each new connection. Zero: no limit.
+  std::chrono::milliseconds connect_timeout{5000};
+  // Write + read of one request including its redirect hops, or of each
+  // pipeline() window, unless the call passes a Deadline. Zero: no limit.
+  std::chrono::milliseconds request_timeout{30000};
+  // How long resolved addresses are reused before being looked up again in
+  // the background. Zero: resolve on every connect. IP literals never are.
+  std::chrono::milliseconds dns_ttl{30000};
+  WarmupOptions warmup;
+  CompressionOptions compression;
+  Protocol protocol = Protocol::Http;
+  TlsOptions tls;
+  RetryOptions retry;
+  CircuitBreakerOptions breaker;
+};
+
+// Absolute per-call deadline. A default-constructed Deadline means "use
+// ClientOptions::request_timeout". Expiry yields ErrorCode::Timeout.
+using Deadline = std::chrono::steady_clock::time_point;
+
+// --- Streaming ---
+
+// Receives each chunk of a streamed value as it arrives. Returning false
+// aborts the transfer.
+using ChunkSink = std::function<bool(std::span<const uint8_t>)>;
+// Fills the buffer with the next bytes of a streamed upload and returns how
+// many it wrote. Returning 0 before the declared size is reached fails the
+// upload.
+using ChunkSource = std::function<std::size_t(std::span<uint8_t>)>;
+
+// --- Field Projection ---
+
+// One document field read by get_field()/get_fields(). monostate: absent or
+// null. Nested objects and arrays come back as their JSON text.
+using FieldValue =
+    std::variant<std::monostate, bool, int64_t, double, std::string>;
+
+// --- Scans ---
+
+// One key, with its value when the scan asked for values, from
+// Client::scan_page() or SmartClient::scan(). Pages arrive as u32 key
+// length and key bytes per entry, each followed by a u32 value length and
+// value bytes when values were requested; lengths are little endian.
+struct ScanEntry {
+  std::string key;
+  std::vector<uint8_t> value;
+};
+
+// --- Batched Patches ---
+
+// Field updates to one document, sent by Client::patch() as a single
+// request (POST /kv/<key>?op=patch) and applied by the server in order.
+// Body, little endian: u32 op count, then per op a u8 Kind, u16 field
+// length and field bytes, followed by an i64 (SetInt, AddInt) or a u32
+// length and bytes (SetStr).
+class PatchBatch {
+public:
+  enum class Kind : uint8_t { SetInt = 1, SetStr = 2, AddInt = 3 };
+
+  PatchBatch &set_int(std::string_view field, int64_t value);
+  PatchBatch &set_str(std::string_view field, std::string_view value);
+  PatchBatch &add_int(std::string_view field, int64_t delta);
+
+  std::size_t size() const { return count_; }
+  bool empty() const { return count_ == 0; }
+  // False once a field name or value was too long for the encoding.
+  bool valid() const { return valid_; }
+  std::span<const uint8_t> body() const { return body_; }
+
+private:
+  void append_field(Kind kind, std::string_view field);
+
+  std::vector<uint8_t> body_ = std::vector<uint8_t>(4); // Count first
+  uint32_t count_ = 0;
+  bool valid_ = true;
+};
+
+// One operation of a Client::pipeline() batch. Only idempotent operations
+// are offered, since unanswered requests are resent if the server closes the
+// connection mid-pipeline. Views must stay valid for the duration of the call.
+struct PipelineOp {
+  enum class Kind { Put, Get, Del };
+  Kind kind;
+  std::string_view key;
+  std::string_view value = {}; // Put only
+
+  static PipelineOp put(std::string_view k, std::string_view v) {
+    return {Kind::Put, k, v};
+  }
+  static PipelineOp get(std::string_view k) { return {Kind::Get, k}; }
+  static PipelineOp del(std::string_view k) { return {Kind::Del, k}; }
+};
+
+// --- Metrics ---
+
+// Distribution of one request phase, in microseconds. Percentiles are bucket
+// upper edges, within 19% of the true value.
+struct LatencyStats {
+  uint64_t count = 0;
+  uint64_t sum_us = 0;
+  uint64_t max_us = 0;
+  uint64_t p50_us = 0;
+  uint64_t p90_us = 0;
+  uint64_t p99_us = 0;
+  uint64_t p999_us = 0;
+};
+
+// Totals for one host:port since the endpoint was first used.
+struct EndpointStats {
+  std::string endpoint; // "host:port"
+  uint64_t requests = 0; // Each redirect hop and pipelined request counts
+  uint64_t bytes_sent = 0;     // Request bodies, as sent on the wire
+  uint64_t bytes_received = 0; // Response bodies, as received on the wire
+  uint64_t redirects = 0;      // 307s followed away from this endpoint
+  uint64_t connects = 0;       // Connections opened
+  uint64_t reconnects = 0; // Connections dropped as broken or server-closed
+  uint64_t retries = 0;    // Attempts after the first (RetryOptions)
+  uint64_t circuit_opens = 0;   // Times the circuit breaker opened
+  uint64_t tls_resumptions = 0; // Connects that resumed a TLS session
+  bool circuit_open = false;    // At the time of the snapshot
+  std::array<uint64_t, error_code_count> errors{}; // Indexed by ErrorCode
+  LatencyStats connect;    // Resolve + TCP connect (+ TLS handshake)
+  LatencyStats write;      // Writing the request
+  LatencyStats first_byte; // Request written -> response header read
+  LatencyStats total;      // Connection checkout -> response read
+  // Compression (see CompressionOptions). Ratio: raw bytes / wire bytes.
+  uint64_t compressed_raw_bytes = 0;  // Request bodies before compression
+  uint64_t compressed_wire_bytes = 0; // ... and after
+  uint64_t inflated_wire_bytes = 0;   // Compressed response bodies
+  uint64_t inflated_raw_bytes = 0;    // ... and after decoding
+  LatencyStats compress;              // CPU time per compressed request
+  LatencyStats decompress;            // CPU time per decoded response
+};
+
+// SmartClient near cache (see NearCacheOptions) counters and occupancy.
+struct NearCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;        // Including expired entries
+  uint64_t revalidated = 0;   // Expired entries kept after a 304
+  uint64_t evictions = 0;     // Entries dropped to stay within max_bytes
+  uint64_t invalidations = 0; // Local writes
+  uint64_t entries = 0;
+  uint64_t bytes = 0;
+};
+
+// SmartClient write-behind (see WriteBehindOptions).
+struct WriteBehindStats {
+  uint64_t writes = 0;    // put()/patch_int() calls buffered
+  uint64_t coalesced = 0; // Of those, merged into a key already buffered
+  uint64_t requests = 0;  // Sent by flushes
+  uint64_t failed = 0;    // Flushed keys the cluster did not take
+  uint64_t keys = 0;      // Buffered now
+  uint64_t bytes = 0;     // Buffered or being flushed
+};
+
+struct ClientStats {
+  std::vector<EndpointStats> endpoints;
+  std::optional<NearCacheStats> near_cache; // SmartClient with a near cache
+  std::optional<WriteBehindStats> write_behind; // SmartClient with one
+};
+
+// Prometheus text exposition of `stats`, one series per endpoint.
+std::string to_prometheus(const ClientStats &stats,
+                          std::string_view prefix = "lite3client");
+
 // --- Forward Declarations ---
 class ClientImpl;
+class BodyPool;
+class EndpointCache;
+
+// A response body on loan from its Client's body pool (see
+// Client::get_pooled). Move-only; the storage goes back to the pool when the
+// PooledBuffer is destroyed, so steady-state reads reuse memory instead of
+// allocating. It may safely outlive the Client that produced it.
+class PooledBuffer {
+  friend class Client;
+  std::shared_ptr<BodyPool> pool_;
+  std::vector<uint8_t> data_;
+
+  PooledBuffer(std::shared_ptr<BodyPool> pool, std::vector<uint8_t> data);
+
+public:
+  PooledBuffer() = default;
+  ~PooledBuffer();
+  PooledBuffer(PooledBuffer &&) noexcept;
+  PooledBuffer &operator=(PooledBuffer &&) noexcept;
+
+  const uint8_t *data() const { return data_.data(); }
+  std::size_t size() const { return data_.size(); }
+  bool empty() const { return data_.empty(); }
+  std::string_view view() const {
+    return {reinterpret_cast<const char *>(data_.data()), data_.size()};
+  }
+
+  // Takes ownership of the bytes; they are no longer recycled.
+  lite3cpp::Buffer release() &&;
+};
 
 // --- Client Class ---
 
 class Client;
 
-// Proxy object for map-like syntax: client["key"]
+// A key prepared for repeated calls: its request target is formatted once,
+// and SmartClient remembers which node owns it until the topology changes,
+// so hot loops over the same keys neither rebuild targets nor re-run the
+// ring lookup. Safe to share between threads.
+class KeyRef {
+public:
+  explicit KeyRef(std::string_view key) : target_("/kv/") {
+    target_.append(key);
+  }
+  KeyRef(const KeyRef &other)
+      : target_(other.target_),
+        route_(other.route_.load(std::memory_order_relaxed)) {}
+  KeyRef &operator=(const KeyRef &other) {
+    target_ = other.target_;
+    route_.store(other.route_.load(std::memory_order_relaxed),
+                 std::memory_order_relaxed);
+    return *this;
+  }
+
+  std::string_view key() const {
+    return std::string_view(target_).substr(prefix);
+  }
+  std::string_view target() const { return target_; } // "/kv/<key>"
+
+private:
+  friend class SmartClient;
+  static constexpr std::size_t prefix = 4;
+
+  std::string target_;
+  // SmartClient's routing cache: snapshot stamp << 16 | node slot, or 0.
+  mutable std::atomic<uint64_t> route_{0};
+};
+
+// Proxy object for map-like syntax: client["key"]. Refers to the caller's
+// key, so it is meant to be used within the expression that made it.
 class KeyProxy {
   Client &client_;
-  std::string key_;
+  std::string_view key_;
 
 public:
   KeyProxy(Client &c, std::string_view k) : client_(c), key_(k) {}
@@ -93,7 +575,14 @@ class Client {
   std::unique_ptr<ClientImpl> impl_;
 
 public:
-  Client(std::string_view host, int port);
+  Client(std::string_view host, int port, ClientOptions options = {});
+  // Also enables the async_* operations, which run on `ioc`. The caller runs
+  // the io_context (from one or more threads) and keeps it alive.
+  Client(boost::asio::io_context &ioc, std::string_view host, int port,
+         ClientOptions options = {});
+  // Connects to an already resolved address, e.g. a /cluster/map peer.
+  explicit Client(const boost::asio::ip::tcp::endpoint &endpoint,
+                  ClientOptions options = {});
   ~Client();
 
   // Copying a client is expensive (new connection), moving is fine.
@@ -108,23 +597,173 @@ public:
   // --- Core Operations (snake_case) ---
 
   // Raw String/Bytes operations
-  Result<void> put(std::string_view key, std::string_view value);
-  Result<void> put(std::string_view key, const lite3cpp::Buffer &buf);
-  Result<lite3cpp::Buffer> get(std::string_view key);
-  Result<void> del(std::string_view key);
+  // put() sends the value straight from the caller's memory (no copy); it
+  // must not be modified until the call returns.
+  Result<void> put(std::string_view key, std::string_view value,
+                   Deadline deadline = {});
+  Result<void> put(std::string_view key, const lite3cpp::Buffer &buf,
+                   Deadline deadline = {});
+  Result<lite3cpp::Buffer> get(std::string_view key, Deadline deadline = {});
+  // Like get(), but the body is backed by recycled storage.
+  Result<PooledBuffer> get_pooled(std::string_view key,
+                                  Deadline deadline = {});
+  Result<void> del(std::string_view key, Deadline deadline = {});
+
+  // The same, with the request target taken from `key`.
+  Result<void> put(const KeyRef &key, std::string_view value,
+                   Deadline deadline = {});
+  Result<void> put(const KeyRef &key, const lite3cpp::Buffer &buf,
+                   Deadline deadline = {});
+  Result<lite3cpp::Buffer> get(const KeyRef &key, Deadline deadline = {});
+  Result<PooledBuffer> get_pooled(const KeyRef &key, Deadline deadline = {});
+  Result<void> del(const KeyRef &key, Deadline deadline = {});
 
   // Helper to check existence
   bool contains(std::string_view key) { return get(key).has_value(); }
 
   Result<void> patch_int(std::string_view key, std::string_view field,
-                         int64_t value);
+                         int64_t value, Deadline deadline = {});
   Result<void> patch_str(std::string_view key, std::string_view field,
-                         std::string_view value);
+                         std::string_view value, Deadline deadline = {});
+
+  // Applies every update of `batch` in one round trip.
+  Result<void> patch(std::string_view key, const PatchBatch &batch,
+                     Deadline deadline = {});
+
+  // --- Streaming ---
+  // Values move through one 64 KiB buffer per call instead of being held
+  // whole, so memory stays bounded for any value size. The Deadline covers
+  // the entire transfer; pass a generous one for big values on slow links.
+
+  // Delivers the value to `sink` chunk by chunk and yields its size.
+  Result<uint64_t> get_to(std::string_view key, const ChunkSink &sink,
+                          Deadline deadline = {});
+  // Uploads exactly `size` bytes read from `source`. A redirected upload
+  // cannot be replayed and fails with ServerError.
+  Result<void> put_from(std::string_view key, const ChunkSource &source,
+                        uint64_t size, Deadline deadline = {});
+  // Uploads a file, with sendfile(2) on Linux. Redirects are followed.
+  Result<void> put_file(std::string_view key, const std::string &path,
+                        Deadline deadline = {});
+
+  // --- Partial Reads ---
+  // Fetches only the named fields (GET ?op=get_fields&fields=a,b), so the
+  // rest of a large document never crosses the wire. The server answers
+  // with a JSON object of the fields it found. Results follow `fields`.
+  Result<FieldValue> get_field(std::string_view key, std::string_view field,
+                               Deadline deadline = {});
+  Result<std::vector<FieldValue>>
+  get_fields(std::string_view key, std::span<const std::string_view> fields,
+             Deadline deadline = {});
+
+  // --- Scans ---
+  // Up to `limit` keys starting with `prefix` that sort after `after`, in
+  // key order (GET /kv/<prefix>?op=scan&limit=N&after=K&values=1). A page
+  // shorter than `limit` is the last one; the next page starts after the
+  // last key of this one.
+  Result<std::vector<ScanEntry>>
+  scan_page(std::string_view prefix, std::string_view after,
+            std::size_t limit, bool values = false, Deadline deadline = {});
+
+  // --- Pipelining ---
+  // Sends `ops` over one keep-alive connection, PoolOptions::pipeline_depth
+  // at a time. Results are in input order; Put and Del yield an empty Buffer
+  // on success.
+  std::vector<Result<lite3cpp::Buffer>>
+  pipeline(std::span<const PipelineOp> ops);
+
+  // --- Connection Warm-up ---
+  // Opens connections until the pool holds PoolOptions::min_connections
+  // (at least one) in every shard, so the first requests skip the
+  // handshake. Each connect is bounded by connect_timeout and `deadline`.
+  // Only the blocking pool is warmed; async_* connections are still opened
+  // on first use.
+  Result<void> warm_up(Deadline deadline = {});
+
+  // --- Metrics ---
+  // Counters of every endpoint this Client has talked to, including
+  // redirect targets. Recording is sharded per thread and never locks.
+  ClientStats stats() const;
+
+  // --- Asynchronous Operations ---
+  // Coroutine API on the io_context given at construction; without one they
+  // complete with ErrorCode::BadRequest. Arguments are referenced, not
+  // copied: they must stay valid until the awaitable completes. Requests are
+  // bounded by ClientOptions::request_timeout.
+  boost::asio::awaitable<Result<void>> async_put(std::string_view key,
+                                                 std::string_view value);
+  boost::asio::awaitable<Result<void>>
+  async_put(std::string_view key, const lite3cpp::Buffer &buf);
+  boost::asio::awaitable<Result<lite3cpp::Buffer>>
+  async_get(std::string_view key);
+  boost::asio::awaitable<Result<void>> async_del(std::string_view key);
+  boost::asio::awaitable<Result<void>>
+  async_patch_int(std::string_view key, std::string_view field, int64_t value);
+  boost::asio::awaitable<Result<void>> async_patch_str(std::string_view key,
+                                                       std::string_view field,
+                                                       std::string_view value);
+
+  // std::future overloads: arguments are copied (or moved, for Buffer), so
+  // temporaries are fine. The io_context must be running for them to finish,
+  // and the Client must outlive the returned future.
+  std::future<Result<void>> async_put(std::string_view key,
+                                      std::string_view value,
+                                      boost::asio::use_future_t<>);
+  std::future<Result<void>> async_put(std::string_view key,
+                                      lite3cpp::Buffer buf,
+                                      boost::asio::use_future_t<>);
+  std::future<Result<lite3cpp::Buffer>> async_get(std::string_view key,
+                                                  boost::asio::use_future_t<>);
+  std::future<Result<void>> async_del(std::string_view key,
+                                      boost::asio::use_future_t<>);
+  std::future<Result<void>> async_patch_int(std::string_view key,
+                                            std::string_view field,
+                                            int64_t value,
+                                            boost::asio::use_future_t<>);
+  std::future<Result<void>> async_patch_str(std::string_view key,
+                                            std::string_view field,
+                                            std::string_view value,
+                                            boost::asio::use_future_t<>);
 
   // Advanced / Internal
   Result<std::vector<uint8_t>> impl_raw_get(std::string_view path);
 
+  // Called with the original request target and the Location endpoint each
+  // time a 307 is followed.
+  using RedirectObserver = std::function<void(
+      std::string_view target, std::string_view host, int port)>;
+
 private:
+  friend class SmartClient;
+
+  // Node clients of one SmartClient share an EndpointCache, so redirects
+  // between nodes reuse already-open connection pools.
+  Client(std::shared_ptr<EndpointCache> cache, std::string_view host,
+         int port);
+  static std::shared_ptr<EndpointCache>
+  make_endpoint_cache(ClientOptions options, boost::asio::io_context *ioc);
+  // Closes pools of endpoints no Client uses any more.
+  static void prune_endpoint_cache(EndpointCache &cache);
+  static ClientStats endpoint_cache_stats(EndpointCache &cache);
+
+  // Must be set before the Client is shared between threads.
+  void set_redirect_observer(RedirectObserver observer);
+
+  // False while this Client's endpoint has its circuit breaker open.
+  bool accepting() const;
+
+  // GET that reports the response's ETag and, given one, sends it as
+  // If-None-Match. A 304 yields not_modified with an empty body.
+  struct TaggedBody {
+    std::vector<uint8_t> body;
+    std::string etag;
+    bool not_modified = false;
+  };
+  Result<TaggedBody> tagged_get(std::string_view key, std::string_view etag,
+                                Deadline deadline);
+  // The same for any request target, such as /cluster/map.
+  Result<TaggedBody> tagged_raw_get(std::string_view path,
+                                    std::string_view etag, Deadline deadline);
 };
 
 // --- Implementations of Proxy templates ---
@@ -132,7 +771,7 @@ private:
 inline KeyProxy &KeyProxy::operator=(std::string_view val) {
   auto res = client_.put(key_, val);
   if (!res) {
-    throw std::runtime_error("Lite3 Client Error (PUT " + key_ +
+    throw std::runtime_error("Lite3 Client Error (PUT " + std::string(key_) +
                              "): " + res.error().message);
   }
   return *this;
@@ -1,43 +1,375 @@
 #pragma once
 
 #include "client.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <lite3/ring.hpp>
 #include <map>
 #include <memory>
 #include <mutex>
-#include <shared_mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace lite3 {
 
+// Where SmartClient reads may go. Writes always go to the key's owner.
+struct ReplicaOptions {
+  // Nodes a key is read from: the ring owner plus the next
+  // replication_factor - 1 nodes in node-ID order (at most 8). With more
+  // than one, reads go to the replica with the least load and latency,
+  // nodes with an open circuit breaker last. Reads that fail to connect, or
+  // that find no key on a node other than the owner, move on to the next
+  // replica; only the owner's NotFound is final.
+  // The cluster map only names owners, and reads from nodes that do not
+  // hold the key cost a redirect or a wasted round trip, so until it names
+  // replica sets, values above 1 are capped at 1 and connect() logs a
+  // warning. Scans still take each key from its owner only.
+  std::size_t replication_factor = 1;
+  // Blocking reads that have not completed after the hedge delay are also
+  // sent to the next-best replica, and the first final answer wins. Needs
+  // more than one replica (see above).
+  // Attempts run on the SmartClient's worker threads (at most 64, joined by
+  // ~SmartClient), so reserve this for latency-sensitive traffic.
+  bool hedge_reads = false;
+  // Zero derives the delay from the observed p95 read latency; no hedges
+  // are sent until enough reads have been timed.
+  std::chrono::milliseconds hedge_delay{0};
+  std::chrono::microseconds min_hedge_delay{500}; // Floor for derived delay
+};
+
+// In-process cache in front of SmartClient::get() for hot keys. Local
+// writes through the same SmartClient invalidate their key at once; writes
+// by anyone else become visible when the entry expires.
+struct NearCacheOptions {
+  std::size_t max_bytes = 0; // Keys + values over all shards. Zero: off
+  std::chrono::milliseconds ttl{1000}; // Zero: until evicted or invalidated
+  // Expired entries that came with an ETag are revalidated with
+  // If-None-Match; a 304 keeps the cached value for another TTL.
+  bool revalidate = false;
+  std::size_t shards = 16; // Independently locked
+};
+
+// Write-behind buffering of SmartClient::put() and patch_int(), for keys
+// written far more often than the cluster needs to see. Writes to a key
+// within one window coalesce: a put replaces whatever was buffered for the
+// key, and the last patch_int to a field wins, so a flush sends each key at
+// most one put and one patch. A background thread flushes every window,
+// puts pipelined per owning node. Buffered writes return at once; reads do
+// not see them until flushed. Other writes to a buffered key (del, patch,
+// patch_str, streaming, multi_put) flush it first, or for del discard it,
+// and fail unsent if that flush fails; async_* writes go straight out,
+// unordered with the buffer.
+struct WriteBehindOptions {
+  std::chrono::milliseconds window{0}; // Zero: off
+  // Keys, values and fields buffered or being flushed. A write that does
+  // not fit waits for a flush until its deadline (by default
+  // ClientOptions::request_timeout), then fails with ErrorCode::Timeout.
+  std::size_t max_bytes = 16 << 20;
+};
+
+// Paging of SmartClient::scan().
+struct ScanOptions {
+  std::size_t page_size = 1000; // Entries per request to a node
+  bool values = false;          // Fetch each key's value along with it
+  std::size_t prefetch = 2;     // Pages per node fetched ahead of next()
+};
+
+// The lazy result of SmartClient::scan(). Nodes are paged in parallel on
+// the SmartClient's worker threads, at most ScanOptions::prefetch pages
+// ahead of the caller, so memory stays bounded however many keys match.
+// Each node's keys come in key order, interleaved with the other nodes'.
+// Used by one thread at a time; destroying it stops the fetches after
+// their current request. Nodes not done when the SmartClient is destroyed
+// report an error instead of their remaining keys.
+class KeyScan {
+public:
+  KeyScan(KeyScan &&) noexcept;
+  KeyScan &operator=(KeyScan &&) noexcept;
+  ~KeyScan();
+
+  // The next entry, or std::nullopt once every node is done. A node that
+  // fails is reported once; entries from the other nodes still follow.
+  Result<std::optional<ScanEntry>> next();
+
+private:
+  friend class SmartClient;
+  struct State;
+  explicit KeyScan(std::shared_ptr<State> state);
+
+  std::shared_ptr<State> state_;
+  std::vector<ScanEntry> page_;
+  std::size_t pos_ = 0;
+};
+
+// --- Logging ---
+
+enum class LogLevel { Debug, Info, Warning, Error };
+// Receives SmartClient's diagnostics: nodes joining and leaving, failed
+// background refreshes. Called from whichever thread refreshed.
+using Logger = std::function<void(LogLevel, std::string_view)>;
+
+// A node SmartClient could not open a connection to while warming up.
+struct UnreachableNode {
+  uint32_t id;
+  std::string endpoint; // "host:port"
+  Error error;
+};
+
+class WorkerPool;
+
 class SmartClient {
 public:
-  SmartClient(std::string_view seed_host, int seed_port);
+  SmartClient(std::string_view seed_host, int seed_port,
+              ClientOptions options = {}, ReplicaOptions replicas = {},
+              NearCacheOptions near_cache = {},
+              WriteBehindOptions write_behind = {});
+  // Node clients run their async_* operations on `ioc`.
+  SmartClient(boost::asio::io_context &ioc, std::string_view seed_host,
+              int seed_port, ClientOptions options = {},
+              ReplicaOptions replicas = {}, NearCacheOptions near_cache = {},
+              WriteBehindOptions write_behind = {});
+  // Flushes buffered writes (see WriteBehindOptions) before returning.
   ~SmartClient();
 
-  // Connect to seed and fetch cluster topology
+  // Connect to seed and fetch cluster topology. With ClientOptions::
+  // warmup.on_connect, this and every later refresh also warm up new nodes
+  // in parallel before routing to them (see Client::warm_up()). Unreachable
+  // nodes do not fail the refresh; they are reported by unreachable_nodes().
   Result<void> connect();
 
-  Result<void> put(std::string_view key, std::string_view value);
-  Result<void> put(std::string_view key, const lite3cpp::Buffer &buf);
-  Result<lite3cpp::Buffer> get(std::string_view key);
-  Result<void> del(std::string_view key);
+  // Nothing is logged until a logger is set. Set it before connect().
+  void set_logger(Logger logger);
+
+  // Warms up every node of the current topology now. Returns the nodes that
+  // failed, in ID order.
+  std::vector<UnreachableNode> warm_up(Deadline deadline = {});
+  // Failures of the last warm-up, from connect(), a refresh or warm_up().
+  std::vector<UnreachableNode> unreachable_nodes() const;
+
+  // --- Topology Refresh ---
+  // Starts a background thread that re-fetches the cluster map every
+  // `interval` (zero: only on demand) and whenever a refresh is requested.
+  // Redirects and connection errors request one automatically; requested
+  // refreshes run at most once per `min_gap`. Requests never wait on a
+  // refresh: the new topology is built aside and swapped in, keeping the
+  // Clients (and warm pools) of unchanged nodes.
+  void start_background_refresh(
+      std::chrono::milliseconds interval,
+      std::chrono::milliseconds min_gap = std::chrono::seconds(1));
+  // Asks the background thread for a refresh; no-op if it is not running.
+  void request_refresh();
+  // The cluster map is fetched as GET /cluster/map?format=binary, and as
+  // JSON from seeds that decline it. Refreshes send the map's ETag as
+  // If-None-Match, and a 304 or an unchanged epoch leaves routing as is.
+  // Returns the epoch of the map in use; 0 if the seed does not number them.
+  uint64_t topology_epoch() const;
+
+  // An explicit Deadline covers the whole call, including replica failover
+  // and hedged attempts. get() is served from the near cache when one is
+  // configured; get_pooled() always goes to the cluster.
+  Result<void> put(std::string_view key, std::string_view value,
+                   Deadline deadline = {});
+  Result<void> put(std::string_view key, const lite3cpp::Buffer &buf,
+                   Deadline deadline = {});
+  Result<lite3cpp::Buffer> get(std::string_view key, Deadline deadline = {});
+  Result<PooledBuffer> get_pooled(std::string_view key,
+                                  Deadline deadline = {});
+  Result<void> del(std::string_view key, Deadline deadline = {});
+
+  // The same for a prepared key, routed from its cached owner while the
+  // topology is unchanged; redirect hints still apply.
+  Result<void> put(const KeyRef &key, std::string_view value,
+                   Deadline deadline = {});
+  Result<void> put(const KeyRef &key, const lite3cpp::Buffer &buf,
+                   Deadline deadline = {});
+  Result<lite3cpp::Buffer> get(const KeyRef &key, Deadline deadline = {});
+  Result<PooledBuffer> get_pooled(const KeyRef &key, Deadline deadline = {});
+  Result<void> del(const KeyRef &key, Deadline deadline = {});
+
+  // Streaming transfers (see Client::get_to()) always go to the key's
+  // owner: a chunk already handed to the sink cannot be taken back, so
+  // there is no replica failover.
+  Result<uint64_t> get_to(std::string_view key, const ChunkSink &sink,
+                          Deadline deadline = {});
+  Result<void> put_from(std::string_view key, const ChunkSource &source,
+                        uint64_t size, Deadline deadline = {});
+  Result<void> put_file(std::string_view key, const std::string &path,
+                        Deadline deadline = {});
+
+  // Partial reads (see Client::get_field()), routed like get() but never
+  // cached.
+  Result<FieldValue> get_field(std::string_view key, std::string_view field,
+                               Deadline deadline = {});
+  Result<std::vector<FieldValue>>
+  get_fields(std::string_view key, std::span<const std::string_view> fields,
+             Deadline deadline = {});
 
   Result<void> patch_int(std::string_view key, std::string_view field,
-                         int64_t value);
+                         int64_t value, Deadline deadline = {});
   Result<void> patch_str(std::string_view key, std::string_view field,
-                         std::string_view value);
+                         std::string_view value, Deadline deadline = {});
+  Result<void> patch(std::string_view key, const PatchBatch &batch,
+                     Deadline deadline = {});
+
+  // Sends every buffered write now and waits for them, and for a
+  // background flush already under way. Returns the first failure; keys
+  // that failed are dropped, as in background flushes. Without
+  // write-behind, a no-op.
+  Result<void> flush();
+
+  // --- Scans ---
+  // Every key starting with `prefix`, from all nodes in parallel (see
+  // Client::scan_page()). With replication_factor > 1, each key is taken
+  // only from its ring owner, so replicas do not repeat it.
+  KeyScan scan(std::string_view prefix, ScanOptions options = {});
+
+  // --- Batch Operations ---
+  // Keys are grouped by owning node under one routing lookup, and each
+  // node's group is sent as one pipelined batch (see PoolOptions::
+  // pipeline_depth), with node groups in flight in parallel. Results are in
+  // input order with per-key errors.
+  std::vector<Result<lite3cpp::Buffer>>
+  multi_get(std::span<const std::string_view> keys);
+  std::vector<Result<void>> multi_put(
+      std::span<const std::pair<std::string_view, std::string_view>> items);
+
+  // --- Metrics ---
+  // Counters of every node endpoint (see Client::stats()), plus the near
+  // cache's. Endpoints that leave the cluster drop out once their
+  // connections are closed.
+  ClientStats stats() const;
+
+  // --- Asynchronous Operations ---
+  // Same lifetime rules as the Client coroutine and future overloads.
+  boost::asio::awaitable<Result<void>> async_put(std::string_view key,
+                                                 std::string_view value);
+  boost::asio::awaitable<Result<void>>
+  async_put(std::string_view key, const lite3cpp::Buffer &buf);
+  boost::asio::awaitable<Result<lite3cpp::Buffer>>
+  async_get(std::string_view key);
+  boost::asio::awaitable<Result<void>> async_del(std::string_view key);
+  boost::asio::awaitable<Result<void>>
+  async_patch_int(std::string_view key, std::string_view field, int64_t value);
+  boost::asio::awaitable<Result<void>> async_patch_str(std::string_view key,
+                                                       std::string_view field,
+                                                       std::string_view value);
+
+  std::future<Result<void>> async_put(std::string_view key,
+                                      std::string_view value,
+                                      boost::asio::use_future_t<>);
+  std::future<Result<void>> async_put(std::string_view key,
+                                      lite3cpp::Buffer buf,
+                                      boost::asio::use_future_t<>);
+  std::future<Result<lite3cpp::Buffer>> async_get(std::string_view key,
+                                                  boost::asio::use_future_t<>);
+  std::future<Result<void>> async_del(std::string_view key,
+                                      boost::asio::use_future_t<>);
+  std::future<Result<void>> async_patch_int(std::string_view key,
+                                            std::string_view field,
+                                            int64_t value,
+                                            boost::asio::use_future_t<>);
+  std::future<Result<void>> async_patch_str(std::string_view key,
+                                            std::string_view field,
+                                            std::string_view value,
+                                            boost::asio::use_future_t<>);
 
 private:
-  Result<void> refresh_topology_unsafe();
+  Result<void> refresh_topology();
+  void log(LogLevel level, std::string_view message) const;
+  void refresh_loop(std::chrono::milliseconds interval,
+                    std::chrono::milliseconds min_gap);
+  template <typename T> Result<T> observe(Result<T> res);
+  struct RoutingSnapshot;
+  struct ThreadRoutes;
+  struct NodeLoad;
+  struct ReadLatency;
+  struct NearCache;
+  struct WriteBehind;
+  struct Replica {
+    std::shared_ptr<Client> client;
+    std::shared_ptr<NodeLoad> load;
+    bool owner = false; // Routed to by the ring or a redirect hint
+  };
+  RoutingSnapshot &snapshot();
   std::shared_ptr<Client> get_client_for_key(std::string_view key);
+  std::shared_ptr<Client> get_client_for_key(const KeyRef &key);
+  std::size_t route_slot(RoutingSnapshot &snap, std::string_view key);
+  std::size_t route_slot(RoutingSnapshot &snap, const KeyRef &key);
+  std::size_t replicas_for(std::string_view key, std::span<Replica> out);
+  std::size_t replicas_for(const KeyRef &key, std::span<Replica> out);
+  std::size_t replicas_from(RoutingSnapshot &snap, std::size_t owner,
+                            std::span<Replica> out);
+  template <typename T, typename Key, typename Op>
+  static Result<T> timed_read(const Replica &r, ReadLatency &latency,
+                              const Key &key, Op &op);
+  template <typename T, typename Key, typename Op>
+  Result<T> replicated_read(const Key &key, Op op);
+  std::chrono::microseconds hedge_delay() const;
+  Result<lite3cpp::Buffer> cached_get(std::string_view key, Deadline deadline);
+  template <typename T>
+  Result<T> invalidated(std::string_view key, Result<T> res);
+  Result<void> settle(std::string_view key, bool discard = false);
+  std::vector<Result<lite3cpp::Buffer>>
+  run_batch(std::span<const PipelineOp> ops);
+  std::shared_ptr<Client> make_node_client(const std::string &host, int port);
+  struct WarmTarget {
+    uint32_t id;
+    std::string endpoint;
+    Client *client;
+  };
+  std::vector<UnreachableNode> warm(std::span<const WarmTarget> targets,
+                                    Deadline deadline);
+  void on_redirect(std::string_view target, std::string_view host, int port);
 
   std::string seed_host_;
   int seed_port_;
+  ClientOptions options_; // Applied to every per-node Client
+  ReplicaOptions replicas_;
+  std::shared_ptr<ReadLatency> read_latency_; // Shared with hedge tasks
+  // Runs hedged reads and scan pages; joined before the members they use
+  // go away.
+  std::shared_ptr<WorkerPool> workers_;
+  std::unique_ptr<NearCache> near_cache_; // Null when disabled
+  boost::asio::io_context *ioc_ = nullptr; // Async executor, if any
+  std::shared_ptr<EndpointCache> endpoints_; // Shared by all node clients
+
+  // Ring + node table, replaced wholesale by refresh_topology(). Threads
+  // cache the current snapshot (see snapshot()); ~SmartClient drops those
+  // caches, so its connections close with it.
+  std::atomic<std::shared_ptr<RoutingSnapshot>> routing_;
+  std::atomic<uint64_t> routing_version_{0};
+  const uint64_t instance_id_; // Tags thread-local snapshot caches
+
+  struct StringHash {
+    using is_transparent = void;
+    std::size_t operator()(std::string_view s) const {
+      return std::hash<std::string_view>{}(s);
+    }
+  };
+
+  mutable std::mutex unreachable_mutex_;
+  std::vector<UnreachableNode> unreachable_;
+
+  std::mutex refresh_mutex_; // Serializes fetch + swap; never held by readers
+  // Guarded by refresh_mutex_: the ETag of the map in use, and whether the
+  // seed rejected ?format=binary.
+  std::string map_etag_;
+  bool binary_map_declined_ = false;
+  Logger logger_; // Set before connect()
+  std::mutex refresher_mutex_;
+  std::condition_variable refresher_cv_;
+  bool refresher_stop_ = false;
+  bool refresh_requested_ = false;
+  std::thread refresher_;
 
-  std::shared_mutex mutex_;
-  lite3::ConsistentHash ring_;
-  std::map<uint32_t, std::shared_ptr<Client>> clients_; // NodeID -> Client
+  std::unique_ptr<WriteBehind> write_behind_; // Null when disabled
 };
 
 } // namespace lite3
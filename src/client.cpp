@@ -1,264 +1,3804 @@
 #include "lite3/client.hpp"
 
+#include <boost/asio/co_spawn.hpp>
 #include <boost/asio/connect.hpp>
+#include <boost/asio/detail/socket_ops.hpp> // poll_read/poll_write
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
+#ifdef LITE3CLIENT_WITH_OPENSSL
+#include <boost/asio/ssl.hpp>
+#include <boost/beast/ssl.hpp>
+#endif
+#include <nlohmann/json.hpp>
+#ifdef LITE3CLIENT_WITH_ZLIB
+#include <zlib.h>
+#endif
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <span>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 namespace beast = boost::beast; // from <boost/beast.hpp>
 namespace http = beast::http;   // from <boost/beast/http.hpp>
 namespace net = boost::asio;    // from <boost/asio.hpp>
 using tcp = net::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
 
-namespace lite3 {
+namespace lite3 {
+
+namespace {
+
+// Views caller memory as a request body without copying it.
+std::span<const uint8_t> as_bytes(std::string_view s) {
+  return {reinterpret_cast<const uint8_t *>(s.data()), s.size()};
+}
+
+// RFC 3986 unreserved characters, which go into a query value as-is.
+constexpr bool unreserved(unsigned char c) {
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+         (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_' ||
+         c == '~';
+}
+
+// Length of the leading run of unreserved bytes, 16 at a time where SSE2 is
+// available: most field names and values are plain identifiers.
+std::size_t unreserved_prefix(std::string_view s) {
+  std::size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+  auto in_range = [](__m128i x, char lo, char hi) {
+    auto off = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+    auto over = _mm_subs_epu8(off, _mm_set1_epi8(static_cast<char>(hi - lo)));
+    return _mm_cmpeq_epi8(over, _mm_setzero_si128());
+  };
+  for (; i + 16 <= s.size(); i += 16) {
+    auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.data() + i));
+    auto ok = _mm_or_si128(
+        _mm_or_si128(in_range(x, 'A', 'Z'), in_range(x, 'a', 'z')),
+        _mm_or_si128(in_range(x, '0', '9'), in_range(x, '-', '.')));
+    ok = _mm_or_si128(ok, _mm_cmpeq_epi8(x, _mm_set1_epi8('_')));
+    ok = _mm_or_si128(ok, _mm_cmpeq_epi8(x, _mm_set1_epi8('~')));
+    auto mask = static_cast<unsigned>(_mm_movemask_epi8(ok));
+    if (mask != 0xFFFF)
+      return i + std::countr_one(mask);
+  }
+#endif
+  while (i < s.size() && unreserved(static_cast<unsigned char>(s[i])))
+    ++i;
+  return i;
+}
+
+void percent_encode(std::string_view s, std::string &out) {
+  static constexpr char hex[] = "0123456789ABCDEF";
+  while (!s.empty()) {
+    auto n = unreserved_prefix(s);
+    out.append(s.substr(0, n));
+    if (n == s.size())
+      return;
+    auto c = static_cast<unsigned char>(s[n]);
+    const char escaped[] = {'%', hex[c >> 4], hex[c & 15]};
+    out.append(escaped, 3);
+    s.remove_prefix(n + 1);
+  }
+}
+
+// Builds "/kv/<key>?name=value&..." with percent-encoded query values,
+// reusing the target string's capacity instead of concatenating
+// temporaries. Keys are sent as given, as before.
+class TargetBuilder {
+public:
+  TargetBuilder(std::string &out, std::string_view key) : out_(out) {
+    out_.clear();
+    out_.append("/kv/").append(key);
+  }
+  // Builds into this thread's scratch string. The target is valid until the
+  // next TargetBuilder on the thread, so blocking calls only: a coroutine
+  // may resume after another one reused it.
+  explicit TargetBuilder(std::string_view key)
+      : TargetBuilder(scratch(), key) {}
+
+  TargetBuilder &param(std::string_view name, std::string_view value) {
+    separator();
+    out_.append(name).push_back('=');
+    percent_encode(value, out_);
+    return *this;
+  }
+  TargetBuilder &param(std::string_view name, int64_t value) {
+    separator();
+    out_.append(name).push_back('=');
+    char digits[24];
+    auto end = std::to_chars(digits, digits + sizeof digits, value).ptr;
+    out_.append(digits, end);
+    return *this;
+  }
+
+  // Comma-separated list, each item encoded.
+  TargetBuilder &param(std::string_view name,
+                       std::span<const std::string_view> values) {
+    separator();
+    out_.append(name).push_back('=');
+    for (std::size_t i = 0; i < values.size(); ++i) {
+      if (i > 0)
+        out_.push_back(',');
+      percent_encode(values[i], out_);
+    }
+    return *this;
+  }
+
+  std::string_view str() const { return out_; }
+
+private:
+  static std::string &scratch() {
+    thread_local std::string target;
+    return target;
+  }
+  void separator() {
+    out_.push_back(first_ ? '?' : '&');
+    first_ = false;
+  }
+
+  std::string &out_;
+  bool first_ = true;
+};
+
+// patch_str values this long, or with bytes outside printable ASCII, go in
+// a PatchBatch body: percent-encoding them would triple their size.
+constexpr std::size_t max_query_value = 512;
+
+bool fits_query(std::string_view value) {
+  if (value.size() > max_query_value)
+    return false;
+  return std::all_of(value.begin(), value.end(), [](unsigned char c) {
+    return c >= 0x20 && c < 0x7f;
+  });
+}
+
+} // namespace
+
+// --- Metrics ---
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+constexpr auto relaxed = std::memory_order_relaxed;
+
+uint64_t micros(Clock::duration d) {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+}
+
+// Log-linear latency buckets: four per power of two, up to about 67 s.
+constexpr std::size_t latency_buckets = 4 * 26;
+
+std::size_t latency_bucket(uint64_t us) {
+  if (us < 4)
+    return us;
+  std::size_t msb = std::bit_width(us) - 1;
+  return std::min((msb - 1) * 4 + ((us >> (msb - 2)) & 3),
+                  latency_buckets - 1);
+}
+
+// Exclusive upper edge of bucket `b`.
+uint64_t bucket_ceiling(std::size_t b) {
+  ++b;
+  return b < 4 ? b : (4 + b % 4) << (b / 4 - 1);
+}
+
+struct Histogram {
+  std::array<std::atomic<uint64_t>, latency_buckets> counts{};
+  std::atomic<uint64_t> sum_us{0};
+  std::atomic<uint64_t> max_us{0};
+
+  void record(uint64_t us) {
+    counts[latency_bucket(us)].fetch_add(1, relaxed);
+    sum_us.fetch_add(us, relaxed);
+    auto prev = max_us.load(relaxed);
+    while (us > prev && !max_us.compare_exchange_weak(prev, us, relaxed)) {
+    }
+  }
+};
+
+LatencyStats summarize(const std::array<uint64_t, latency_buckets> &counts,
+                       uint64_t sum_us, uint64_t max_us) {
+  LatencyStats out;
+  for (auto c : counts)
+    out.count += c;
+  out.sum_us = sum_us;
+  out.max_us = max_us;
+  if (out.count == 0)
+    return out;
+
+  auto at = [&](double q) {
+    auto want = static_cast<uint64_t>(q * static_cast<double>(out.count - 1));
+    uint64_t seen = 0;
+    for (std::size_t b = 0; b < counts.size(); ++b) {
+      seen += counts[b];
+      if (seen > want)
+        return std::min(bucket_ceiling(b), max_us);
+    }
+    return max_us;
+  };
+  out.p50_us = at(0.5);
+  out.p90_us = at(0.9);
+  out.p99_us = at(0.99);
+  out.p999_us = at(0.999);
+  return out;
+}
+
+constexpr std::size_t metric_shards = 8;
+
+// Numbers threads in order of first use.
+std::size_t thread_index() {
+  static std::atomic<std::size_t> next{0};
+  thread_local const std::size_t index = next.fetch_add(1, relaxed);
+  return index;
+}
+
+// Each thread records into one shard, assigned round-robin on first use.
+std::size_t thread_shard() { return thread_index() % metric_shards; }
+
+// The calling thread's pool shard; see PoolOptions::shards.
+std::size_t pool_shard(const PoolOptions &opts) {
+  if (opts.shards <= 1)
+    return 0;
+#ifdef __linux__
+  if (opts.shard_by_cpu) {
+    const int cpu = ::sched_getcpu();
+    if (cpu >= 0)
+      return static_cast<std::size_t>(cpu) % opts.shards;
+  }
+#endif
+  return thread_index() % opts.shards;
+}
+
+std::string_view error_code_name(ErrorCode code) {
+  switch (code) {
+  case ErrorCode::ConnectionRefused:
+    return "connection_refused";
+  case ErrorCode::NetworkError:
+    return "network_error";
+  case ErrorCode::Timeout:
+    return "timeout";
+  case ErrorCode::BadRequest:
+    return "bad_request";
+  case ErrorCode::NotFound:
+    return "not_found";
+  case ErrorCode::ServerError:
+    return "server_error";
+  case ErrorCode::SerializationError:
+    return "serialization_error";
+  case ErrorCode::Unknown:
+    break;
+  }
+  return "unknown";
+}
+
+} // namespace
+
+// Counters for one endpoint, split into cache-line-aligned shards so
+// threads talking to the same node do not contend on one set of atomics.
+// snapshot() sums the shards.
+class EndpointMetrics {
+public:
+  enum Phase {
+    Connect,
+    Write,
+    FirstByte,
+    Total,
+    Compress,
+    Decompress,
+    PhaseCount
+  };
+
+  void connected(Clock::duration took) {
+    auto &s = shard();
+    s.connects.fetch_add(1, relaxed);
+    s.phases[Connect].record(micros(took));
+  }
+  void dropped() { shard().reconnects.fetch_add(1, relaxed); }
+  void retried() { shard().retries.fetch_add(1, relaxed); }
+  void circuit_opened() { shard().circuit_opens.fetch_add(1, relaxed); }
+  void tls_resumed() { shard().tls_resumptions.fetch_add(1, relaxed); }
+  void redirected() { shard().redirects.fetch_add(1, relaxed); }
+  void failed(ErrorCode code) {
+    shard().errors[static_cast<std::size_t>(code)].fetch_add(1, relaxed);
+  }
+  void exchanged(std::size_t sent, std::size_t received) {
+    auto &s = shard();
+    s.requests.fetch_add(1, relaxed);
+    s.bytes_sent.fetch_add(sent, relaxed);
+    s.bytes_received.fetch_add(received, relaxed);
+  }
+  void compressed(std::size_t raw, std::size_t wire, Clock::duration took) {
+    auto &s = shard();
+    s.compressed_raw.fetch_add(raw, relaxed);
+    s.compressed_wire.fetch_add(wire, relaxed);
+    s.phases[Compress].record(micros(took));
+  }
+  void inflated(std::size_t wire, std::size_t raw, Clock::duration took) {
+    auto &s = shard();
+    s.inflated_wire.fetch_add(wire, relaxed);
+    s.inflated_raw.fetch_add(raw, relaxed);
+    s.phases[Decompress].record(micros(took));
+  }
+  void timed(Phase phase, Clock::duration took) {
+    shard().phases[phase].record(micros(took));
+  }
+
+  EndpointStats snapshot(std::string endpoint) const {
+    EndpointStats out;
+    out.endpoint = std::move(endpoint);
+    std::array<std::array<uint64_t, latency_buckets>, PhaseCount> counts{};
+    std::array<uint64_t, PhaseCount> sums{};
+    std::array<uint64_t, PhaseCount> maxes{};
+    for (const auto &s : shards_) {
+      out.requests += s.requests.load(relaxed);
+      out.bytes_sent += s.bytes_sent.load(relaxed);
+      out.bytes_received += s.bytes_received.load(relaxed);
+      out.redirects += s.redirects.load(relaxed);
+      out.connects += s.connects.load(relaxed);
+      out.reconnects += s.reconnects.load(relaxed);
+      out.retries += s.retries.load(relaxed);
+      out.circuit_opens += s.circuit_opens.load(relaxed);
+      out.tls_resumptions += s.tls_resumptions.load(relaxed);
+      out.compressed_raw_bytes += s.compressed_raw.load(relaxed);
+      out.compressed_wire_bytes += s.compressed_wire.load(relaxed);
+      out.inflated_wire_bytes += s.inflated_wire.load(relaxed);
+      out.inflated_raw_bytes += s.inflated_raw.load(relaxed);
+      for (std::size_t e = 0; e < error_code_count; ++e)
+        out.errors[e] += s.errors[e].load(relaxed);
+      for (std::size_t p = 0; p < PhaseCount; ++p) {
+        for (std::size_t b = 0; b < latency_buckets; ++b)
+          counts[p][b] += s.phases[p].counts[b].load(relaxed);
+        sums[p] += s.phases[p].sum_us.load(relaxed);
+        maxes[p] = std::max(maxes[p], s.phases[p].max_us.load(relaxed));
+      }
+    }
+    out.connect = summarize(counts[Connect], sums[Connect], maxes[Connect]);
+    out.write = summarize(counts[Write], sums[Write], maxes[Write]);
+    out.first_byte =
+        summarize(counts[FirstByte], sums[FirstByte], maxes[FirstByte]);
+    out.total = summarize(counts[Total], sums[Total], maxes[Total]);
+    out.compress =
+        summarize(counts[Compress], sums[Compress], maxes[Compress]);
+    out.decompress =
+        summarize(counts[Decompress], sums[Decompress], maxes[Decompress]);
+    return out;
+  }
+
+private:
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> bytes_sent{0};
+    std::atomic<uint64_t> bytes_received{0};
+    std::atomic<uint64_t> redirects{0};
+    std::atomic<uint64_t> connects{0};
+    std::atomic<uint64_t> reconnects{0};
+    std::atomic<uint64_t> retries{0};
+    std::atomic<uint64_t> circuit_opens{0};
+    std::atomic<uint64_t> tls_resumptions{0};
+    std::atomic<uint64_t> compressed_raw{0};
+    std::atomic<uint64_t> compressed_wire{0};
+    std::atomic<uint64_t> inflated_wire{0};
+    std::atomic<uint64_t> inflated_raw{0};
+    std::array<std::atomic<uint64_t>, error_code_count> errors{};
+    std::array<Histogram, PhaseCount> phases;
+  };
+
+  Shard &shard() { return shards_[thread_shard()]; }
+
+  std::array<Shard, metric_shards> shards_;
+};
+
+std::string to_prometheus(const ClientStats &stats, std::string_view prefix) {
+  std::string out;
+  auto header = [&](std::string_view name, std::string_view type,
+                    std::string_view help) {
+    out.append("# HELP ").append(prefix).append("_").append(name);
+    out.append(" ").append(help).append("\n");
+    out.append("# TYPE ").append(prefix).append("_").append(name);
+    out.append(" ").append(type).append("\n");
+  };
+  auto sample = [&](std::string_view name, const EndpointStats &ep,
+                    std::string_view extra_labels, uint64_t value) {
+    out.append(prefix).append("_").append(name);
+    out.append("{endpoint=\"").append(ep.endpoint).append("\"");
+    out.append(extra_labels).append("} ");
+    out.append(std::to_string(value)).append("\n");
+  };
+  auto counter = [&](std::string_view name, std::string_view help,
+                     uint64_t EndpointStats::*field) {
+    header(name, "counter", help);
+    for (const auto &ep : stats.endpoints)
+      sample(name, ep, "", ep.*field);
+  };
+
+  counter("requests_total", "Requests sent.", &EndpointStats::requests);
+  counter("sent_bytes_total", "Request body bytes sent.",
+          &EndpointStats::bytes_sent);
+  counter("received_bytes_total", "Response body bytes received.",
+          &EndpointStats::bytes_received);
+  counter("redirects_total", "Redirects followed.", &EndpointStats::redirects);
+  counter("connects_total", "Connections opened.", &EndpointStats::connects);
+  counter("reconnects_total", "Connections dropped as broken or closed.",
+          &EndpointStats::reconnects);
+  counter("retries_total", "Attempts after the first.",
+          &EndpointStats::retries);
+  counter("circuit_opens_total", "Times the circuit breaker opened.",
+          &EndpointStats::circuit_opens);
+  header("circuit_open", "gauge", "1 while the circuit breaker is open.");
+  for (const auto &ep : stats.endpoints)
+    sample("circuit_open", ep, "", ep.circuit_open ? 1 : 0);
+  counter("tls_resumptions_total", "Connects that resumed a TLS session.",
+          &EndpointStats::tls_resumptions);
+  counter("compress_input_bytes_total", "Request body bytes compressed.",
+          &EndpointStats::compressed_raw_bytes);
+  counter("compress_output_bytes_total", "Compressed request body bytes.",
+          &EndpointStats::compressed_wire_bytes);
+  counter("decompress_input_bytes_total", "Compressed response body bytes.",
+          &EndpointStats::inflated_wire_bytes);
+  counter("decompress_output_bytes_total", "Decoded response body bytes.",
+          &EndpointStats::inflated_raw_bytes);
+
+  header("errors_total", "counter", "Requests that failed, by error code.");
+  for (const auto &ep : stats.endpoints)
+    for (std::size_t e = 0; e < error_code_count; ++e)
+      if (ep.errors[e] != 0) {
+        std::string code = ",code=\"";
+        code.append(error_code_name(static_cast<ErrorCode>(e))).append("\"");
+        sample("errors_total", ep, code, ep.errors[e]);
+      }
+
+  constexpr std::string_view latency = "phase_duration_microseconds";
+  header(latency, "summary", "Request phase latency.");
+  for (const auto &ep : stats.endpoints) {
+    const std::pair<std::string_view, const LatencyStats *> phases[] = {
+        {"connect", &ep.connect},
+        {"write", &ep.write},
+        {"first_byte", &ep.first_byte},
+        {"total", &ep.total},
+        {"compress", &ep.compress},
+        {"decompress", &ep.decompress}};
+    for (const auto &[phase, l] : phases) {
+      std::string labels = ",phase=\"";
+      labels.append(phase).append("\"");
+      const std::pair<std::string_view, uint64_t> quantiles[] = {
+          {"0.5", l->p50_us},
+          {"0.9", l->p90_us},
+          {"0.99", l->p99_us},
+          {"0.999", l->p999_us}};
+      for (const auto &[q, value] : quantiles) {
+        std::string with_q = labels;
+        with_q.append(",quantile=\"").append(q).append("\"");
+        sample(latency, ep, with_q, value);
+      }
+      sample(std::string(latency) + "_sum", ep, labels, l->sum_us);
+      sample(std::string(latency) + "_count", ep, labels, l->count);
+    }
+  }
+
+  if (const auto &nc = stats.near_cache) {
+    auto cache = [&](std::string_view name, std::string_view type,
+                     std::string_view help, uint64_t value) {
+      std::string full = "near_cache_";
+      full.append(name);
+      header(full, type, help);
+      out.append(prefix).append("_").append(full).append(" ");
+      out.append(std::to_string(value)).append("\n");
+    };
+    cache("hits_total", "counter", "Reads served from the near cache.",
+          nc->hits);
+    cache("misses_total", "counter", "Reads the near cache could not serve.",
+          nc->misses);
+    cache("revalidated_total", "counter", "Expired entries kept after a 304.",
+          nc->revalidated);
+    cache("evictions_total", "counter", "Entries evicted to stay in budget.",
+          nc->evictions);
+    cache("invalidations_total", "counter", "Entries invalidated by writes.",
+          nc->invalidations);
+    cache("entries", "gauge", "Entries cached.", nc->entries);
+    cache("bytes", "gauge", "Key and value bytes cached.", nc->bytes);
+  }
+
+  if (const auto &wb = stats.write_behind) {
+    auto buffer = [&](std::string_view name, std::string_view type,
+                      std::string_view help, uint64_t value) {
+      std::string full = "write_behind_";
+      full.append(name);
+      header(full, type, help);
+      out.append(prefix).append("_").append(full).append(" ");
+      out.append(std::to_string(value)).append("\n");
+    };
+    buffer("writes_total", "counter", "Writes buffered.", wb->writes);
+    buffer("coalesced_total", "counter",
+           "Buffered writes merged into a pending key.", wb->coalesced);
+    buffer("requests_total", "counter", "Requests sent by flushes.",
+           wb->requests);
+    buffer("failed_total", "counter", "Flushed keys the cluster rejected.",
+           wb->failed);
+    buffer("keys", "gauge", "Keys buffered.", wb->keys);
+    buffer("bytes", "gauge", "Bytes buffered or being flushed.", wb->bytes);
+  }
+  return out;
+}
+
+// --- TLS ---
+
+// The client context shared by every endpoint of an EndpointCache (see
+// TlsOptions). Options that cannot be applied (say, a missing ca_file) are
+// kept as error() and fail each connect instead of the constructor.
+#ifdef LITE3CLIENT_WITH_OPENSSL
+class TlsContext {
+public:
+  explicit TlsContext(const TlsOptions &opts)
+      : ctx_(net::ssl::context::tls_client), verify_(opts.verify_peer) {
+    auto *handle = ctx_.native_handle();
+    SSL_CTX_set_min_proto_version(handle, TLS1_2_VERSION);
+    const auto &key_file = opts.key_file.empty() ? opts.cert_file
+                                                 : opts.key_file;
+    beast::error_code ec;
+    std::string_view step = "verify mode";
+    ctx_.set_verify_mode(opts.verify_peer ? net::ssl::verify_peer
+                                          : net::ssl::verify_none,
+                         ec);
+    if (!ec && opts.verify_peer && opts.ca_file.empty()) {
+      step = "default CA paths";
+      ctx_.set_default_verify_paths(ec);
+    } else if (!ec && opts.verify_peer) {
+      step = opts.ca_file;
+      ctx_.load_verify_file(opts.ca_file, ec);
+    }
+    if (!ec && !opts.cert_file.empty()) {
+      step = opts.cert_file;
+      ctx_.use_certificate_chain_file(opts.cert_file, ec);
+    }
+    if (!ec && !opts.cert_file.empty()) {
+      step = key_file;
+      ctx_.use_private_key_file(key_file, net::ssl::context::pem, ec);
+    }
+    if (ec)
+      error_ = "TLS setup failed on " + std::string(step) + ": " +
+               ec.message();
+    if (opts.resume_sessions) {
+      // Sessions are kept per endpoint by TlsPeer, not in OpenSSL's cache,
+      // which only servers consult.
+      SSL_CTX_set_session_cache_mode(handle, SSL_SESS_CACHE_CLIENT |
+                                                 SSL_SESS_CACHE_NO_INTERNAL);
+      SSL_CTX_sess_set_new_cb(handle, &TlsContext::session_issued);
+    }
+  }
+
+  net::ssl::context &native() { return ctx_; }
+  bool verify() const { return verify_; }
+  const std::string &error() const { return error_; }
+
+  // The ex_data slot holding an SSL object's TlsPeer. Asio keeps its verify
+  // callback in the app data slot.
+  static int peer_index() {
+    static const int index =
+        SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+  }
+
+private:
+  static int session_issued(SSL *ssl, SSL_SESSION *session);
+
+  net::ssl::context ctx_;
+  bool verify_;
+  std::string error_;
+};
+
+// One endpoint's side of the context: the name its certificate must carry
+// and the latest session its server issued, offered by every new connection
+// to it. In TLS 1.3 sessions arrive after the handshake, whenever the
+// server's ticket is read, so the slot is updated from any thread.
+class TlsPeer {
+public:
+  TlsPeer(std::shared_ptr<TlsContext> ctx, std::string host)
+      : ctx_(std::move(ctx)), host_(std::move(host)) {
+    beast::error_code ec;
+    net::ip::make_address(host_, ec);
+    ip_ = !ec;
+  }
+  TlsPeer(const TlsPeer &) = delete;
+  TlsPeer &operator=(const TlsPeer &) = delete;
+  ~TlsPeer() {
+    if (session_)
+      SSL_SESSION_free(session_);
+  }
+
+  net::ssl::context &context() { return ctx_->native(); }
+
+  // Sets SNI, host name verification and the session to resume on a new
+  // connection's SSL object. Throws if the context is unusable.
+  void prepare(SSL *ssl) {
+    if (!ctx_->error().empty())
+      throw std::runtime_error(ctx_->error());
+    SSL_set_ex_data(ssl, TlsContext::peer_index(), this);
+    if (!ip_)
+      SSL_set_tlsext_host_name(ssl, host_.c_str());
+    if (ctx_->verify()) {
+      auto *param = SSL_get0_param(ssl);
+      if (ip_)
+        X509_VERIFY_PARAM_set1_ip_asc(param, host_.c_str());
+      else
+        X509_VERIFY_PARAM_set1_host(param, host_.c_str(), 0);
+    }
+    std::lock_guard lock(mutex_);
+    if (session_)
+      SSL_set_session(ssl, session_);
+  }
+
+  // Takes ownership of `session`.
+  void store(SSL_SESSION *session) {
+    std::lock_guard lock(mutex_);
+    std::swap(session_, session);
+    if (session)
+      SSL_SESSION_free(session);
+  }
+
+private:
+  std::shared_ptr<TlsContext> ctx_; // Outlives every SSL object made here
+  std::string host_;
+  bool ip_ = false;
+  std::mutex mutex_;
+  SSL_SESSION *session_ = nullptr;
+};
+
+// OpenSSL makes the session of a connection freed without a close_notify
+// unresumable. This queues one in Asio's memory BIO, so nothing reaches the
+// socket, which the pools close without waiting on the peer.
+void mark_closed(SSL *ssl) {
+  if (SSL_is_init_finished(ssl))
+    SSL_shutdown(ssl);
+}
+
+int TlsContext::session_issued(SSL *ssl, SSL_SESSION *session) {
+  auto *peer = static_cast<TlsPeer *>(SSL_get_ex_data(ssl, peer_index()));
+  if (!peer)
+    return 0;
+  peer->store(session);
+  return 1; // The reference is now the peer's
+}
+
+#else // Built without OpenSSL: TlsOptions::enabled fails each connect
+
+class TlsContext {
+public:
+  explicit TlsContext(const TlsOptions &) {}
+  const std::string &error() const { return error_; }
+
+private:
+  std::string error_ =
+      "TLS is enabled, but lite3client was built without OpenSSL";
+};
+
+class TlsPeer {
+public:
+  TlsPeer(std::shared_ptr<TlsContext> ctx, std::string)
+      : ctx_(std::move(ctx)) {}
+
+  [[noreturn]] void unavailable() const {
+    throw std::runtime_error(ctx_->error());
+  }
+
+private:
+  std::shared_ptr<TlsContext> ctx_;
+};
+
+#endif // LITE3CLIENT_WITH_OPENSSL
+
+// --- Connection Pool ---
+
+namespace {
+
+constexpr Clock::time_point no_deadline = Clock::time_point::max();
+
+// Earliest of `deadline` and `timeout` from now; a zero timeout adds no
+// limit.
+Clock::time_point within(Clock::time_point deadline,
+                         std::chrono::milliseconds timeout) {
+  if (timeout.count() <= 0)
+    return deadline;
+  return std::min(deadline, Clock::now() + timeout);
+}
+
+void set_expiry(beast::tcp_stream &stream, Clock::time_point deadline) {
+  if (deadline == no_deadline)
+    stream.expires_never();
+  else
+    stream.expires_at(deadline);
+}
+
+// Blocking reads and writes on a connection's socket that give up at a
+// deadline. tcp_stream's expiry only covers async operations, and running
+// every request through the io_context costs several times a plain syscall
+// on large bodies. Instead the socket is non-blocking and an operation that
+// would block waits in poll() for the time left.
+class DeadlineStream {
+public:
+  using executor_type = tcp::socket::executor_type;
+  using lowest_layer_type = tcp::socket;
+
+  DeadlineStream(tcp::socket &socket, Clock::time_point deadline)
+      : socket_(socket), deadline_(deadline) {}
+
+  executor_type get_executor() { return socket_.get_executor(); }
+  lowest_layer_type &lowest_layer() { return socket_; }
+  // For a TLS stream layered on top, which outlives each request.
+  void expires_at(Clock::time_point deadline) { deadline_ = deadline; }
+
+  template <class Buffers>
+  std::size_t read_some(const Buffers &buffers, beast::error_code &ec) {
+    return retry(net::detail::socket_ops::poll_read,
+                 [&] { return socket_.read_some(buffers, ec); }, ec);
+  }
+  template <class Buffers> std::size_t read_some(const Buffers &buffers) {
+    beast::error_code ec;
+    auto n = read_some(buffers, ec);
+    if (ec)
+      throw beast::system_error(ec);
+    return n;
+  }
+
+  template <class Buffers>
+  std::size_t write_some(const Buffers &buffers, beast::error_code &ec) {
+    return retry(net::detail::socket_ops::poll_write,
+                 [&] { return socket_.write_some(buffers, ec); }, ec);
+  }
+  template <class Buffers> std::size_t write_some(const Buffers &buffers) {
+    beast::error_code ec;
+    auto n = write_some(buffers, ec);
+    if (ec)
+      throw beast::system_error(ec);
+    return n;
+  }
+
+  // A write the socket object does not offer (e.g. sendfile), with the same
+  // waiting. `op` writes through native_handle() and sets `ec`.
+  template <class Op> std::size_t write_native(Op op, beast::error_code &ec) {
+    return retry(net::detail::socket_ops::poll_write, op, ec);
+  }
+  tcp::socket::native_handle_type native_handle() {
+    return socket_.native_handle();
+  }
+
+private:
+  template <class Poll, class Op>
+  std::size_t retry(Poll poll, Op op, beast::error_code &ec) {
+    for (;;) {
+      std::size_t n = op();
+      if (ec != net::error::would_block && ec != net::error::try_again)
+        return n;
+      int wait_ms = -1;
+      if (deadline_ != no_deadline) {
+        auto left = std::chrono::ceil<std::chrono::milliseconds>(
+                        deadline_ - Clock::now())
+                        .count();
+        if (left <= 0) {
+          ec = beast::error::timeout;
+          return 0;
+        }
+        wait_ms = static_cast<int>(
+            std::min<int64_t>(left, std::numeric_limits<int>::max()));
+      }
+      int ready = poll(socket_.native_handle(), 0, wait_ms, ec);
+      if (ready < 0)
+        return 0;
+      if (ready == 0) {
+        ec = beast::error::timeout;
+        return 0;
+      }
+    }
+  }
+
+  tcp::socket &socket_;
+  Clock::time_point deadline_;
+};
+
+// Maps a transport failure to an Error. Expired stream deadlines are
+// timeouts.
+Error transport_error(const std::exception &e) {
+  if (auto *se = dynamic_cast<const beast::system_error *>(&e)) {
+    if (se->code() == beast::error::timeout)
+      return Error{ErrorCode::Timeout, e.what()};
+    if (se->code() == net::error::connection_refused)
+      return Error{ErrorCode::ConnectionRefused, e.what()};
+  }
+  return Error{ErrorCode::NetworkError, e.what()};
+}
+
+} // namespace
+
+// A single keep-alive connection. Each one carries its own io_context so a
+// worker thread can drive its socket without coordinating with other threads.
+// The read buffer lives with the connection so its capacity is reused across
+// requests (and holds bytes of the next response when pipelining).
+struct Connection {
+  net::io_context ioc;
+  beast::tcp_stream stream{ioc};
+  beast::flat_buffer buffer;
+  std::chrono::steady_clock::time_point last_used;
+  std::size_t shard = 0; // Owning ConnectionPool shard
+#ifdef LITE3CLIENT_WITH_OPENSSL
+  // TlsOptions::enabled. Layered on the socket, so `stream` still connects
+  // and closes it.
+  std::unique_ptr<beast::ssl_stream<DeadlineStream>> tls;
+
+  ~Connection() {
+    if (tls)
+      mark_closed(tls->native_handle());
+  }
+#endif
+};
+
+namespace {
+
+// Starts an async operation on the connection's private io_context and
+// runs it to completion, so the stream's expiry applies.
+template <class Initiate>
+beast::error_code run_blocking(Connection &conn, Initiate &&initiate) {
+  beast::error_code result;
+  std::forward<Initiate>(initiate)(
+      [&result](beast::error_code ec, auto &&...) { result = ec; });
+  conn.ioc.restart();
+  conn.ioc.run();
+  return result;
+}
+
+} // namespace
+
+// Coroutine-API counterpart of Connection, bound to the caller's executor.
+struct AsyncConnection {
+  explicit AsyncConnection(const net::any_io_executor &ex) : stream(ex) {}
+  beast::tcp_stream stream;
+  beast::flat_buffer buffer;
+  std::chrono::steady_clock::time_point last_used;
+#ifdef LITE3CLIENT_WITH_OPENSSL
+  std::unique_ptr<beast::ssl_stream<beast::tcp_stream &>> tls; // Likewise
+
+  ~AsyncConnection() {
+    if (tls)
+      mark_closed(tls->native_handle());
+  }
+#endif
+};
+
+// The blocking stream of one request: the connection's TLS stream if it has
+// one, else its socket. Either gives up at `deadline`.
+class RequestStream {
+public:
+  using executor_type = tcp::socket::executor_type;
+
+#ifdef LITE3CLIENT_WITH_OPENSSL
+  RequestStream(Connection &conn, Clock::time_point deadline)
+      : tls_(conn.tls.get()), plain_(conn.stream.socket(), deadline) {
+    if (tls_)
+      tls_->next_layer().expires_at(deadline);
+  }
+#else
+  RequestStream(Connection &conn, Clock::time_point deadline)
+      : plain_(conn.stream.socket(), deadline) {}
+#endif
+
+  executor_type get_executor() { return plain_.get_executor(); }
+  bool encrypted() const { return tls_ != nullptr; }
+  // Writes that bypass the socket object (sendfile); unencrypted only.
+  DeadlineStream &plain() { return plain_; }
+
+  template <class Buffers>
+  std::size_t read_some(const Buffers &buffers, beast::error_code &ec) {
+#ifdef LITE3CLIENT_WITH_OPENSSL
+    if (tls_)
+      return tls_->read_some(buffers, ec);
+#endif
+    return plain_.read_some(buffers, ec);
+  }
+  template <class Buffers> std::size_t read_some(const Buffers &buffers) {
+    beast::error_code ec;
+    auto n = read_some(buffers, ec);
+    if (ec)
+      throw beast::system_error(ec);
+    return n;
+  }
+
+  template <class Buffers>
+  std::size_t write_some(const Buffers &buffers, beast::error_code &ec) {
+#ifdef LITE3CLIENT_WITH_OPENSSL
+    if (tls_)
+      return tls_->write_some(buffers, ec);
+#endif
+    return plain_.write_some(buffers, ec);
+  }
+  template <class Buffers> std::size_t write_some(const Buffers &buffers) {
+    beast::error_code ec;
+    auto n = write_some(buffers, ec);
+    if (ec)
+      throw beast::system_error(ec);
+    return n;
+  }
+
+private:
+#ifdef LITE3CLIENT_WITH_OPENSSL
+  beast::ssl_stream<DeadlineStream> *tls_;
+#else
+  static constexpr void *tls_ = nullptr;
+#endif
+  DeadlineStream plain_;
+};
+
+// Runs `op` on an async connection's TLS stream if it has one, else on its
+// TCP stream; `op` yields the same awaitable type for both.
+template <class Op> auto on_stream(AsyncConnection &conn, Op op) {
+#ifdef LITE3CLIENT_WITH_OPENSSL
+  return conn.tls ? op(*conn.tls) : op(conn.stream);
+#else
+  return op(conn.stream);
+#endif
+}
+
+// Releases a connection's read buffer once a large response has pushed it
+// past the configured high-water mark.
+template <class Conn> void trim_buffer(Conn &conn, std::size_t high_water) {
+  if (conn.buffer.capacity() > high_water)
+    conn.buffer.shrink_to_fit();
+}
+
+// Recycles response body storage so steady-state reads reuse capacity
+// instead of growing a fresh vector per request. Shared with PooledBuffer,
+// which may outlive the Client.
+class BodyPool {
+public:
+  explicit BodyPool(const PoolOptions &opts)
+      : opts_(opts), shards_(std::max<std::size_t>(opts.shards, 1)) {
+    opts_.shards = shards_.size();
+  }
+
+  std::vector<uint8_t> acquire() {
+    auto &shard = shards_[pool_shard(opts_)];
+    std::lock_guard lock(shard.mutex);
+    if (shard.free.empty())
+      return {};
+    auto body = std::move(shard.free.back());
+    shard.free.pop_back();
+    return body;
+  }
+
+  // Into the calling thread's shard, whichever one it came from.
+  void release(std::vector<uint8_t> body) {
+    if (body.capacity() == 0 || body.capacity() > opts_.buffer_high_water)
+      return;
+    body.clear();
+    auto &shard = shards_[pool_shard(opts_)];
+    std::lock_guard lock(shard.mutex);
+    if (shard.free.size() < opts_.max_connections)
+      shard.free.push_back(std::move(body));
+  }
+
+private:
+  struct alignas(64) Shard {
+    std::mutex mutex;
+    std::vector<std::vector<uint8_t>> free;
+  };
+
+  PoolOptions opts_;
+  std::vector<Shard> shards_;
+};
+
+// The one thread that re-resolves stale AddressCache entries for every
+// endpoint in the process, a lookup at a time with one resolver, so expiring
+// entries never cost a thread each. Started on first use and joined at exit;
+// lookups still queued then are dropped.
+class AddressRefresher {
+public:
+  using Task = std::function<void(tcp::resolver &)>;
+
+  static AddressRefresher &instance() {
+    static AddressRefresher refresher;
+    return refresher;
+  }
+
+  ~AddressRefresher() {
+    {
+      std::lock_guard lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    if (thread_.joinable())
+      thread_.join();
+  }
+
+  void post(Task task) {
+    std::lock_guard lock(mutex_);
+    if (stopping_)
+      return;
+    queue_.push_back(std::move(task));
+    if (!thread_.joinable())
+      thread_ = std::thread([this] { run(); });
+    wake_.notify_one();
+  }
+
+private:
+  AddressRefresher() = default;
+
+  void run() {
+    net::io_context ioc;
+    tcp::resolver resolver(ioc);
+    std::unique_lock lock(mutex_);
+    for (;;) {
+      wake_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+      if (stopping_)
+        return;
+      auto task = std::move(queue_.front());
+      queue_.pop_front();
+      lock.unlock();
+      task(resolver);
+      task = nullptr; // May hold the last reference to its cache
+      lock.lock();
+    }
+  }
+
+  std::mutex mutex_; // Everything below
+  std::condition_variable wake_;
+  std::deque<Task> queue_;
+  bool stopping_ = false;
+  std::thread thread_;
+};
+
+// Resolved addresses of one host:port, shared by the endpoint's pools so
+// reconnects skip DNS. Past dns_ttl the old addresses stay in use while the
+// AddressRefresher re-resolves; only a connect with nothing cached waits for
+// the resolver. IP literals are never resolved.
+class AddressCache : public std::enable_shared_from_this<AddressCache> {
+public:
+  using Addresses = std::vector<tcp::endpoint>;
+
+  AddressCache(std::string host, int port, std::chrono::milliseconds ttl)
+      : host_(std::move(host)), service_(std::to_string(port)), ttl_(ttl) {
+    beast::error_code ec;
+    auto address = net::ip::make_address(host_, ec);
+    if (!ec) {
+      addresses_ = std::make_shared<const Addresses>(
+          1, tcp::endpoint(address, static_cast<unsigned short>(port)));
+      pinned_ = true;
+    }
+  }
+
+  // Resolves with `ioc` if nothing is cached. The resolver has no expiry of
+  // its own, so it runs against `deadline` and is cancelled if it overruns.
+  // Throws on failure.
+  std::shared_ptr<const Addresses> get(net::io_context &ioc,
+                                       Clock::time_point deadline) {
+    if (auto addresses = cached())
+      return addresses;
+    tcp::resolver resolver(ioc);
+    tcp::resolver::results_type results;
+    beast::error_code ec;
+    bool resolved = false;
+    resolver.async_resolve(
+        host_, service_,
+        [&](beast::error_code e, tcp::resolver::results_type r) {
+          ec = e;
+          results = std::move(r);
+          resolved = true;
+        });
+    ioc.restart();
+    if (deadline == no_deadline)
+      ioc.run();
+    else
+      ioc.run_until(deadline);
+    if (!resolved) {
+      resolver.cancel();
+      ioc.run();
+      ec = beast::error::timeout;
+    }
+    if (ec)
+      throw beast::system_error(ec);
+    return store(results);
+  }
+
+  net::awaitable<std::shared_ptr<const Addresses>>
+  async_get(const net::any_io_executor &ex) {
+    if (auto addresses = cached())
+      co_return addresses;
+    tcp::resolver resolver(ex);
+    auto results =
+        co_await resolver.async_resolve(host_, service_, net::use_awaitable);
+    co_return store(results);
+  }
+
+  // No cached address accepted a connection: the host may have moved, so
+  // the next connect resolves again.
+  void invalidate() {
+    std::lock_guard lock(mutex_);
+    if (!pinned_)
+      addresses_.reset();
+  }
+
+private:
+  std::shared_ptr<const Addresses> cached() {
+    std::lock_guard lock(mutex_);
+    if (addresses_ && !pinned_ && !refreshing_ && Clock::now() >= expires_) {
+      refreshing_ = true;
+      AddressRefresher::instance().post(
+          [weak = weak_from_this()](tcp::resolver &resolver) {
+            if (auto self = weak.lock())
+              self->refresh(resolver);
+          });
+    }
+    return addresses_;
+  }
+
+  std::shared_ptr<const Addresses>
+  store(const tcp::resolver::results_type &results) {
+    auto addresses = std::make_shared<Addresses>();
+    for (const auto &entry : results)
+      addresses->push_back(entry.endpoint());
+    std::lock_guard lock(mutex_);
+    if (ttl_.count() > 0) {
+      addresses_ = addresses;
+      expires_ = Clock::now() + ttl_;
+    }
+    return addresses;
+  }
+
+  // A failed lookup keeps serving the old addresses for another TTL.
+  void refresh(tcp::resolver &resolver) {
+    beast::error_code ec;
+    auto results = resolver.resolve(host_, service_, ec);
+    if (!ec && !results.empty())
+      store(results);
+    std::lock_guard lock(mutex_);
+    if (ec || results.empty())
+      expires_ = Clock::now() + ttl_;
+    refreshing_ = false;
+  }
+
+  const std::string host_;
+  const std::string service_;
+  const std::chrono::milliseconds ttl_; // Zero: resolve on every connect
+
+  std::mutex mutex_;
+  std::shared_ptr<const Addresses> addresses_;
+  Clock::time_point expires_;
+  bool pinned_ = false;
+  bool refreshing_ = false;
+};
+
+// Bounded set of keep-alive connections to one endpoint. Threads check out a
+// connection for the duration of one request and return it afterwards;
+// broken connections are discarded instead of returned.
+namespace {
+
+// Uniform in [0, bound].
+Clock::duration jittered(Clock::duration bound) {
+  thread_local std::minstd_rand rng{std::random_device{}()};
+  if (bound.count() <= 0)
+    return Clock::duration::zero();
+  std::uniform_int_distribution<Clock::rep> pick(0, bound.count());
+  return Clock::duration(pick(rng));
+}
+
+} // namespace
+
+// See CircuitBreakerOptions. Shared by an endpoint's pools; only their
+// connect attempts are counted, so a busy healthy node never trips it.
+class CircuitBreaker {
+public:
+  CircuitBreaker(const CircuitBreakerOptions &opts, EndpointMetrics &metrics)
+      : opts_(opts), metrics_(metrics) {}
+
+  // Whether a new connection may be attempted. Once the open period has
+  // passed, true for exactly one caller, the probe.
+  bool allow() {
+    if (!open_.load(std::memory_order_acquire))
+      return true;
+    std::lock_guard lock(mutex_);
+    if (!open_.load(relaxed))
+      return true;
+    if (probing_ || Clock::now() < reopen_at_)
+      return false;
+    probing_ = true;
+    return true;
+  }
+
+  bool closed() const { return !open_.load(relaxed); }
+
+  void connected() {
+    if (failures_.load(relaxed) == 0 && !open_.load(relaxed))
+      return; // Steady state: no shared writes
+    std::lock_guard lock(mutex_);
+    failures_.store(0, relaxed);
+    open_.store(false, std::memory_order_release);
+    probing_ = false;
+    period_ = {};
+  }
+
+  void connect_failed() {
+    if (opts_.failure_threshold == 0)
+      return;
+    std::lock_guard lock(mutex_);
+    probing_ = false;
+    const bool was_open = open_.load(relaxed);
+    if (!was_open && failures_.fetch_add(1, relaxed) + 1 <
+                         opts_.failure_threshold)
+      return;
+    // Half to all of the period, so clients that failed together do not
+    // probe together.
+    period_ = was_open ? std::min<Clock::duration>(period_ * 2,
+                                                   opts_.max_open_for)
+                       : Clock::duration(opts_.open_for);
+    reopen_at_ = Clock::now() + period_ / 2 + jittered(period_ / 2);
+    if (!was_open) {
+      open_.store(true, std::memory_order_release);
+      metrics_.circuit_opened();
+    }
+  }
+
+private:
+  CircuitBreakerOptions opts_;
+  EndpointMetrics &metrics_;
+  std::atomic<bool> open_{false};
+  std::atomic<uint32_t> failures_{0}; // Consecutive, while closed
+  std::mutex mutex_;                  // Transitions and the fields below
+  bool probing_ = false;
+  Clock::duration period_{};
+  Clock::time_point reopen_at_{};
+};
+
+// The token bucket behind RetryOptions' budget, in thousandths of a token.
+class RetryBudget {
+public:
+  explicit RetryBudget(const RetryOptions &opts)
+      : max_(static_cast<int64_t>(opts.budget_tokens) * 1000),
+        refund_(static_cast<int64_t>(opts.budget_ratio * 1000)),
+        tokens_(max_) {}
+
+  // `answered`: the server replied, whatever it said.
+  void record(bool answered) { add(answered ? refund_ : -1000); }
+  bool allows_retry() const { return tokens_.load(relaxed) > max_ / 2; }
+
+private:
+  void add(int64_t delta) {
+    auto tokens = tokens_.load(relaxed);
+    int64_t next;
+    do {
+      next = std::clamp<int64_t>(tokens + delta, 0, max_);
+      if (next == tokens)
+        return; // A full bucket stays read-only
+    } while (!tokens_.compare_exchange_weak(tokens, next, relaxed));
+  }
+
+  const int64_t max_;
+  const int64_t refund_;
+  std::atomic<int64_t> tokens_;
+};
+
+// Thrown by checkout() while the circuit is open.
+[[noreturn]] void throw_circuit_open() {
+  throw beast::system_error(net::error::connection_refused, "Circuit open");
+}
+
+class ConnectionPool {
+public:
+  // `tls`: null unless TlsOptions::enabled.
+  ConnectionPool(AddressCache &addresses, const ClientOptions &opts,
+                 EndpointMetrics &metrics, CircuitBreaker &breaker,
+                 TlsPeer *tls)
+      : addresses_(addresses), opts_(opts.pool),
+        connect_timeout_(opts.connect_timeout), metrics_(metrics),
+        breaker_(breaker), tls_(tls),
+        shards_(std::max<std::size_t>(opts.pool.shards, 1)) {
+    opts_.shards = shards_.size();
+    if (opts_.max_connections == 0)
+      opts_.max_connections = 1;
+    if (opts_.min_connections > opts_.max_connections)
+      opts_.min_connections = opts_.max_connections;
+  }
+
+  // Returns an idle connection, opens a new one if under max_connections, or
+  // waits up to checkout_timeout (and at most until `deadline`) for one to
+  // be returned. Null on timeout. Throws on connect failure. Only the
+  // calling thread's shard is used.
+  std::unique_ptr<Connection> checkout(Clock::time_point deadline) {
+    const auto index = pool_shard(opts_);
+    auto &shard = shards_[index];
+    std::unique_lock lock(shard.mutex);
+    reap_idle_locked(shard, std::chrono::steady_clock::now());
+
+    auto wait_until = within(deadline, opts_.checkout_timeout);
+    while (shard.idle.empty() && shard.total >= opts_.max_connections) {
+      if (shard.cv.wait_until(lock, wait_until) == std::cv_status::timeout &&
+          shard.idle.empty() && shard.total >= opts_.max_connections)
+        return nullptr;
+    }
+
+    if (!shard.idle.empty()) {
+      // Most recently used first: it is the least likely to have been
+      // closed by the server's keep-alive timer.
+      auto conn = std::move(shard.idle.back());
+      shard.idle.pop_back();
+      return conn;
+    }
+
+    // Reserve a slot, then connect without holding the lock.
+    if (!breaker_.allow())
+      throw_circuit_open();
+    ++shard.total;
+    lock.unlock();
+    try {
+      auto conn = open(within(deadline, connect_timeout_));
+      conn->shard = index;
+      return conn;
+    } catch (...) {
+      release_slot(shard);
+      throw;
+    }
+  }
+
+  // Opens connections until `target` exist in every shard, idle or checked
+  // out. Throws on the first connect failure.
+  void warm(std::size_t target, Clock::time_point deadline) {
+    target = std::min(target, opts_.max_connections);
+    for (std::size_t i = 0; i < shards_.size(); ++i) {
+      auto &shard = shards_[i];
+      for (;;) {
+        {
+          std::lock_guard lock(shard.mutex);
+          if (shard.total >= target)
+            break;
+          ++shard.total;
+        }
+        std::unique_ptr<Connection> conn;
+        try {
+          conn = open(within(deadline, connect_timeout_));
+        } catch (...) {
+          release_slot(shard);
+          throw;
+        }
+        conn->shard = i;
+        checkin(std::move(conn));
+      }
+    }
+  }
+
+  void checkin(std::unique_ptr<Connection> conn) {
+    conn->last_used = std::chrono::steady_clock::now();
+    auto &shard = shards_[conn->shard];
+    {
+      std::lock_guard lock(shard.mutex);
+      shard.idle.push_back(std::move(conn));
+    }
+    shard.cv.notify_one();
+  }
+
+  void discard(std::unique_ptr<Connection> conn) {
+    auto &shard = shards_[conn->shard];
+    beast::error_code ec;
+    conn->stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+    conn->stream.close();
+    conn.reset();
+    metrics_.dropped();
+    release_slot(shard);
+  }
+
+private:
+  struct alignas(64) Shard {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::unique_ptr<Connection>> idle; // Oldest at front
+    std::size_t total = 0;                        // Idle + checked out
+  };
+
+  std::unique_ptr<Connection> open(Clock::time_point deadline) {
+    const auto start = Clock::now();
+    auto conn = std::make_unique<Connection>();
+    beast::error_code ec;
+    try {
+      auto addresses = addresses_.get(conn->ioc, deadline);
+      set_expiry(conn->stream, deadline);
+      ec = run_blocking(*conn, [&](auto handler) {
+        conn->stream.async_connect(*addresses, std::move(handler));
+      });
+    } catch (const beast::system_error &e) {
+      ec = e.code();
+    }
+    if (ec) {
+      if (ec != beast::error::timeout)
+        addresses_.invalidate();
+      breaker_.connect_failed();
+      throw beast::system_error(ec);
+    }
+    conn->stream.expires_never();
+    conn->stream.socket().set_option(tcp::no_delay(true));
+    conn->stream.socket().non_blocking(true); // See DeadlineStream
+    if (tls_) {
+      try {
+        handshake(*conn, deadline);
+      } catch (...) {
+        breaker_.connect_failed();
+        throw;
+      }
+    }
+    breaker_.connected();
+    metrics_.connected(Clock::now() - start);
+    return conn;
+  }
+
+  void handshake(Connection &conn, Clock::time_point deadline) {
+#ifdef LITE3CLIENT_WITH_OPENSSL
+    conn.tls = std::make_unique<beast::ssl_stream<DeadlineStream>>(
+        DeadlineStream(conn.stream.socket(), deadline), tls_->context());
+    tls_->prepare(conn.tls->native_handle());
+    conn.tls->handshake(net::ssl::stream_base::client);
+    if (SSL_session_reused(conn.tls->native_handle()))
+      metrics_.tls_resumed();
+#else
+    (void)conn;
+    (void)deadline;
+    tls_->unavailable();
+#endif
+  }
+
+  static void release_slot(Shard &shard) {
+    {
+      std::lock_guard lock(shard.mutex);
+      --shard.total;
+    }
+    shard.cv.notify_one();
+  }
+
+  // Drop connections idle past idle_timeout, oldest first, keeping at least
+  // min_connections open.
+  void reap_idle_locked(Shard &shard,
+                        std::chrono::steady_clock::time_point now) {
+    auto &idle = shard.idle;
+    while (!idle.empty() && shard.total > opts_.min_connections &&
+           now - idle.front()->last_used > opts_.idle_timeout) {
+      beast::error_code ec;
+      idle.front()->stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+      idle.pop_front();
+      --shard.total;
+    }
+  }
+
+  AddressCache &addresses_;
+  PoolOptions opts_;
+  std::chrono::milliseconds connect_timeout_;
+  EndpointMetrics &metrics_;
+  CircuitBreaker &breaker_;
+  TlsPeer *tls_;
+  std::vector<Shard> shards_;
+};
+
+// Keep-alive connections bound to a caller-supplied executor, used by the
+// coroutine API. Waiters suspend on a timer instead of blocking a thread, so
+// one event loop can keep many requests in flight.
+class AsyncConnectionPool {
+public:
+  AsyncConnectionPool(net::any_io_executor ex, AddressCache &addresses,
+                      const ClientOptions &opts, EndpointMetrics &metrics,
+                      CircuitBreaker &breaker, TlsPeer *tls)
+      : ex_(std::move(ex)), addresses_(addresses), opts_(opts.pool),
+        connect_timeout_(opts.connect_timeout), metrics_(metrics),
+        breaker_(breaker), tls_(tls) {
+    if (opts_.max_connections == 0)
+      opts_.max_connections = 1;
+  }
+
+  const net::any_io_executor &executor() const { return ex_; }
+
+  // Same contract as ConnectionPool::checkout(): null on timeout, throws on
+  // connect failure. The connect deadline covers the TCP handshake only.
+  net::awaitable<std::unique_ptr<AsyncConnection>>
+  checkout(Clock::time_point limit) {
+    auto deadline = within(limit, opts_.checkout_timeout);
+    for (;;) {
+      std::unique_lock lock(mutex_);
+      reap_idle_locked(std::chrono::steady_clock::now());
+      if (!idle_.empty()) {
+        auto conn = std::move(idle_.back());
+        idle_.pop_back();
+        co_return conn;
+      }
+      if (total_ < opts_.max_connections) {
+        if (!breaker_.allow())
+          throw_circuit_open();
+        ++total_;
+        lock.unlock();
+        const auto start = Clock::now();
+        auto conn = std::make_unique<AsyncConnection>(ex_);
+        beast::error_code ec;
+        std::shared_ptr<const AddressCache::Addresses> addresses;
+        try {
+          addresses = co_await addresses_.async_get(ex_);
+        } catch (const beast::system_error &e) {
+          ec = e.code();
+        }
+        std::exception_ptr tls_failure;
+        if (!ec) {
+          set_expiry(conn->stream, within(limit, connect_timeout_));
+          co_await conn->stream.async_connect(
+              *addresses, net::redirect_error(net::use_awaitable, ec));
+          if (ec && ec != beast::error::timeout)
+            addresses_.invalidate();
+          if (!ec && tls_) {
+            try {
+              co_await handshake(*conn);
+            } catch (...) {
+              tls_failure = std::current_exception();
+            }
+          }
+          conn->stream.expires_never();
+        }
+        if (ec || tls_failure) {
+          breaker_.connect_failed();
+          release_slot();
+          if (tls_failure)
+            std::rethrow_exception(tls_failure);
+          throw beast::system_error(ec);
+        }
+        breaker_.connected();
+        conn->stream.socket().set_option(tcp::no_delay(true));
+        metrics_.connected(Clock::now() - start);
+        co_return conn;
+      }
+
+      // Pool exhausted: park on a timer. A returning connection wakes us by
+      // moving the expiry to the past, which also covers the window before
+      // async_wait starts.
+      auto waiter = std::make_shared<Waiter>(ex_, deadline);
+      waiters_.push_back(waiter);
+      lock.unlock();
+
+      beast::error_code ec;
+      co_await waiter->timer.async_wait(
+          net::redirect_error(net::use_awaitable, ec));
+
+      lock.lock();
+      if (!waiter->notified) {
+        std::erase(waiters_, waiter);
+        co_return nullptr;
+      }
+    }
+  }
+
+  void checkin(std::unique_ptr<AsyncConnection> conn) {
+    conn->last_used = std::chrono::steady_clock::now();
+    std::lock_guard lock(mutex_);
+    idle_.push_back(std::move(conn));
+    wake_one_locked();
+  }
+
+  void discard(std::unique_ptr<AsyncConnection> conn) {
+    beast::error_code ec;
+    conn->stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+    conn->stream.close();
+    conn.reset();
+    metrics_.dropped();
+    release_slot();
+  }
+
+private:
+  struct Waiter {
+    Waiter(const net::any_io_executor &ex,
+           std::chrono::steady_clock::time_point deadline)
+        : timer(ex, deadline) {}
+    net::steady_timer timer;
+    bool notified = false; // Guarded by the pool mutex
+  };
+
+  void release_slot() {
+    std::lock_guard lock(mutex_);
+    --total_;
+    wake_one_locked();
+  }
+
+  // Under the connect expiry. Throws on failure.
+  net::awaitable<void> handshake(AsyncConnection &conn) {
+#ifdef LITE3CLIENT_WITH_OPENSSL
+    conn.tls = std::make_unique<beast::ssl_stream<beast::tcp_stream &>>(
+        conn.stream, tls_->context());
+    tls_->prepare(conn.tls->native_handle());
+    co_await conn.tls->async_handshake(net::ssl::stream_base::client,
+                                       net::use_awaitable);
+    if (SSL_session_reused(conn.tls->native_handle()))
+      metrics_.tls_resumed();
+#else
+    (void)conn;
+    tls_->unavailable();
+    co_return;
+#endif
+  }
+
+  void wake_one_locked() {
+    if (waiters_.empty())
+      return;
+    auto waiter = std::move(waiters_.front());
+    waiters_.pop_front();
+    waiter->notified = true;
+    waiter->timer.expires_at(std::chrono::steady_clock::time_point::min());
+  }
+
+  void reap_idle_locked(std::chrono::steady_clock::time_point now) {
+    while (!idle_.empty() && total_ > opts_.min_connections &&
+           now - idle_.front()->last_used > opts_.idle_timeout) {
+      beast::error_code ec;
+      idle_.front()->stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+      idle_.pop_front();
+      --total_;
+    }
+  }
+
+  net::any_io_executor ex_;
+  AddressCache &addresses_;
+  PoolOptions opts_;
+  std::chrono::milliseconds connect_timeout_;
+  EndpointMetrics &metrics_;
+  CircuitBreaker &breaker_;
+  TlsPeer *tls_;
+
+  std::mutex mutex_;
+  std::deque<std::unique_ptr<AsyncConnection>> idle_; // Oldest at front
+  std::deque<std::shared_ptr<Waiter>> waiters_;
+  std::size_t total_ = 0;
+};
+
+// --- Binary Transport ---
+
+// The operations a Transport carries. The values are also the op codes of
+// Protocol::Binary frames.
+enum class KvOp : uint8_t { Get = 1, Put = 2, Del = 3 };
+
+// Protocol::Binary frames, integers little-endian:
+//   request:  u32 id, u8 op, u8 0, u16 key length, u32 value length,
+//             key, value
+//   response: u32 id, u8 status, u8 0, u16 0, u32 body length, body
+// A Moved response's body is the "host:port" that owns the key.
+enum class BinaryStatus : uint8_t {
+  Ok = 0,
+  NotFound = 1,
+  BadRequest = 2,
+  ServerError = 3,
+  Moved = 4
+};
+
+namespace {
+
+constexpr std::size_t frame_header = 12;
+// Longest response body accepted, the same as Beast's default body limit
+// on HTTP responses. A longer length is a corrupt stream or a hostile
+// server, and nothing after it can be trusted to parse.
+constexpr uint32_t max_frame_body = 8 * 1024 * 1024;
+constexpr std::string_view binary_upgrade = "lite3-binary/1";
+
+void store_le32(uint8_t *out, uint32_t v) {
+  for (int i = 0; i < 4; ++i)
+    out[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+uint32_t load_le32(const uint8_t *in) {
+  uint32_t v = 0;
+  for (int i = 3; i >= 0; --i)
+    v = (v << 8) | in[i];
+  return v;
+}
+
+} // namespace
+
+// Protocol::Binary requests from every thread, multiplexed over one
+// connection per endpoint. Callers write their frame under a write lock
+// and sleep until the reader thread hands them the response carrying their
+// id. The connection is taken from the endpoint's pool and upgraded with
+// "Upgrade: lite3-binary/1"; a server that answers anything but 101 is
+// remembered, and callers use HTTP from then on.
+class BinaryChannel {
+public:
+  struct Reply {
+    BinaryStatus status;
+    std::vector<uint8_t> body;
+  };
+
+  BinaryChannel(std::string_view host, ConnectionPool &pool, BodyPool &bodies,
+                std::size_t high_water)
+      : host_(host), pool_(pool), bodies_(bodies), high_water_(high_water) {}
+
+  ~BinaryChannel() {
+    std::lock_guard lock(mutex_);
+    session_.reset();
+  }
+
+  bool available() const { return !declined_.load(relaxed); }
+
+  Result<Reply> call(KvOp op, std::string_view key,
+                     std::span<const uint8_t> value,
+                     Clock::time_point deadline) {
+    if (key.size() > UINT16_MAX || value.size() > UINT32_MAX)
+      return Error{ErrorCode::BadRequest, "Key or value too large"};
+    std::shared_ptr<Session> s;
+    try {
+      s = session(deadline);
+    } catch (const std::exception &e) {
+      return transport_error(e);
+    }
+    if (!s)
+      return Error{ErrorCode::NetworkError,
+                   "Server declined the binary protocol"};
+
+    Pending pending;
+    uint32_t id;
+    {
+      std::lock_guard lock(s->mutex);
+      if (s->broken)
+        return Error{ErrorCode::NetworkError, "Binary connection closed"};
+      id = s->next_id++;
+      s->pending.emplace(id, &pending);
+    }
+
+    std::array<uint8_t, frame_header> header{};
+    store_le32(header.data(), id);
+    header[4] = static_cast<uint8_t>(op);
+    header[6] = static_cast<uint8_t>(key.size());
+    header[7] = static_cast<uint8_t>(key.size() >> 8);
+    store_le32(header.data() + 8, static_cast<uint32_t>(value.size()));
+    const std::array<net::const_buffer, 3> frame = {
+        net::buffer(header), net::buffer(key.data(), key.size()),
+        net::buffer(value.data(), value.size())};
+    try {
+      std::lock_guard lock(s->write_mutex);
+      DeadlineStream io(s->conn->stream.socket(), deadline);
+      net::write(io, frame);
+    } catch (const std::exception &e) {
+      // Part of a frame may have been sent; nothing after it would parse.
+      abandon(*s);
+      std::lock_guard lock(s->mutex);
+      s->pending.erase(id);
+      return transport_error(e);
+    }
+
+    std::unique_lock lock(s->mutex);
+    auto done = [&] { return pending.done; };
+    if (deadline == no_deadline) {
+      pending.cv.wait(lock, done);
+    } else if (!pending.cv.wait_until(lock, deadline, done)) {
+      s->pending.erase(id); // The reader drops the late response
+      return Error{ErrorCode::Timeout, "Timed out waiting for a response"};
+    }
+    if (pending.error)
+      return *pending.error;
+    return Reply{pending.status, std::move(pending.body)};
+  }
+
+private:
+  struct Pending {
+    std::condition_variable cv;
+    bool done = false;
+    BinaryStatus status = BinaryStatus::Ok;
+    std::vector<uint8_t> body;
+    std::optional<Error> error;
+  };
+
+  // One upgraded connection and the thread reading it.
+  struct Session {
+    Session(ConnectionPool &p, std::unique_ptr<Connection> c)
+        : pool(p), conn(std::move(c)) {}
+    ~Session() {
+      beast::error_code ec;
+      conn->stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+      if (reader.joinable())
+        reader.join();
+      pool.discard(std::move(conn));
+    }
+
+    ConnectionPool &pool;
+    std::unique_ptr<Connection> conn;
+    std::thread reader;
+    std::mutex write_mutex; // Whole frames only
+    std::mutex mutex;       // Everything below
+    std::unordered_map<uint32_t, Pending *> pending;
+    uint32_t next_id = 0;
+    bool broken = false;
+  };
+
+  // The live session, connecting and upgrading a new one if the last one
+  // broke. Null once the server has declined the upgrade. Throws on
+  // transport failure.
+  std::shared_ptr<Session> session(Clock::time_point deadline) {
+    std::lock_guard lock(mutex_);
+    if (session_) {
+      std::lock_guard session_lock(session_->mutex);
+      if (!session_->broken)
+        return session_;
+    }
+    session_.reset(); // Joins the old reader
+    if (declined_.load(relaxed))
+      return nullptr;
+
+    auto conn = pool_.checkout(deadline);
+    if (!conn)
+      throw beast::system_error(beast::error::timeout);
+    try {
+      DeadlineStream io(conn->stream.socket(), deadline);
+      http::request<http::empty_body> req{http::verb::get, "/kv", 11};
+      req.set(http::field::host, host_);
+      req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+      req.set(http::field::connection, "Upgrade");
+      req.set(http::field::upgrade, {binary_upgrade.data(),
+                                     binary_upgrade.size()});
+      http::write(io, req);
+      http::response_parser<http::vector_body<uint8_t>> parser;
+      http::read(io, conn->buffer, parser);
+      auto &res = parser.get();
+      if (res.result() != http::status::switching_protocols ||
+          !beast::iequals(res[http::field::upgrade],
+                          {binary_upgrade.data(), binary_upgrade.size()})) {
+        declined_.store(true, relaxed);
+        if (res.keep_alive())
+          pool_.checkin(std::move(conn));
+        else
+          pool_.discard(std::move(conn));
+        return nullptr;
+      }
+    } catch (...) {
+      pool_.discard(std::move(conn));
+      throw;
+    }
+
+    session_ = std::make_shared<Session>(pool_, std::move(conn));
+    session_->reader =
+        std::thread([this, s = session_.get()] { read_replies(*s); });
+    return session_;
+  }
+
+  // Reader thread: hands each response to its waiting caller until the
+  // connection fails, is shut down or announces a body over
+  // max_frame_body, then fails everyone still waiting.
+  void read_replies(Session &s) {
+    auto &buffer = s.conn->buffer; // May already hold frames after the 101
+    DeadlineStream io(s.conn->stream.socket(), no_deadline);
+    try {
+      for (;;) {
+        while (buffer.size() < frame_header)
+          buffer.commit(io.read_some(buffer.prepare(16 * 1024)));
+        std::array<uint8_t, frame_header> header;
+        net::buffer_copy(net::buffer(header), buffer.data());
+        buffer.consume(frame_header);
+        const uint32_t id = load_le32(header.data());
+        const uint32_t size = load_le32(header.data() + 8);
+        if (size > max_frame_body)
+          throw beast::system_error(http::error::body_limit);
+
+        // Large bodies are read straight into their own storage.
+        auto body = bodies_.acquire();
+        body.resize(size);
+        auto buffered = net::buffer_copy(net::buffer(body), buffer.data());
+        buffer.consume(buffered);
+        if (buffered < size)
+          net::read(io, net::buffer(body.data() + buffered, size - buffered));
+        if (buffer.size() == 0 && buffer.capacity() > high_water_)
+          buffer.shrink_to_fit();
+
+        std::lock_guard lock(s.mutex);
+        auto it = s.pending.find(id);
+        if (it == s.pending.end()) {
+          bodies_.release(std::move(body)); // Its caller timed out
+          continue;
+        }
+        auto &pending = *it->second;
+        pending.status = static_cast<BinaryStatus>(header[4]);
+        pending.body = std::move(body);
+        pending.done = true;
+        s.pending.erase(it);
+        pending.cv.notify_one(); // Under the lock: `pending` is on its stack
+      }
+    } catch (const std::exception &e) {
+      auto failure = transport_error(e);
+      std::lock_guard lock(s.mutex);
+      s.broken = true;
+      for (auto &[id, pending] : s.pending) {
+        pending->error = failure;
+        pending->done = true;
+        pending->cv.notify_one();
+      }
+      s.pending.clear();
+    }
+  }
+
+  // Wakes the reader, which fails the callers still waiting.
+  static void abandon(Session &s) {
+    {
+      std::lock_guard lock(s.mutex);
+      s.broken = true;
+    }
+    beast::error_code ec;
+    s.conn->stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+  }
+
+  std::string host_;
+  ConnectionPool &pool_;
+  BodyPool &bodies_;
+  std::size_t high_water_;
+  std::atomic<bool> declined_{false};
+  std::mutex mutex_; // Guards session_; held while connecting
+  std::shared_ptr<Session> session_;
+};
+
+// --- Endpoints ---
+
+// Everything needed to talk to one host:port: its connection pools and body
+// storage. Endpoints are shared through an EndpointCache, so a redirect to a
+// node we already know reuses that node's warm connections.
+struct Endpoint {
+  // `tls`: null unless TlsOptions::enabled.
+  Endpoint(std::string_view h, int p, const ClientOptions &o,
+           const std::optional<net::any_io_executor> &ex,
+           std::shared_ptr<TlsContext> tls_context)
+      : host(h), port(std::to_string(p)), opts(o),
+        breaker(o.breaker, metrics), retry_budget(o.retry),
+        tls(tls_context ? std::make_unique<TlsPeer>(std::move(tls_context),
+                                                    host)
+                        : nullptr),
+        addresses(std::make_shared<AddressCache>(host, p, o.dns_ttl)),
+        pool(*addresses, o, metrics, breaker, tls.get()),
+        bodies(std::make_shared<BodyPool>(o.pool)) {
+    if (ex)
+      async_pool.emplace(*ex, *addresses, o, metrics, breaker, tls.get());
+    // Frames would need one TLS session read and written by two threads at
+    // once, which OpenSSL does not allow; HTTP carries them instead.
+    if (o.protocol == Protocol::Binary && !tls)
+      binary = std::make_unique<BinaryChannel>(host, pool, *bodies,
+                                               o.pool.buffer_high_water);
+  }
+
+  std::string host;
+  std::string port;
+  ClientOptions opts;
+  EndpointMetrics metrics; // Before the pools, which record into it
+  CircuitBreaker breaker;  // Likewise
+  RetryBudget retry_budget;
+  std::unique_ptr<TlsPeer> tls; // Before the pools, whose connections use it
+  std::shared_ptr<AddressCache> addresses; // Held weakly by AddressRefresher
+  ConnectionPool pool;
+  std::optional<AsyncConnectionPool> async_pool; // Set when given an executor
+  std::shared_ptr<BodyPool> bodies;
+  std::unique_ptr<BinaryChannel> binary; // Protocol::Binary only
+};
+
+// host:port -> Endpoint. A standalone Client owns one; a SmartClient shares
+// one between all of its node clients.
+class EndpointCache {
+public:
+  EndpointCache(ClientOptions opts, std::optional<net::any_io_executor> ex)
+      : opts_(opts), ex_(std::move(ex)) {
+    if (opts_.tls.enabled)
+      tls_ = std::make_shared<TlsContext>(opts_.tls);
+  }
+
+  std::shared_ptr<Endpoint> get(std::string_view host, int port) {
+    std::string key(host);
+    key += ':';
+    key += std::to_string(port);
+
+    std::lock_guard lock(mutex_);
+    auto &ep = endpoints_[key];
+    if (!ep)
+      ep = std::make_shared<Endpoint>(host, port, opts_, ex_, tls_);
+    return ep;
+  }
+
+  const std::optional<net::any_io_executor> &executor() const { return ex_; }
+
+  ClientStats stats() {
+    ClientStats out;
+    {
+      std::lock_guard lock(mutex_);
+      out.endpoints.reserve(endpoints_.size());
+      for (const auto &[key, ep] : endpoints_) {
+        out.endpoints.push_back(ep->metrics.snapshot(key));
+        out.endpoints.back().circuit_open = !ep->breaker.closed();
+      }
+    }
+    std::sort(out.endpoints.begin(), out.endpoints.end(),
+              [](const auto &a, const auto &b) {
+                return a.endpoint < b.endpoint;
+              });
+    return out;
+  }
+
+  // Forgets endpoints only the cache still references.
+  void prune() {
+    std::lock_guard lock(mutex_);
+    std::erase_if(endpoints_, [](const auto &entry) {
+      return entry.second.use_count() == 1;
+    });
+  }
+
+private:
+  ClientOptions opts_;
+  std::optional<net::any_io_executor> ex_;
+  std::shared_ptr<TlsContext> tls_; // Shared by every endpoint's sessions
+
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<Endpoint>> endpoints_;
+};
+
+// --- Compression ---
+
+namespace {
+
+#ifdef LITE3CLIENT_WITH_ZLIB
+
+// zlib state per thread, reset between bodies instead of reallocated:
+// deflateInit2 alone allocates about 256 KiB.
+class Deflater {
+public:
+  Deflater() = default;
+  Deflater(const Deflater &) = delete;
+  Deflater &operator=(const Deflater &) = delete;
+  ~Deflater() {
+    if (ready_)
+      deflateEnd(&zs_);
+  }
+
+  // Compresses `in` into `out`: gzip, or a zlib stream naming `dict` when
+  // one is given. False if zlib fails.
+  bool run(std::span<const uint8_t> in, int level,
+           std::span<const uint8_t> dict, std::vector<uint8_t> &out) {
+    const int bits = dict.empty() ? 15 + 16 : 15;
+    if (in.size() > std::numeric_limits<uInt>::max())
+      return false;
+    if (ready_ && (level != level_ || bits != bits_)) {
+      deflateEnd(&zs_);
+      ready_ = false;
+    }
+    if (!ready_) {
+      zs_ = {};
+      if (deflateInit2(&zs_, level, Z_DEFLATED, bits, 8,
+                       Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+      ready_ = true;
+      level_ = level;
+      bits_ = bits;
+    } else if (deflateReset(&zs_) != Z_OK) {
+      return false;
+    }
+    if (!dict.empty() &&
+        deflateSetDictionary(&zs_, dict.data(),
+                             static_cast<uInt>(dict.size())) != Z_OK)
+      return false;
+
+    out.resize(deflateBound(&zs_, static_cast<uLong>(in.size())));
+    zs_.next_in = const_cast<Bytef *>(in.data());
+    zs_.avail_in = static_cast<uInt>(in.size());
+    zs_.next_out = out.data();
+    zs_.avail_out = static_cast<uInt>(out.size());
+    if (deflate(&zs_, Z_FINISH) != Z_STREAM_END)
+      return false;
+    out.resize(zs_.total_out);
+    return true;
+  }
+
+private:
+  z_stream zs_{};
+  bool ready_ = false;
+  int level_ = 0;
+  int bits_ = 0;
+};
+
+class Inflater {
+public:
+  Inflater() = default;
+  Inflater(const Inflater &) = delete;
+  Inflater &operator=(const Inflater &) = delete;
+  ~Inflater() {
+    if (ready_)
+      inflateEnd(&zs_);
+  }
+
+  // Decodes a gzip or zlib stream into `out`, failing on corrupt or
+  // truncated input, an unknown dictionary, or output past `limit`.
+  bool run(std::span<const uint8_t> in, std::span<const uint8_t> dict,
+           std::size_t limit, std::vector<uint8_t> &out) {
+    if (in.size() > std::numeric_limits<uInt>::max())
+      return false;
+    if (!ready_) {
+      zs_ = {};
+      if (inflateInit2(&zs_, 15 + 32) != Z_OK) // 32: detect gzip or zlib
+        return false;
+      ready_ = true;
+    } else if (inflateReset(&zs_) != Z_OK) {
+      return false;
+    }
+
+    zs_.next_in = const_cast<Bytef *>(in.data());
+    zs_.avail_in = static_cast<uInt>(in.size());
+    out.resize(std::min(limit, std::max<std::size_t>(in.size() * 4, 4096)));
+    for (;;) {
+      zs_.next_out = out.data() + zs_.total_out;
+      zs_.avail_out = static_cast<uInt>(std::min<std::size_t>(
+          out.size() - zs_.total_out, std::numeric_limits<uInt>::max()));
+      int rc = inflate(&zs_, Z_NO_FLUSH);
+      if (rc == Z_STREAM_END) {
+        out.resize(zs_.total_out);
+        return true;
+      }
+      if (rc == Z_NEED_DICT) {
+        if (dict.empty() ||
+            inflateSetDictionary(&zs_, dict.data(),
+                                 static_cast<uInt>(dict.size())) != Z_OK)
+          return false;
+        continue;
+      }
+      if (rc != Z_OK && rc != Z_BUF_ERROR)
+        return false;
+      if (zs_.avail_out != 0)
+        return false; // Input ended before the stream did
+      if (out.size() >= limit)
+        return false;
+      out.resize(std::min(limit, out.size() * 2));
+    }
+  }
+
+private:
+  z_stream zs_{};
+  bool ready_ = false;
+};
+
+#endif // LITE3CLIENT_WITH_ZLIB
+
+// Without zlib, calls that would compress fail before they connect.
+std::optional<Error> compression_unavailable(const CompressionOptions &opts) {
+#ifdef LITE3CLIENT_WITH_ZLIB
+  (void)opts;
+  return std::nullopt;
+#else
+  if (!opts.enabled)
+    return std::nullopt;
+  return Error{ErrorCode::BadRequest,
+               "Compression is enabled, but lite3client was built without "
+               "zlib"};
+#endif
+}
+
+} // namespace
+
+// --- PIMPL Implementation ---
+
+// How a Client's get/put/del reach a node; see Protocol. HttpTransport and
+// BinaryTransport follow ClientImpl.
+// A key and, from a KeyRef, its preformatted target; transports that need
+// a target build one when it is empty.
+struct KvKey {
+  std::string_view key;
+  std::string_view target = {};
+};
+
+class Transport {
+public:
+  virtual ~Transport() = default;
+  virtual Result<std::vector<uint8_t>>
+  call(Endpoint &ep, KvOp op, KvKey key, std::span<const uint8_t> value,
+       int depth, Clock::time_point deadline) = 0;
+};
+
+class ClientImpl {
+public:
+  std::shared_ptr<EndpointCache> cache_;
+  std::shared_ptr<Endpoint> self_; // The endpoint this Client was built for
+  Client::RedirectObserver on_redirect_;
+  std::unique_ptr<Transport> transport_;
+
+  using Response = http::response<http::vector_body<uint8_t>>;
+  using Parser = http::response_parser<http::vector_body<uint8_t>>;
+
+  ClientImpl(std::shared_ptr<EndpointCache> cache, std::string_view host,
+             int port);
+
+  // get/put/del through the configured transport.
+  Result<std::vector<uint8_t>> kv(KvOp op, KvKey key,
+                                  std::span<const uint8_t> value,
+                                  Deadline deadline) {
+    if (key.key.empty())
+      return Error{ErrorCode::BadRequest, "Key cannot be empty"};
+    const auto limit = call_deadline(deadline);
+    return with_retries(*self_, true, limit, [&] {
+      return transport_->call(*self_, op, key, value, 0, limit);
+    });
+  }
+
+  Result<void> put(KvKey key, std::span<const uint8_t> value,
+                   Deadline deadline) {
+    auto res = kv(KvOp::Put, key, value, deadline);
+    if (!res) {
+      return Result<void>(res.error());
+    }
+    return Result<void>();
+  }
+
+  Result<void> del(KvKey key, Deadline deadline) {
+    // DELETE usually returns 200 or 404. Our helper returns error on 404.
+    // We should treat 404 as success for delete (idempotency).
+    auto res = kv(KvOp::Del, key, {}, deadline);
+    if (!res) {
+      if (res.error().code == ErrorCode::NotFound)
+        return Result<void>();
+      return Result<void>(res.error());
+    }
+    return Result<void>();
+  }
+
+  static bool unanswered(const Error &e) {
+    return e.code == ErrorCode::NetworkError ||
+           e.code == ErrorCode::ConnectionRefused;
+  }
+
+  // Whether to make attempt `attempts` + 1 after `res`, and after how long.
+  // Records `res` against the endpoint's retry budget.
+  template <class T>
+  static bool should_retry(Endpoint &ep, const Result<T> &res,
+                           bool idempotent, std::size_t attempts,
+                           Clock::time_point deadline,
+                           Clock::duration &pause) {
+    const auto &opts = ep.opts.retry;
+    const bool failed = !res && unanswered(res.error());
+    ep.retry_budget.record(!failed);
+    // An open circuit would only fail the retry fast as well.
+    if (!failed || !idempotent || attempts >= opts.max_attempts ||
+        !ep.breaker.closed() || !ep.retry_budget.allows_retry())
+      return false;
+    const auto cap = std::min<Clock::duration>(
+        opts.max_backoff, opts.base_backoff * (1u << std::min<std::size_t>(
+                                                   attempts - 1, 16)));
+    pause = jittered(cap);
+    return Clock::now() + pause < deadline;
+  }
+
+  // Runs `attempt` until it is answered or RetryOptions give up.
+  template <class Attempt>
+  static std::invoke_result_t<Attempt &>
+  with_retries(Endpoint &ep, bool idempotent, Clock::time_point deadline,
+               Attempt &&attempt) {
+    auto res = attempt();
+    if (ep.opts.retry.max_attempts <= 1)
+      return res;
+    Clock::duration pause;
+    for (std::size_t n = 1;
+         should_retry(ep, res, idempotent, n, deadline, pause); ++n) {
+      std::this_thread::sleep_for(pause);
+      ep.metrics.retried();
+      res = attempt();
+    }
+    return res;
+  }
+
+  // Patches add as well as set, so a lost answer does not make them safe
+  // to resend.
+  bool idempotent(http::verb method) const {
+    return method != http::verb::post || self_->opts.retry.retry_patches;
+  }
+
+  // Where the std::future overloads run. Without an io_context the async
+  // path fails immediately, so the system executor only reports that error.
+  net::any_io_executor spawn_executor() const {
+    if (cache_->executor())
+      return *cache_->executor();
+    return net::system_executor();
+  }
+
+  // Splits a redirect Location, "http://host[:port]/path" or with TLS
+  // "https://...", the scheme matching ours: a node must not move us off
+  // or onto TLS. The port defaults to the scheme's.
+  bool parse_location(std::string_view loc, std::string &out_host,
+                      int &out_port, std::string &out_target) const {
+    const bool tls = self_->opts.tls.enabled;
+    const std::string_view scheme = tls ? "https://" : "http://";
+    if (loc.substr(0, scheme.size()) != scheme)
+      return false;
+    loc.remove_prefix(scheme.size());
+    auto path_sep = loc.find('/');
+    auto authority = loc.substr(0, path_sep);
+    auto port_sep = authority.find(':');
+
+    out_host = std::string(authority.substr(0, port_sep));
+    if (out_host.empty())
+      return false;
+    out_port = tls ? 443 : 80;
+    if (port_sep != std::string_view::npos) {
+      auto port = authority.substr(port_sep + 1);
+      auto [end, ec] =
+          std::from_chars(port.data(), port.data() + port.size(), out_port);
+      if (ec != std::errc() || end != port.data() + port.size() ||
+          out_port <= 0 || out_port > 65535)
+        return false;
+    }
+
+    out_target = path_sep != std::string_view::npos
+                     ? std::string(loc.substr(path_sep))
+                     : std::string("/");
+    return true;
+  }
+
+  // The body is a view of the caller's bytes: the serializer sends header
+  // and body as one scatter-gather write, so values are never copied.
+  using Request = http::request<http::span_body<const uint8_t>>;
+
+  // With `packed`, the exchange may be compressed both ways (see
+  // CompressionOptions); a compressed body lives in `*packed`.
+  static Request make_request(Endpoint &ep, http::verb method,
+                              std::string_view target,
+                              std::span<const uint8_t> body,
+                              std::vector<uint8_t> *packed = nullptr,
+                              std::string_view if_none_match = {}) {
+    // Set up an HTTP request message
+    Request req{method, std::string(target), 11};
+    req.set(http::field::host, ep.host);
+    req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+    req.set(http::field::content_type, "application/octet-stream");
+    if (!if_none_match.empty())
+      req.set(http::field::if_none_match,
+              {if_none_match.data(), if_none_match.size()});
+    req.keep_alive(true);
+    if (packed && ep.opts.compression.enabled) {
+      req.set(http::field::accept_encoding, "gzip, deflate");
+      if (compress(ep, body, *packed)) {
+        req.set(http::field::content_encoding,
+                ep.opts.compression.dictionary.empty() ? "gzip" : "deflate");
+        body = *packed;
+      }
+    }
+    req.body() = {body.data(), body.size()};
+    req.prepare_payload();
+    return req;
+  }
+
+  // Compresses `body` into `packed` if it is large enough and shrinks.
+  static bool compress(Endpoint &ep, std::span<const uint8_t> body,
+                       std::vector<uint8_t> &packed) {
+    const auto &opts = ep.opts.compression;
+    if (body.size() < std::max<std::size_t>(opts.min_size, 1))
+      return false;
+#ifdef LITE3CLIENT_WITH_ZLIB
+    thread_local Deflater deflater;
+    const auto start = Clock::now();
+    if (!deflater.run(body, opts.level, opts.dictionary, packed) ||
+        packed.size() >= body.size())
+      return false;
+    ep.metrics.compressed(body.size(), packed.size(), Clock::now() - start);
+    return true;
+#else
+    (void)packed;
+    return false; // Unreachable: compression_unavailable() failed the call
+#endif
+  }
+
+  // Replaces a gzip/deflate-encoded response body with the decoded bytes.
+  static std::optional<Error> decode_body(Endpoint &ep, Response &res) {
+    auto it = res.find(http::field::content_encoding);
+    if (it == res.end() || beast::iequals(it->value(), "identity"))
+      return std::nullopt;
+    if (!beast::iequals(it->value(), "gzip") &&
+        !beast::iequals(it->value(), "deflate"))
+      return Error{ErrorCode::SerializationError,
+                   "Unsupported Content-Encoding: " +
+                       std::string(it->value())};
+    if (res.body().empty())
+      return std::nullopt;
+
+#ifndef LITE3CLIENT_WITH_ZLIB
+    (void)ep;
+    return Error{ErrorCode::SerializationError,
+                 "Compressed response, but lite3client was built without "
+                 "zlib"};
+#else
+    thread_local Inflater inflater;
+    const auto start = Clock::now();
+    auto raw = ep.bodies->acquire();
+    if (!inflater.run(res.body(), ep.opts.compression.dictionary,
+                      ep.opts.compression.max_decompressed, raw))
+      return Error{ErrorCode::SerializationError,
+                   "Corrupt or oversized compressed response"};
+    ep.metrics.inflated(res.body().size(), raw.size(), Clock::now() - start);
+    ep.bodies->release(std::move(res.body()));
+    res.body() = std::move(raw);
+    return std::nullopt;
+#endif
+  }
+
+  // Resolves a 307 to the endpoint it points at, reporting it to the
+  // observer. Null when `res` is not a followable redirect.
+  template <class Message>
+  std::shared_ptr<Endpoint> follow_redirect(const Message &res,
+                                            std::string_view target,
+                                            std::string &out_target) {
+    if (res.result() != http::status::temporary_redirect)
+      return nullptr;
+    auto loc_it = res.find(http::field::location);
+    if (loc_it == res.end())
+      return nullptr;
+    std::string new_host;
+    int new_port = 0;
+    if (!parse_location({loc_it->value().data(), loc_it->value().size()},
+                        new_host, new_port, out_target))
+      return nullptr;
+    if (on_redirect_)
+      on_redirect_(target, new_host, new_port);
+    return cache_->get(new_host, new_port);
+  }
+
+  // Maps a final (non-followed) response to a Result.
+  static Result<std::vector<uint8_t>> to_result(Response &res) {
+    if (res.result() == http::status::ok)
+      return std::move(res.body());
+    return status_error(res);
+  }
+
+  // The Error for a final response other than 200.
+  template <class Message> static Error status_error(const Message &res) {
+    if (res.result() == http::status::temporary_redirect) {
+      return Error{ErrorCode::ServerError, "Invalid Redirect Location"};
+    } else if (res.result() == http::status::not_found) {
+      return Error{ErrorCode::NotFound, "Key not found"};
+    } else {
+      return Error{ErrorCode::ServerError,
+                   "Server error: " + std::to_string(res.result_int())};
+    }
+  }
+
+  // Conditional GET state: the ETag to send, and what the final response
+  // (after redirects) said.
+  struct Revalidation {
+    std::string_view if_none_match;
+    std::string etag;
+    bool not_modified = false;
+  };
+
+  // The caller's deadline, or request_timeout from now.
+  Clock::time_point call_deadline(Deadline deadline) const {
+    if (deadline != Deadline{})
+      return deadline;
+    return within(no_deadline, self_->opts.request_timeout);
+  }
+
+  Result<std::vector<uint8_t>>
+  perform_request(http::verb method, std::string_view target,
+                  std::span<const uint8_t> body = {}, Deadline deadline = {},
+                  Revalidation *reval = nullptr) {
+    const auto limit = call_deadline(deadline);
+    return with_retries(*self_, idempotent(method), limit, [&] {
+      return perform_request(*self_, method, target, body, 0, limit, reval);
+    });
+  }
+
+  // Helper to perform a single request on a pooled keep-alive connection.
+  // Safe to call from several threads at once.
+  Result<std::vector<uint8_t>>
+  perform_request(Endpoint &ep, http::verb method, std::string_view target,
+                  std::span<const uint8_t> body, int depth,
+                  Clock::time_point deadline, Revalidation *reval = nullptr) {
+    if (depth > 5) {
+      ep.metrics.failed(ErrorCode::NetworkError);
+      return Error{ErrorCode::NetworkError, "Too many redirects"};
+    }
+    if (auto unavailable = compression_unavailable(ep.opts.compression))
+      return *unavailable;
+
+    const auto start = Clock::now();
+    std::unique_ptr<Connection> conn;
+    Response res;
+    std::vector<uint8_t> packed;
+    std::size_t sent = 0;
+    try {
+      conn = ep.pool.checkout(deadline);
+      if (!conn) {
+        ep.metrics.failed(ErrorCode::Timeout);
+        return Error{ErrorCode::Timeout,
+                     "Timed out waiting for a pooled connection"};
+      }
+
+      // Send the HTTP request to the remote host
+      RequestStream io(*conn, deadline);
+      auto req = make_request(ep, method, target, body, &packed,
+                              reval ? reval->if_none_match : "");
+      sent = req.body().size();
+      const auto write_start = Clock::now();
+      http::write(io, req);
+      const auto written = Clock::now();
+      ep.metrics.timed(EndpointMetrics::Write, written - write_start);
+
+      // Receive the HTTP response into recycled body storage
+      Parser parser;
+      if (method == http::verb::get)
+        parser.get().body() = ep.bodies->acquire();
+      http::read_header(io, conn->buffer, parser);
+      ep.metrics.timed(EndpointMetrics::FirstByte, Clock::now() - written);
+      http::read(io, conn->buffer, parser);
+      res = parser.release();
+      trim_buffer(*conn, ep.opts.pool.buffer_high_water);
+    } catch (const std::exception &e) {
+      // The broken connection is not returned to the pool.
+      if (conn)
+        ep.pool.discard(std::move(conn));
+
+      auto failure = transport_error(e);
+      ep.metrics.failed(failure.code);
+      return failure;
+    }
+    ep.metrics.exchanged(sent, res.body().size());
+    ep.metrics.timed(EndpointMetrics::Total, Clock::now() - start);
+
+    // The connection is reusable unless the server asked to close it.
+    if (res.keep_alive())
+      ep.pool.checkin(std::move(conn));
+    else
+      ep.pool.discard(std::move(conn));
+
+    return finish_response(ep, method, target, body, res, depth, deadline,
+                           reval);
+  }
+
+  // Follows a redirect or maps the response to a Result.
+  Result<std::vector<uint8_t>>
+  finish_response(Endpoint &ep, http::verb method, std::string_view target,
+                  std::span<const uint8_t> body, Response &res, int depth,
+                  Clock::time_point deadline, Revalidation *reval = nullptr) {
+    std::string new_target;
+    if (auto next = follow_redirect(res, target, new_target)) {
+      ep.metrics.redirected();
+      return perform_request(*next, method, new_target, body, depth + 1,
+                             deadline, reval);
+    }
+    if (reval) {
+      if (auto it = res.find(http::field::etag); it != res.end())
+        reval->etag = std::string(it->value());
+      if (res.result() == http::status::not_modified) {
+        reval->not_modified = true;
+        return std::vector<uint8_t>();
+      }
+    }
+    if (auto failure = decode_body(ep, res)) {
+      ep.metrics.failed(failure->code);
+      return *failure;
+    }
+    auto result = to_result(res);
+    if (!result)
+      ep.metrics.failed(result.error().code);
+    return result;
+  }
+
+  static constexpr std::size_t stream_chunk = 64 * 1024;
+
+  // GET whose body goes to `sink` one buffer_body chunk at a time. Bodies of
+  // redirects and errors are read and dropped.
+  Result<uint64_t> stream_get(Endpoint &ep, std::string_view target,
+                              const ChunkSink &sink, int depth,
+                              Clock::time_point deadline) {
+    if (depth > 5) {
+      ep.metrics.failed(ErrorCode::NetworkError);
+      return Error{ErrorCode::NetworkError, "Too many redirects"};
+    }
+
+    const auto start = Clock::now();
+    std::unique_ptr<Connection> conn;
+    http::response_parser<http::buffer_body> parser;
+    parser.body_limit(std::numeric_limits<uint64_t>::max());
+    auto chunk = std::make_unique<uint8_t[]>(stream_chunk);
+    uint64_t delivered = 0;
+    bool aborted = false;
+    try {
+      conn = ep.pool.checkout(deadline);
+      if (!conn) {
+        ep.metrics.failed(ErrorCode::Timeout);
+        return Error{ErrorCode::Timeout,
+                     "Timed out waiting for a pooled connection"};
+      }
+
+      RequestStream io(*conn, deadline);
+      auto req = make_request(ep, http::verb::get, target, {});
+      http::write(io, req);
+      http::read_header(io, conn->buffer, parser);
+      const bool ok = parser.get().result() == http::status::ok;
+      while (!parser.is_done()) {
+        auto &body = parser.get().body();
+        body.data = chunk.get();
+        body.size = stream_chunk;
+        beast::error_code ec;
+        http::read(io, conn->buffer, parser, ec);
+        if (ec && ec != http::error::need_buffer)
+          throw beast::system_error(ec);
+        auto n = stream_chunk - body.size;
+        if (!ok || n == 0)
+          continue;
+        delivered += n;
+        if (!sink({chunk.get(), n})) {
+          aborted = true;
+          break;
+        }
+      }
+    } catch (const std::exception &e) {
+      if (conn)
+        ep.pool.discard(std::move(conn));
+      auto failure = transport_error(e);
+      ep.metrics.failed(failure.code);
+      return failure;
+    }
+    ep.metrics.exchanged(0, delivered);
+    ep.metrics.timed(EndpointMetrics::Total, Clock::now() - start);
+
+    // An aborted body leaves unread bytes on the connection.
+    if (!aborted && parser.get().keep_alive())
+      ep.pool.checkin(std::move(conn));
+    else
+      ep.pool.discard(std::move(conn));
+    if (aborted) {
+      ep.metrics.failed(ErrorCode::Unknown);
+      return Error{ErrorCode::Unknown, "Transfer aborted by sink"};
+    }
+
+    std::string new_target;
+    if (auto next = follow_redirect(parser.get(), target, new_target)) {
+      ep.metrics.redirected();
+      return stream_get(*next, new_target, sink, depth + 1, deadline);
+    }
+    if (parser.get().result() != http::status::ok) {
+      auto failure = status_error(parser.get());
+      ep.metrics.failed(failure.code);
+      return failure;
+    }
+    return delivered;
+  }
+
+  // PUT of `size` bytes written by `send_body(io)` after the header. A
+  // redirect is followed only if the body can be sent again (`replayable`).
+  template <class SendBody>
+  Result<void> stream_put(Endpoint &ep, std::string_view target,
+                          uint64_t size, SendBody &send_body, bool replayable,
+                          int depth, Clock::time_point deadline) {
+    if (depth > 5) {
+      ep.metrics.failed(ErrorCode::NetworkError);
+      return Error{ErrorCode::NetworkError, "Too many redirects"};
+    }
+
+    const auto start = Clock::now();
+    std::unique_ptr<Connection> conn;
+    Response res;
+    try {
+      conn = ep.pool.checkout(deadline);
+      if (!conn) {
+        ep.metrics.failed(ErrorCode::Timeout);
+        return Error{ErrorCode::Timeout,
+                     "Timed out waiting for a pooled connection"};
+      }
+
+      RequestStream io(*conn, deadline);
+      auto req = make_request(ep, http::verb::put, target, {});
+      req.content_length(size);
+      http::request_serializer<http::span_body<const uint8_t>> sr(req);
+      http::write_header(io, sr);
+      if (auto sent = send_body(io); !sent) {
+        // The server is still waiting for the rest of the body.
+        ep.pool.discard(std::move(conn));
+        ep.metrics.failed(sent.error().code);
+        return sent.error();
+      }
+
+      Parser parser;
+      http::read_header(io, conn->buffer, parser);
+      http::read(io, conn->buffer, parser);
+      res = parser.release();
+    } catch (const std::exception &e) {
+      if (conn)
+        ep.pool.discard(std::move(conn));
+      auto failure = transport_error(e);
+      ep.metrics.failed(failure.code);
+      return failure;
+    }
+    ep.metrics.exchanged(size, res.body().size());
+    ep.metrics.timed(EndpointMetrics::Total, Clock::now() - start);
+    if (res.keep_alive())
+      ep.pool.checkin(std::move(conn));
+    else
+      ep.pool.discard(std::move(conn));
+
+    std::string new_target;
+    if (auto next = follow_redirect(res, target, new_target)) {
+      ep.metrics.redirected();
+      if (!replayable) {
+        ep.metrics.failed(ErrorCode::ServerError);
+        return Error{ErrorCode::ServerError,
+                     "Streamed upload was redirected and cannot be replayed"};
+      }
+      return stream_put(*next, new_target, size, send_body, replayable,
+                        depth + 1, deadline);
+    }
+    auto result = to_result(res);
+    if (!result) {
+      ep.metrics.failed(result.error().code);
+      return result.error();
+    }
+    return Result<void>();
+  }
+
+  struct PipelinedRequest {
+    http::verb method;
+    std::string target;
+    std::span<const uint8_t> body; // Caller-owned
+  };
+
+  // HTTP/1.1 pipelining: writes up to pipeline_depth requests back to back on
+  // one connection, then reads their responses in FIFO order. If the server
+  // closes mid-pipeline, the unanswered requests are resent on a fresh
+  // connection; callers must only pipeline idempotent requests. Each window
+  // of pipeline_depth requests gets its own request_timeout.
+  std::vector<Result<std::vector<uint8_t>>>
+  perform_pipeline(std::span<const PipelinedRequest> reqs) {
+    Endpoint &ep = *self_;
+    std::vector<Result<std::vector<uint8_t>>> out(reqs.size());
+    if (auto unavailable = compression_unavailable(ep.opts.compression)) {
+      std::fill(out.begin(), out.end(), *unavailable);
+      return out;
+    }
+    std::vector<std::size_t> sent(reqs.size()); // Body bytes on the wire
+    std::vector<uint8_t> packed; // Only written before its request is sent
+    const std::size_t depth =
+        std::max<std::size_t>(1, ep.opts.pool.pipeline_depth);
+
+    std::size_t next = 0;    // First request without a response
+    int failed_attempts = 0; // Consecutive connections that made no progress
+    while (next < reqs.size()) {
+      std::unique_ptr<Connection> conn;
+      std::optional<Error> failure;
+      const std::size_t start = next;
+      bool reusable = true;
+      try {
+        conn = ep.pool.checkout(call_deadline({}));
+        if (!conn)
+          failure = Error{ErrorCode::Timeout,
+                          "Timed out waiting for a pooled connection"};
+
+        // The connection's buffer may hold bytes of the next response
+        // after each read.
+        while (conn && next < reqs.size() && reusable) {
+          const std::size_t end = std::min(reqs.size(), next + depth);
+          const auto deadline = call_deadline({});
+          RequestStream io(*conn, deadline);
+          std::size_t written = next;
+          beast::error_code write_ec;
+          for (; written < end; ++written) {
+            auto req = make_request(ep, reqs[written].method,
+                                    reqs[written].target, reqs[written].body,
+                                    &packed);
+            sent[written] = req.body().size();
+            http::write(io, req, write_ec);
+            if (write_ec)
+              break;
+          }
+          // The server may have answered some requests before closing, so
+          // collect what was written even if a later write failed.
+          for (std::size_t i = next; i < written; ++i) {
+            Response res;
+            if (reqs[i].method == http::verb::get)
+              res.body() = ep.bodies->acquire();
+            http::read(io, conn->buffer, res);
+            reusable = res.keep_alive();
+            ep.metrics.exchanged(sent[i], res.body().size());
+            out[i] = finish_response(ep, reqs[i].method, reqs[i].target,
+                                     reqs[i].body, res, 0, deadline);
+            ++next;
+            if (!reusable)
+              break; // Anything after this was never answered
+          }
+          if (write_ec && reusable)
+            throw beast::system_error(write_ec);
+        }
+      } catch (const std::exception &e) {
+        failure = transport_error(e);
+        reusable = false;
+      }
+
+      if (conn) {
+        trim_buffer(*conn, ep.opts.pool.buffer_high_water);
+        if (reusable)
+          ep.pool.checkin(std::move(conn));
+        else
+          ep.pool.discard(std::move(conn));
+      }
+
+      if (failure) {
+        // A connection that closed after answering some requests is normal
+        // keep-alive churn; two in a row that answered nothing is not.
+        failed_attempts = next > start ? 0 : failed_attempts + 1;
+        if (failure->code == ErrorCode::Timeout || failed_attempts >= 2) {
+          for (std::size_t i = next; i < reqs.size(); ++i) {
+            out[i] = *failure;
+            ep.metrics.failed(failure->code);
+          }
+          break;
+        }
+      }
+    }
+    return out;
+  }
+
+  net::awaitable<Result<std::vector<uint8_t>>>
+  async_perform_request(http::verb method, std::string_view target,
+                        std::span<const uint8_t> body = {}) {
+    Endpoint &ep = *self_;
+    const auto deadline = call_deadline({});
+    auto res =
+        co_await async_perform_request(ep, method, target, body, 0, deadline);
+    if (ep.opts.retry.max_attempts <= 1 || !ep.async_pool)
+      co_return res;
+    Clock::duration pause;
+    for (std::size_t n = 1;
+         should_retry(ep, res, idempotent(method), n, deadline, pause); ++n) {
+      net::steady_timer timer(ep.async_pool->executor(), pause);
+      co_await timer.async_wait(net::use_awaitable);
+      ep.metrics.retried();
+      res = co_await async_perform_request(ep, method, target, body, 0,
+                                           deadline);
+    }
+    co_return res;
+  }
+
+  // Coroutine counterpart of perform_request, running on the executor the
+  // Client was constructed with.
+  net::awaitable<Result<std::vector<uint8_t>>>
+  async_perform_request(Endpoint &ep, http::verb method,
+                        std::string_view target,
+                        std::span<const uint8_t> body, int depth,
+                        Clock::time_point deadline) {
+    if (!ep.async_pool)
+      co_return Error{ErrorCode::BadRequest,
+                      "Client was not constructed with an io_context"};
+    if (depth > 5) {
+      ep.metrics.failed(ErrorCode::NetworkError);
+      co_return Error{ErrorCode::NetworkError, "Too many redirects"};
+    }
+    if (auto unavailable = compression_unavailable(ep.opts.compression))
+      co_return *unavailable;
+
+    const auto start = Clock::now();
+    std::unique_ptr<AsyncConnection> conn;
+    Response res;
+    std::vector<uint8_t> packed;
+    std::size_t sent = 0;
+    std::optional<Error> failure;
+    try {
+      conn = co_await ep.async_pool->checkout(deadline);
+      if (!conn) {
+        ep.metrics.failed(ErrorCode::Timeout);
+        co_return Error{ErrorCode::Timeout,
+                        "Timed out waiting for a pooled connection"};
+      }
+
+      auto req = make_request(ep, method, target, body, &packed);
+      sent = req.body().size();
+      set_expiry(conn->stream, deadline);
+      const auto write_start = Clock::now();
+      co_await on_stream(*conn, [&](auto &stream) {
+        return http::async_write(stream, req, net::use_awaitable);
+      });
+      const auto written = Clock::now();
+      ep.metrics.timed(EndpointMetrics::Write, written - write_start);
 
-// --- PIMPL Implementation ---
+      Parser parser;
+      if (method == http::verb::get)
+        parser.get().body() = ep.bodies->acquire();
+      co_await on_stream(*conn, [&](auto &stream) {
+        return http::async_read_header(stream, conn->buffer, parser,
+                                       net::use_awaitable);
+      });
+      ep.metrics.timed(EndpointMetrics::FirstByte, Clock::now() - written);
+      co_await on_stream(*conn, [&](auto &stream) {
+        return http::async_read(stream, conn->buffer, parser,
+                                net::use_awaitable);
+      });
+      res = parser.release();
+      trim_buffer(*conn, ep.opts.pool.buffer_high_water);
+    } catch (const std::exception &e) {
+      failure = transport_error(e);
+    }
+    if (failure) {
+      if (conn)
+        ep.async_pool->discard(std::move(conn));
+      ep.metrics.failed(failure->code);
+      co_return *failure;
+    }
+    ep.metrics.exchanged(sent, res.body().size());
+    ep.metrics.timed(EndpointMetrics::Total, Clock::now() - start);
 
-class ClientImpl {
-public:
-  std::string host_;
-  std::string port_;
-  net::io_context ioc_;
-  tcp::resolver resolver_;
-  beast::tcp_stream stream_;
-
-  ClientImpl(std::string_view host, int port)
-      : host_(host), port_(std::to_string(port)), ioc_(), resolver_(ioc_),
-        stream_(ioc_) {}
-
-  // Helper to parse URL: http://host:port/path
-  // Very basic for internal redirects
-  bool parse_location(const std::string &loc, std::string &out_host,
-                      int &out_port, std::string &out_target) {
-    if (loc.rfind("http://", 0) != 0)
-      return false;
-    auto host_start = loc.begin() + 7;
-    auto port_sep = std::find(host_start, loc.end(), ':');
-    if (port_sep == loc.end())
-      return false;
-    auto path_sep = std::find(port_sep, loc.end(), '/');
+    if (res.keep_alive())
+      ep.async_pool->checkin(std::move(conn));
+    else
+      ep.async_pool->discard(std::move(conn));
 
-    out_host = std::string(host_start, port_sep);
-    std::string port_str(port_sep + 1, path_sep);
-    try {
-      out_port = std::stoi(port_str);
-    } catch (...) {
-      return false;
+    std::string new_target;
+    if (auto next = follow_redirect(res, target, new_target)) {
+      ep.metrics.redirected();
+      co_return co_await async_perform_request(*next, method, new_target,
+                                               body, depth + 1, deadline);
     }
+    if (auto undecodable = decode_body(ep, res)) {
+      ep.metrics.failed(undecodable->code);
+      co_return *undecodable;
+    }
+    auto result = to_result(res);
+    if (!result)
+      ep.metrics.failed(result.error().code);
+    co_return result;
+  }
+};
 
-    if (path_sep != loc.end())
-      out_target = std::string(path_sep, loc.end());
-    else
-      out_target = "/";
-    return true;
+// KvOp -> one HTTP request on /kv/<key>.
+class HttpTransport : public Transport {
+public:
+  explicit HttpTransport(ClientImpl &impl) : impl_(impl) {}
+
+  Result<std::vector<uint8_t>> call(Endpoint &ep, KvOp op, KvKey key,
+                                    std::span<const uint8_t> value, int depth,
+                                    Clock::time_point deadline) override {
+    static constexpr http::verb verbs[] = {http::verb::unknown, http::verb::get,
+                                           http::verb::put,
+                                           http::verb::delete_};
+    const auto verb = verbs[static_cast<int>(op)];
+    if (!key.target.empty())
+      return impl_.perform_request(ep, verb, key.target, value, depth,
+                                   deadline);
+    TargetBuilder target(key.key);
+    return impl_.perform_request(ep, verb, target.str(), value, depth,
+                                 deadline);
   }
 
-  // Helper to perform a single request
-  // Beast is lower-level; we need to connect, write, read.
-  // Ideally we keep the connection open (Keep-Alive).
-  Result<std::vector<uint8_t>>
-  perform_request(http::verb method, std::string_view target,
-                  const std::vector<uint8_t> &body = {}, int depth = 0) {
+private:
+  ClientImpl &impl_;
+};
+
+// KvOp -> one frame on the endpoint's BinaryChannel, over HTTP for nodes
+// that declined the upgrade.
+class BinaryTransport : public Transport {
+public:
+  explicit BinaryTransport(ClientImpl &impl) : impl_(impl), http_(impl) {}
+
+  Result<std::vector<uint8_t>> call(Endpoint &ep, KvOp op, KvKey key,
+                                    std::span<const uint8_t> value, int depth,
+                                    Clock::time_point deadline) override {
+    if (!ep.binary || !ep.binary->available())
+      return http_.call(ep, op, key, value, depth, deadline);
     if (depth > 5) {
+      ep.metrics.failed(ErrorCode::NetworkError);
       return Error{ErrorCode::NetworkError, "Too many redirects"};
     }
 
-    try {
-      // Check if connected, if not connect.
-      if (!stream_.socket().is_open()) {
-        // std::cout << "Client: Reconnecting to " << host_ << ":" << port_ <<
-        // "\n"; // DEBUG
-        connect();
-      }
+    const auto start = Clock::now();
+    auto reply = ep.binary->call(op, key.key, value, deadline);
+    if (!reply) {
+      if (!ep.binary->available())
+        return http_.call(ep, op, key, value, depth, deadline);
+      ep.metrics.failed(reply.error().code);
+      return reply.error();
+    }
+    ep.metrics.exchanged(value.size(), reply->body.size());
+    ep.metrics.timed(EndpointMetrics::Total, Clock::now() - start);
 
-      // Set up an HTTP request message
-      http::request<http::vector_body<uint8_t>> req{method, std::string(target),
-                                                    11};
-      req.set(http::field::host, host_);
-      req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
-      req.set(http::field::content_type, "application/octet-stream");
-      req.keep_alive(true);
-      if (!body.empty()) {
-        req.body() = body;
-        req.prepare_payload();
-      } else {
-        req.prepare_payload();
+    switch (reply->status) {
+    case BinaryStatus::Ok:
+      return std::move(reply->body);
+    case BinaryStatus::Moved:
+      if (auto next = moved_to(*reply, key.key)) {
+        ep.metrics.redirected();
+        return call(*next, op, key, value, depth + 1, deadline);
       }
+      ep.metrics.failed(ErrorCode::ServerError);
+      return Error{ErrorCode::ServerError, "Invalid Redirect Location"};
+    case BinaryStatus::NotFound:
+      ep.metrics.failed(ErrorCode::NotFound);
+      return Error{ErrorCode::NotFound, "Key not found"};
+    case BinaryStatus::BadRequest:
+      ep.metrics.failed(ErrorCode::BadRequest);
+      return Error{ErrorCode::BadRequest,
+                   std::string(reply->body.begin(), reply->body.end())};
+    default:
+      ep.metrics.failed(ErrorCode::ServerError);
+      return Error{ErrorCode::ServerError,
+                   "Server error: binary status " +
+                       std::to_string(static_cast<int>(reply->status))};
+    }
+  }
 
-      // Send the HTTP request to the remote host
-      http::write(stream_, req);
-
-      // This buffer is used for reading and must be persisted
-      beast::flat_buffer buffer;
-
-      // Declare a container to hold the response
-      http::response<http::vector_body<uint8_t>> res;
-
-      // Receive the HTTP response
-      http::read(stream_, buffer, res);
-
-      // Handle status codes
-      if (res.result() == http::status::ok) {
-        return std::move(res.body());
-      } else if (res.result() == http::status::temporary_redirect) {
-        // Follow Redirect
-        auto loc_it = res.find(http::field::location);
-        if (loc_it != res.end()) {
-          std::string location(loc_it->value());
-          std::string new_host;
-          int new_port = 0;
-          std::string new_target;
-          if (parse_location(location, new_host, new_port, new_target)) {
-            // Create one-off client to follow redirect
-            // We don't want to close OUR connection.
-            ClientImpl temp_client(new_host, new_port);
-            return temp_client.perform_request(method, new_target, body,
-                                               depth + 1);
-          }
-        }
-        return Error{ErrorCode::ServerError, "Invalid Redirect Location"};
+private:
+  // The endpoint named by a Moved reply's "host:port", reported to the
+  // redirect observer like an HTTP 307.
+  std::shared_ptr<Endpoint> moved_to(const BinaryChannel::Reply &reply,
+                                     std::string_view key) {
+    std::string_view to(reinterpret_cast<const char *>(reply.body.data()),
+                        reply.body.size());
+    auto colon = to.rfind(':');
+    int port = 0;
+    if (colon == std::string_view::npos || colon == 0)
+      return nullptr;
+    auto [end, ec] =
+        std::from_chars(to.data() + colon + 1, to.data() + to.size(), port);
+    if (ec != std::errc() || end != to.data() + to.size() || port <= 0 ||
+        port > 65535)
+      return nullptr;
+    std::string host(to.substr(0, colon));
+    if (impl_.on_redirect_) {
+      std::string target = "/kv/";
+      target.append(key);
+      impl_.on_redirect_(target, host, port);
+    }
+    return impl_.cache_->get(host, port);
+  }
 
-      } else if (res.result() == http::status::not_found) {
-        return Error{ErrorCode::NotFound, "Key not found"};
-      } else {
-        return Error{ErrorCode::ServerError,
-                     "Server error: " + std::to_string(res.result_int())};
-      }
+  ClientImpl &impl_;
+  HttpTransport http_;
+};
 
-    } catch (const std::exception &e) {
-      // If we failed, maybe connection closed? specific logic could go here.
-      // For now, return network error.
-      // Try to close gracefully if possible
-      beast::error_code ec;
-      stream_.socket().shutdown(tcp::socket::shutdown_both, ec);
-      stream_.close();
+ClientImpl::ClientImpl(std::shared_ptr<EndpointCache> cache,
+                       std::string_view host, int port)
+    : cache_(std::move(cache)), self_(cache_->get(host, port)) {
+  if (self_->opts.protocol == Protocol::Binary)
+    transport_ = std::make_unique<BinaryTransport>(*this);
+  else
+    transport_ = std::make_unique<HttpTransport>(*this);
+}
 
-      return Error{ErrorCode::NetworkError, e.what()};
-    }
-  }
+Result<void> pin_thread(unsigned cpu) {
+#ifdef __linux__
+  if (cpu >= CPU_SETSIZE)
+    return Error{ErrorCode::BadRequest, "No such CPU"};
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (int rc = ::pthread_setaffinity_np(::pthread_self(), sizeof set, &set))
+    return Error{ErrorCode::Unknown, std::system_category().message(rc)};
+  return Result<void>();
+#else
+  (void)cpu;
+  return Error{ErrorCode::Unknown, "CPU pinning is not supported here"};
+#endif
+}
 
-  void connect() {
-    auto const results = resolver_.resolve(host_, port_);
-    stream_.connect(results);
-    stream_.socket().set_option(tcp::no_delay(true));
-  }
+// --- PooledBuffer ---
 
-  // Explicitly close
-  void close() {
-    beast::error_code ec;
-    stream_.socket().shutdown(tcp::socket::shutdown_both, ec);
+PooledBuffer::PooledBuffer(std::shared_ptr<BodyPool> pool,
+                           std::vector<uint8_t> data)
+    : pool_(std::move(pool)), data_(std::move(data)) {}
+
+PooledBuffer::~PooledBuffer() {
+  if (pool_)
+    pool_->release(std::move(data_));
+}
+
+PooledBuffer::PooledBuffer(PooledBuffer &&) noexcept = default;
+
+PooledBuffer &PooledBuffer::operator=(PooledBuffer &&other) noexcept {
+  if (this != &other) {
+    if (pool_)
+      pool_->release(std::move(data_));
+    pool_ = std::move(other.pool_);
+    data_ = std::move(other.data_);
   }
-};
+  return *this;
+}
+
+lite3cpp::Buffer PooledBuffer::release() && {
+  pool_.reset();
+  return lite3cpp::Buffer(std::move(data_));
+}
 
 // --- Client Methods ---
 
-Client::Client(std::string_view host, int port)
-    : impl_(std::make_unique<ClientImpl>(host, port)) {}
+Client::Client(std::string_view host, int port, ClientOptions options)
+    : Client(make_endpoint_cache(options, nullptr), host, port) {}
+
+Client::Client(net::io_context &ioc, std::string_view host, int port,
+               ClientOptions options)
+    : Client(make_endpoint_cache(options, &ioc), host, port) {}
+
+Client::Client(const tcp::endpoint &endpoint, ClientOptions options)
+    : Client(make_endpoint_cache(options, nullptr),
+             endpoint.address().to_string(), endpoint.port()) {}
+
+Client::Client(std::shared_ptr<EndpointCache> cache, std::string_view host,
+               int port)
+    : impl_(std::make_unique<ClientImpl>(std::move(cache), host, port)) {}
+
+std::shared_ptr<EndpointCache>
+Client::make_endpoint_cache(ClientOptions options, net::io_context *ioc) {
+  std::optional<net::any_io_executor> ex;
+  if (ioc)
+    ex = ioc->get_executor();
+  return std::make_shared<EndpointCache>(options, std::move(ex));
+}
+
+void Client::prune_endpoint_cache(EndpointCache &cache) { cache.prune(); }
+
+ClientStats Client::endpoint_cache_stats(EndpointCache &cache) {
+  return cache.stats();
+}
+
+ClientStats Client::stats() const { return impl_->cache_->stats(); }
+
+bool Client::accepting() const { return impl_->self_->breaker.closed(); }
+
+Result<void> Client::warm_up(Deadline deadline) {
+  auto &ep = *impl_->self_;
+  try {
+    ep.pool.warm(std::max<std::size_t>(ep.opts.pool.min_connections, 1),
+                 impl_->call_deadline(deadline));
+  } catch (const std::exception &e) {
+    return transport_error(e);
+  }
+  return Result<void>();
+}
+
+void Client::set_redirect_observer(RedirectObserver observer) {
+  impl_->on_redirect_ = std::move(observer);
+}
 
 Client::~Client() = default;
 
 Client::Client(Client &&) noexcept = default;
 Client &Client::operator=(Client &&) noexcept = default;
 
-Result<void> Client::put(std::string_view key, std::string_view value) {
+Result<void> Client::put(std::string_view key, std::string_view value,
+                         Deadline deadline) {
+  return impl_->put({key}, as_bytes(value), deadline);
+}
+
+// Sent straight from the Buffer's storage
+Result<void> Client::put(std::string_view key, const lite3cpp::Buffer &buf,
+                         Deadline deadline) {
+  return impl_->put({key}, {buf.data(), buf.size()}, deadline);
+}
+
+Result<lite3cpp::Buffer> Client::get(std::string_view key, Deadline deadline) {
+  auto res = impl_->kv(KvOp::Get, {key}, {}, deadline);
+  if (!res)
+    return res.error();
+  return lite3cpp::Buffer(std::move(res.value()));
+}
+
+Result<PooledBuffer> Client::get_pooled(std::string_view key,
+                                        Deadline deadline) {
+  auto res = impl_->kv(KvOp::Get, {key}, {}, deadline);
+  if (!res)
+    return res.error();
+  return PooledBuffer(impl_->self_->bodies, std::move(res).value());
+}
+
+Result<void> Client::del(std::string_view key, Deadline deadline) {
+  return impl_->del({key}, deadline);
+}
+
+Result<void> Client::put(const KeyRef &key, std::string_view value,
+                         Deadline deadline) {
+  return impl_->put({key.key(), key.target()}, as_bytes(value), deadline);
+}
+
+Result<void> Client::put(const KeyRef &key, const lite3cpp::Buffer &buf,
+                         Deadline deadline) {
+  return impl_->put({key.key(), key.target()}, {buf.data(), buf.size()},
+                    deadline);
+}
+
+Result<lite3cpp::Buffer> Client::get(const KeyRef &key, Deadline deadline) {
+  auto res = impl_->kv(KvOp::Get, {key.key(), key.target()}, {}, deadline);
+  if (!res)
+    return res.error();
+  return lite3cpp::Buffer(std::move(res.value()));
+}
+
+Result<PooledBuffer> Client::get_pooled(const KeyRef &key,
+                                        Deadline deadline) {
+  auto res = impl_->kv(KvOp::Get, {key.key(), key.target()}, {}, deadline);
+  if (!res)
+    return res.error();
+  return PooledBuffer(impl_->self_->bodies, std::move(res).value());
+}
+
+Result<void> Client::del(const KeyRef &key, Deadline deadline) {
+  return impl_->del({key.key(), key.target()}, deadline);
+}
+
+Result<Client::TaggedBody> Client::tagged_get(std::string_view key,
+                                              std::string_view etag,
+                                              Deadline deadline) {
   if (key.empty())
     return Error{ErrorCode::BadRequest, "Key cannot be empty"};
-  std::string path = "/kv/";
-  path.append(key);
+  TargetBuilder target(key);
+  return tagged_raw_get(target.str(), etag, deadline);
+}
+
+Result<Client::TaggedBody> Client::tagged_raw_get(std::string_view path,
+                                                  std::string_view etag,
+                                                  Deadline deadline) {
+  ClientImpl::Revalidation reval;
+  reval.if_none_match = etag;
+  auto res =
+      impl_->perform_request(http::verb::get, path, {}, deadline, &reval);
+  if (!res)
+    return res.error();
+  return TaggedBody{std::move(res).value(), std::move(reval.etag),
+                    reval.not_modified};
+}
 
-  std::vector<uint8_t> vec(value.begin(), value.end());
-  auto res = impl_->perform_request(http::verb::put, path, vec);
-  if (!res) {
+Result<void> Client::patch_int(std::string_view key, std::string_view field,
+                               int64_t value, Deadline deadline) {
+  if (key.empty())
+    return Error{ErrorCode::BadRequest, "Key cannot be empty"};
+
+  TargetBuilder target(key);
+  target.param("op", "set_int").param("field", field).param("val", value);
+
+  auto res =
+      impl_->perform_request(http::verb::post, target.str(), {}, deadline);
+  if (!res)
     return Result<void>(res.error());
-  }
   return Result<void>();
 }
 
-Result<void> Client::put(std::string_view key, const lite3cpp::Buffer &buf) {
+Result<void> Client::patch_str(std::string_view key, std::string_view field,
+                               std::string_view value, Deadline deadline) {
   if (key.empty())
     return Error{ErrorCode::BadRequest, "Key cannot be empty"};
-  std::string path = "/kv/";
-  path.append(key);
 
-  // Buffer data is already a vector<uint8_t>
-  std::vector<uint8_t> vec(buf.data(), buf.data() + buf.size());
-  auto res = impl_->perform_request(http::verb::put, path, vec);
-  if (!res) {
+  if (!fits_query(value))
+    return patch(key, PatchBatch().set_str(field, value), deadline);
+
+  TargetBuilder target(key);
+  target.param("op", "set_str").param("field", field).param("val", value);
+
+  auto res =
+      impl_->perform_request(http::verb::post, target.str(), {}, deadline);
+  if (!res)
+    return Result<void>(res.error());
+  return Result<void>();
+}
+
+namespace {
+template <class Int> void append_le(std::vector<uint8_t> &out, Int v) {
+  auto u = static_cast<std::make_unsigned_t<Int>>(v);
+  for (std::size_t i = 0; i < sizeof(Int); ++i)
+    out.push_back(static_cast<uint8_t>(u >> (8 * i)));
+}
+} // namespace
+
+void PatchBatch::append_field(Kind kind, std::string_view field) {
+  if (field.empty() || field.size() > UINT16_MAX)
+    valid_ = false;
+  body_.push_back(static_cast<uint8_t>(kind));
+  auto n = static_cast<uint16_t>(field.size());
+  body_.push_back(static_cast<uint8_t>(n));
+  body_.push_back(static_cast<uint8_t>(n >> 8));
+  body_.insert(body_.end(), field.begin(), field.end());
+
+  ++count_;
+  for (int i = 0; i < 4; ++i)
+    body_[i] = static_cast<uint8_t>(count_ >> (8 * i));
+}
+
+PatchBatch &PatchBatch::set_int(std::string_view field, int64_t value) {
+  append_field(Kind::SetInt, field);
+  append_le(body_, value);
+  return *this;
+}
+
+PatchBatch &PatchBatch::set_str(std::string_view field,
+                                std::string_view value) {
+  append_field(Kind::SetStr, field);
+  if (value.size() > UINT32_MAX)
+    valid_ = false;
+  append_le(body_, static_cast<uint32_t>(value.size()));
+  body_.insert(body_.end(), value.begin(), value.end());
+  return *this;
+}
+
+PatchBatch &PatchBatch::add_int(std::string_view field, int64_t delta) {
+  append_field(Kind::AddInt, field);
+  append_le(body_, delta);
+  return *this;
+}
+
+Result<void> Client::patch(std::string_view key, const PatchBatch &batch,
+                           Deadline deadline) {
+  if (key.empty())
+    return Error{ErrorCode::BadRequest, "Key cannot be empty"};
+  if (!batch.valid())
+    return Error{ErrorCode::BadRequest, "Patch field or value too long"};
+  if (batch.empty())
+    return Result<void>();
+
+  TargetBuilder target(key);
+  target.param("op", "patch");
+
+  auto res = impl_->perform_request(http::verb::post, target.str(),
+                                    batch.body(), deadline);
+  if (!res)
     return Result<void>(res.error());
-  }
   return Result<void>();
 }
 
-Result<lite3cpp::Buffer> Client::get(std::string_view key) {
+Result<uint64_t> Client::get_to(std::string_view key, const ChunkSink &sink,
+                                Deadline deadline) {
   if (key.empty())
     return Error{ErrorCode::BadRequest, "Key cannot be empty"};
-  std::string path = "/kv/";
-  path.append(key);
+  TargetBuilder target(key);
+  return impl_->stream_get(*impl_->self_, target.str(), sink, 0,
+                           impl_->call_deadline(deadline));
+}
+
+Result<void> Client::put_from(std::string_view key, const ChunkSource &source,
+                              uint64_t size, Deadline deadline) {
+  if (key.empty())
+    return Error{ErrorCode::BadRequest, "Key cannot be empty"};
+  TargetBuilder target(key);
+
+  auto chunk = std::make_unique<uint8_t[]>(ClientImpl::stream_chunk);
+  auto send = [&](RequestStream &io) -> Result<void> {
+    for (uint64_t left = size; left > 0;) {
+      auto want = static_cast<std::size_t>(
+          std::min<uint64_t>(left, ClientImpl::stream_chunk));
+      auto n = source({chunk.get(), want});
+      if (n == 0 || n > want)
+        return Error{ErrorCode::BadRequest, "Source ended before size bytes"};
+      net::write(io, net::buffer(chunk.get(), n));
+      left -= n;
+    }
+    return Result<void>();
+  };
+  return impl_->stream_put(*impl_->self_, target.str(), size, send, false, 0,
+                           impl_->call_deadline(deadline));
+}
+
+Result<void> Client::put_file(std::string_view key, const std::string &path,
+                              Deadline deadline) {
+  if (key.empty())
+    return Error{ErrorCode::BadRequest, "Key cannot be empty"};
+  TargetBuilder target(key);
+
+#ifdef __linux__
+  struct File {
+    int fd;
+    ~File() {
+      if (fd >= 0)
+        ::close(fd);
+    }
+  } file{::open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+  struct stat st {};
+  if (file.fd < 0 || ::fstat(file.fd, &st) != 0)
+    return Error{ErrorCode::BadRequest, "Cannot open " + path};
+  const auto size = static_cast<uint64_t>(st.st_size);
 
-  auto res = impl_->perform_request(http::verb::get, path);
+  // The kernel copies file pages straight to the socket, unless TLS has to
+  // encrypt them on the way.
+  std::unique_ptr<uint8_t[]> chunk;
+  auto send = [&](RequestStream &io) -> Result<void> {
+    off_t offset = 0;
+    for (uint64_t left = size; left > 0;) {
+      if (io.encrypted()) {
+        if (!chunk)
+          chunk = std::make_unique<uint8_t[]>(ClientImpl::stream_chunk);
+        auto r = ::pread(file.fd, chunk.get(),
+                         std::min<uint64_t>(left, ClientImpl::stream_chunk),
+                         offset);
+        if (r < 0)
+          throw beast::system_error(errno, beast::system_category());
+        if (r == 0)
+          return Error{ErrorCode::BadRequest, "File shrank during upload"};
+        net::write(io, net::buffer(chunk.get(), static_cast<std::size_t>(r)));
+        offset += r;
+        left -= static_cast<uint64_t>(r);
+        continue;
+      }
+      auto want = static_cast<std::size_t>(std::min<uint64_t>(left, 1 << 30));
+      beast::error_code ec;
+      auto n = io.plain().write_native(
+          [&]() -> std::size_t {
+            auto r = ::sendfile(io.plain().native_handle(), file.fd, &offset,
+                                want);
+            if (r < 0) {
+              ec.assign(errno, beast::system_category());
+              return 0;
+            }
+            ec = {};
+            return static_cast<std::size_t>(r);
+          },
+          ec);
+      if (ec)
+        throw beast::system_error(ec);
+      if (n == 0)
+        return Error{ErrorCode::BadRequest, "File shrank during upload"};
+      left -= n;
+    }
+    return Result<void>();
+  };
+#else
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file)
+    return Error{ErrorCode::BadRequest, "Cannot open " + path};
+  const auto size = static_cast<uint64_t>(file.tellg());
+
+  auto chunk = std::make_unique<uint8_t[]>(ClientImpl::stream_chunk);
+  auto send = [&](RequestStream &io) -> Result<void> {
+    file.clear();
+    file.seekg(0);
+    for (uint64_t left = size; left > 0;) {
+      auto want = static_cast<std::streamsize>(
+          std::min<uint64_t>(left, ClientImpl::stream_chunk));
+      file.read(reinterpret_cast<char *>(chunk.get()), want);
+      auto n = static_cast<std::size_t>(file.gcount());
+      if (n == 0)
+        return Error{ErrorCode::BadRequest, "File shrank during upload"};
+      net::write(io, net::buffer(chunk.get(), n));
+      left -= n;
+    }
+    return Result<void>();
+  };
+#endif
+  return impl_->stream_put(*impl_->self_, target.str(), size, send, true, 0,
+                           impl_->call_deadline(deadline));
+}
+
+Result<FieldValue> Client::get_field(std::string_view key,
+                                    std::string_view field,
+                                    Deadline deadline) {
+  auto res = get_fields(key, std::span(&field, 1), deadline);
   if (!res)
     return res.error();
-  return lite3cpp::Buffer(std::move(res.value()));
+  return std::move(std::move(res).value().front());
 }
 
-Result<void> Client::del(std::string_view key) {
+Result<std::vector<FieldValue>>
+Client::get_fields(std::string_view key,
+                   std::span<const std::string_view> fields,
+                   Deadline deadline) {
   if (key.empty())
     return Error{ErrorCode::BadRequest, "Key cannot be empty"};
-  std::string path = "/kv/";
-  path.append(key);
+  if (fields.empty())
+    return std::vector<FieldValue>();
 
-  // DELETE usually returns 200 or 404. Our helper returns error on 404.
-  // We should treat 404 as success for delete (idempotency).
-  auto res = impl_->perform_request(http::verb::delete_, path);
-  if (!res) {
-    if (res.error().code == ErrorCode::NotFound)
-      return Result<void>();
-    return Result<void>(res.error());
+  for (auto field : fields)
+    if (field.empty() || field.find(',') != std::string_view::npos)
+      return Error{ErrorCode::BadRequest, "Invalid field name"};
+  TargetBuilder target(key);
+  target.param("op", "get_fields").param("fields", fields);
+
+  auto res =
+      impl_->perform_request(http::verb::get, target.str(), {}, deadline);
+  if (!res)
+    return res.error();
+  const auto &body = res.value();
+  auto doc = nlohmann::json::parse(body.begin(), body.end(), nullptr, false);
+  if (!doc.is_object())
+    return Error{ErrorCode::ServerError, "Malformed field projection"};
+
+  std::vector<FieldValue> out;
+  out.reserve(fields.size());
+  for (auto field : fields) {
+    auto it = doc.find(field);
+    if (it == doc.end() || it->is_null())
+      out.emplace_back();
+    else if (it->is_boolean())
+      out.emplace_back(it->get<bool>());
+    else if (it->is_number_integer())
+      out.emplace_back(it->get<int64_t>());
+    else if (it->is_number())
+      out.emplace_back(it->get<double>());
+    else if (it->is_string())
+      out.emplace_back(std::move(it->get_ref<std::string &>()));
+    else
+      out.emplace_back(it->dump());
   }
-  return Result<void>();
+  return out;
 }
 
-Result<void> Client::patch_int(std::string_view key, std::string_view field,
-                               int64_t value) {
+Result<std::vector<ScanEntry>>
+Client::scan_page(std::string_view prefix, std::string_view after,
+                  std::size_t limit, bool values, Deadline deadline) {
+  if (limit == 0)
+    return Error{ErrorCode::BadRequest, "Scan limit must be positive"};
+  TargetBuilder target(prefix);
+  target.param("op", "scan").param("limit", static_cast<int64_t>(limit));
+  if (!after.empty())
+    target.param("after", after);
+  if (values)
+    target.param("values", 1);
+
+  auto res =
+      impl_->perform_request(http::verb::get, target.str(), {}, deadline);
+  if (!res)
+    return res.error();
+
+  std::span<const uint8_t> rest = res.value();
+  auto take = [&rest](auto &out) {
+    if (rest.size() < 4 || rest.size() - 4 < load_le32(rest.data()))
+      return false;
+    const auto n = load_le32(rest.data());
+    out.assign(rest.begin() + 4, rest.begin() + 4 + n);
+    rest = rest.subspan(4 + n);
+    return true;
+  };
+  std::vector<ScanEntry> out;
+  while (!rest.empty()) {
+    auto &entry = out.emplace_back();
+    if (!take(entry.key) || (values && !take(entry.value)))
+      return Error{ErrorCode::ServerError, "Malformed scan page"};
+  }
+  return out;
+}
+
+std::vector<Result<lite3cpp::Buffer>>
+Client::pipeline(std::span<const PipelineOp> ops) {
+  std::vector<Result<lite3cpp::Buffer>> out(
+      ops.size(), Result<lite3cpp::Buffer>(
+                      Error{ErrorCode::BadRequest, "Key cannot be empty"}));
+
+  // Empty keys never reach the wire; they keep their error slot in `out`.
+  std::vector<std::size_t> sent;
+  std::vector<ClientImpl::PipelinedRequest> reqs;
+  sent.reserve(ops.size());
+  reqs.reserve(ops.size());
+  for (std::size_t i = 0; i < ops.size(); ++i) {
+    const auto &op = ops[i];
+    if (op.key.empty())
+      continue;
+    std::string path = "/kv/";
+    path.append(op.key);
+    switch (op.kind) {
+    case PipelineOp::Kind::Put:
+      reqs.push_back({http::verb::put, std::move(path), as_bytes(op.value)});
+      break;
+    case PipelineOp::Kind::Get:
+      reqs.push_back({http::verb::get, std::move(path), {}});
+      break;
+    case PipelineOp::Kind::Del:
+      reqs.push_back({http::verb::delete_, std::move(path), {}});
+      break;
+    }
+    sent.push_back(i);
+  }
+
+  auto responses = impl_->perform_pipeline(reqs);
+  for (std::size_t j = 0; j < sent.size(); ++j) {
+    auto &res = responses[j];
+    if (res)
+      out[sent[j]] = lite3cpp::Buffer(std::move(res.value()));
+    else if (ops[sent[j]].kind == PipelineOp::Kind::Del &&
+             res.error().code == ErrorCode::NotFound)
+      out[sent[j]] = lite3cpp::Buffer(); // Same as del(): 404 is success
+    else
+      out[sent[j]] = res.error();
+  }
+  return out;
+}
+
+Result<std::vector<uint8_t>> Client::impl_raw_get(std::string_view path) {
+  return impl_->perform_request(http::verb::get, path);
+}
+
+// --- Asynchronous Client Methods ---
+
+net::awaitable<Result<void>> Client::async_put(std::string_view key,
+                                               std::string_view value) {
   if (key.empty())
-    return Error{ErrorCode::BadRequest, "Key cannot be empty"};
+    co_return Error{ErrorCode::BadRequest, "Key cannot be empty"};
+  std::string path = "/kv/";
+  path.append(key);
+
+  auto res = co_await impl_->async_perform_request(http::verb::put, path,
+                                                   as_bytes(value));
+  if (!res)
+    co_return Result<void>(res.error());
+  co_return Result<void>();
+}
 
+net::awaitable<Result<void>> Client::async_put(std::string_view key,
+                                               const lite3cpp::Buffer &buf) {
+  if (key.empty())
+    co_return Error{ErrorCode::BadRequest, "Key cannot be empty"};
   std::string path = "/kv/";
   path.append(key);
-  path += "?op=set_int&field=" + std::string(field) +
-          "&val=" + std::to_string(value);
 
-  auto res = impl_->perform_request(http::verb::post, path);
+  auto res = co_await impl_->async_perform_request(http::verb::put, path,
+                                                   {buf.data(), buf.size()});
   if (!res)
-    return Result<void>(res.error());
-  return Result<void>();
+    co_return Result<void>(res.error());
+  co_return Result<void>();
 }
 
-Result<void> Client::patch_str(std::string_view key, std::string_view field,
-                               std::string_view value) {
+net::awaitable<Result<lite3cpp::Buffer>>
+Client::async_get(std::string_view key) {
   if (key.empty())
-    return Error{ErrorCode::BadRequest, "Key cannot be empty"};
+    co_return Error{ErrorCode::BadRequest, "Key cannot be empty"};
+  std::string path = "/kv/";
+  path.append(key);
 
+  auto res = co_await impl_->async_perform_request(http::verb::get, path);
+  if (!res)
+    co_return res.error();
+  co_return lite3cpp::Buffer(std::move(res.value()));
+}
+
+net::awaitable<Result<void>> Client::async_del(std::string_view key) {
+  if (key.empty())
+    co_return Error{ErrorCode::BadRequest, "Key cannot be empty"};
   std::string path = "/kv/";
   path.append(key);
-  // Simple URL parameter construction (assuming safe characters for benchmark)
-  path +=
-      "?op=set_str&field=" + std::string(field) + "&val=" + std::string(value);
 
-  auto res = impl_->perform_request(http::verb::post, path);
+  // 404 is success for delete, same as the blocking API.
+  auto res = co_await impl_->async_perform_request(http::verb::delete_, path);
+  if (!res && res.error().code != ErrorCode::NotFound)
+    co_return Result<void>(res.error());
+  co_return Result<void>();
+}
+
+net::awaitable<Result<void>> Client::async_patch_int(std::string_view key,
+                                                     std::string_view field,
+                                                     int64_t value) {
+  if (key.empty())
+    co_return Error{ErrorCode::BadRequest, "Key cannot be empty"};
+
+  std::string path;
+  TargetBuilder(path, key)
+      .param("op", "set_int")
+      .param("field", field)
+      .param("val", value);
+
+  auto res = co_await impl_->async_perform_request(http::verb::post, path);
   if (!res)
-    return Result<void>(res.error());
-  return Result<void>();
+    co_return Result<void>(res.error());
+  co_return Result<void>();
 }
 
-Result<std::vector<uint8_t>> Client::impl_raw_get(std::string_view path) {
-  auto res = impl_->perform_request(http::verb::get, path);
+net::awaitable<Result<void>> Client::async_patch_str(std::string_view key,
+                                                     std::string_view field,
+                                                     std::string_view value) {
+  if (key.empty())
+    co_return Error{ErrorCode::BadRequest, "Key cannot be empty"};
+
+  std::string path;
+  std::span<const uint8_t> body;
+  PatchBatch batch; // Outlives the request, which views its body
+  if (fits_query(value)) {
+    TargetBuilder(path, key)
+        .param("op", "set_str")
+        .param("field", field)
+        .param("val", value);
+  } else {
+    TargetBuilder(path, key).param("op", "patch");
+    body = batch.set_str(field, value).body();
+    if (!batch.valid())
+      co_return Error{ErrorCode::BadRequest, "Patch field or value too long"};
+  }
+
+  auto res =
+      co_await impl_->async_perform_request(http::verb::post, path, body);
   if (!res)
-    return res.error();
-  return std::move(res.value());
+    co_return Result<void>(res.error());
+  co_return Result<void>();
+}
+
+// --- std::future Overloads ---
+// Each one copies its arguments into a coroutine frame so the caller's
+// temporaries may go away before the request completes.
+
+namespace {
+
+net::awaitable<Result<void>> owned_put(Client &c, std::string key,
+                                       std::string value) {
+  co_return co_await c.async_put(key, value);
+}
+
+net::awaitable<Result<void>> owned_put_buf(Client &c, std::string key,
+                                           lite3cpp::Buffer buf) {
+  co_return co_await c.async_put(key, buf);
+}
+
+net::awaitable<Result<lite3cpp::Buffer>> owned_get(Client &c,
+                                                   std::string key) {
+  co_return co_await c.async_get(key);
+}
+
+net::awaitable<Result<void>> owned_del(Client &c, std::string key) {
+  co_return co_await c.async_del(key);
+}
+
+net::awaitable<Result<void>> owned_patch_int(Client &c, std::string key,
+                                             std::string field,
+                                             int64_t value) {
+  co_return co_await c.async_patch_int(key, field, value);
+}
+
+net::awaitable<Result<void>> owned_patch_str(Client &c, std::string key,
+                                             std::string field,
+                                             std::string value) {
+  co_return co_await c.async_patch_str(key, field, value);
+}
+
+} // namespace
+
+std::future<Result<void>> Client::async_put(std::string_view key,
+                                            std::string_view value,
+                                            net::use_future_t<>) {
+  return net::co_spawn(impl_->spawn_executor(),
+                       owned_put(*this, std::string(key), std::string(value)),
+                       net::use_future);
+}
+
+std::future<Result<void>> Client::async_put(std::string_view key,
+                                            lite3cpp::Buffer buf,
+                                            net::use_future_t<>) {
+  return net::co_spawn(impl_->spawn_executor(),
+                       owned_put_buf(*this, std::string(key), std::move(buf)),
+                       net::use_future);
+}
+
+std::future<Result<lite3cpp::Buffer>>
+Client::async_get(std::string_view key, net::use_future_t<>) {
+  return net::co_spawn(impl_->spawn_executor(),
+                       owned_get(*this, std::string(key)), net::use_future);
+}
+
+std::future<Result<void>> Client::async_del(std::string_view key,
+                                            net::use_future_t<>) {
+  return net::co_spawn(impl_->spawn_executor(),
+                       owned_del(*this, std::string(key)), net::use_future);
+}
+
+std::future<Result<void>> Client::async_patch_int(std::string_view key,
+                                                  std::string_view field,
+                                                  int64_t value,
+                                                  net::use_future_t<>) {
+  return net::co_spawn(
+      impl_->spawn_executor(),
+      owned_patch_int(*this, std::string(key), std::string(field), value),
+      net::use_future);
+}
+
+std::future<Result<void>> Client::async_patch_str(std::string_view key,
+                                                  std::string_view field,
+                                                  std::string_view value,
+                                                  net::use_future_t<>) {
+  return net::co_spawn(impl_->spawn_executor(),
+                       owned_patch_str(*this, std::string(key),
+                                       std::string(field), std::string(value)),
+                       net::use_future);
 }
 
 } // namespace lite3
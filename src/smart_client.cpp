@@ -1,136 +1,2056 @@
 #include "lite3/smart_client.hpp"
 #include "lite3/ring.hpp" // Ensure ring is available
-#include <iostream>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <deque>
+#include <future>
+#include <list>
 #include <nlohmann/json.hpp>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
 
 using json = nlohmann::json;
+namespace net = boost::asio;
 
 namespace lite3 {
 
-SmartClient::SmartClient(std::string_view seed_host, int seed_port)
-    : seed_host_(seed_host), seed_port_(seed_port) {}
+// Immutable once published, but for its redirect hints. Node clients sit in
+// a dense array; `ids` is sorted and parallel to it, so a lookup is a binary
+// search over a few cache lines instead of a std::map walk.
+struct SmartClient::RoutingSnapshot {
+  // Unique across SmartClients; KeyRef caches a route under it.
+  const uint64_t stamp = next_stamp();
+  uint64_t epoch = 0; // Of the cluster map it was built from
+  // Shared with the previous snapshot while the node IDs stay the same.
+  std::shared_ptr<const lite3::ConsistentHash> ring =
+      std::make_shared<lite3::ConsistentHash>();
+  std::vector<uint32_t> ids;
+  std::vector<std::shared_ptr<Client>> nodes; // nodes[i] serves ids[i]
+  std::vector<std::shared_ptr<NodeLoad>> load; // load[i] tracks nodes[i]
+  std::map<std::string, uint32_t, std::less<>> endpoint_ids; // "host:port"
+  // Owners learned from 307s, consulted before the ring until the next
+  // topology change. A direct-mapped table of key hash tag | slot + 1:
+  // routing reads one word without a lock, and a new hint overwrites only
+  // the one it collides with.
+  static constexpr std::size_t hint_cells = 4096;
+  static constexpr uint64_t hint_slot_mask = 0xffff;
+  const std::unique_ptr<std::atomic<uint64_t>[]> hints =
+      std::make_unique<std::atomic<uint64_t>[]>(hint_cells);
+  std::atomic<bool> hinted{false}; // Set by the first hint
 
-SmartClient::~SmartClient() = default;
+  std::size_t slot_of(uint32_t id) const {
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (it == ids.end() || *it != id)
+      return nodes.size();
+    return static_cast<std::size_t>(it - ids.begin());
+  }
+  // The ring owner's slot, or slot 0 when the ring names no known node.
+  std::size_t owner_of(std::string_view key) const {
+    auto slot = slot_of(ring->get_node(key));
+    return slot == nodes.size() && !nodes.empty() ? 0 : slot;
+  }
+
+  // The slot a 307 named for `key`, or nodes.size() when there is none.
+  std::size_t hint_of(std::string_view key) const {
+    if (!hinted.load(std::memory_order_relaxed))
+      return nodes.size();
+    const auto hash = std::hash<std::string_view>{}(key);
+    const auto cell = hints[hash % hint_cells].load(std::memory_order_relaxed);
+    if (cell == 0 || (cell & ~hint_slot_mask) != (hash & ~hint_slot_mask))
+      return nodes.size();
+    return std::min<std::size_t>((cell & hint_slot_mask) - 1, nodes.size());
+  }
+
+  // Routes `key` to `slot` from now on; a slot the ring already names
+  // drops the key's hint instead. Writes only when that changes the cell.
+  void hint(std::string_view key, std::size_t slot) {
+    if (slot >= hint_slot_mask)
+      return;
+    const auto hash = std::hash<std::string_view>{}(key);
+    auto &cell = hints[hash % hint_cells];
+    const auto old = cell.load(std::memory_order_relaxed);
+    const bool mine = old != 0 && (old & ~hint_slot_mask) ==
+                                      (hash & ~hint_slot_mask);
+    if (slot == owner_of(key)) {
+      if (mine)
+        cell.store(0, std::memory_order_relaxed);
+      return;
+    }
+    const uint64_t next = (hash & ~hint_slot_mask) | (slot + 1);
+    if (old == next)
+      return;
+    cell.store(next, std::memory_order_relaxed);
+    hinted.store(true, std::memory_order_relaxed);
+  }
+
+  static uint64_t next_stamp() {
+    static std::atomic<uint64_t> next{1};
+    return next.fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+// The snapshot one thread last routed with (see snapshot()). Every
+// thread's entry is registered so ~SmartClient can drop the ones holding
+// its snapshots. The owning thread reads its entry unlocked; it and
+// ~SmartClient change it only under mutex().
+struct SmartClient::ThreadRoutes {
+  std::atomic<uint64_t> instance{0}; // 0: holds nothing
+  uint64_t version = 0;
+  std::shared_ptr<RoutingSnapshot> snap;
+
+  ThreadRoutes() {
+    std::lock_guard lock(mutex());
+    all().insert(this);
+  }
+  ~ThreadRoutes() {
+    std::lock_guard lock(mutex());
+    all().erase(this);
+  }
+
+  static std::mutex &mutex() {
+    static std::mutex m;
+    return m;
+  }
+  static std::unordered_set<ThreadRoutes *> &all() {
+    static std::unordered_set<ThreadRoutes *> entries;
+    return entries;
+  }
+};
+
+// Outstanding reads and smoothed read latency of one node, compared when
+// choosing a replica. Carried across refreshes along with the node's Client.
+struct SmartClient::NodeLoad {
+  std::atomic<uint32_t> inflight{0};
+  std::atomic<uint64_t> ewma_us{0}; // 0 until the first sample
+
+  void record(uint64_t us) {
+    // Racy update: a lost sample only slows convergence.
+    auto old = ewma_us.load(std::memory_order_relaxed);
+    ewma_us.store(old == 0 ? us + 1 : old - old / 8 + us / 8 + 1,
+                  std::memory_order_relaxed);
+  }
+  // Lower is better. Unmeasured nodes score zero so they get sampled.
+  uint64_t score() const {
+    return (inflight.load(std::memory_order_relaxed) + 1) *
+           ewma_us.load(std::memory_order_relaxed);
+  }
+};
+
+// Log-linear histogram of read latencies, four buckets per power of two.
+// Counts are halved periodically so percentiles follow recent traffic.
+struct SmartClient::ReadLatency {
+  static constexpr std::size_t buckets = 4 * 40;
+  static constexpr uint64_t decay_at = 1 << 14;
+  static constexpr uint64_t min_samples = 64;
+  std::array<std::atomic<uint64_t>, buckets> counts{};
+  std::atomic<uint64_t> total{0};
+
+  static std::size_t bucket(uint64_t us) {
+    if (us < 4)
+      return us;
+    std::size_t msb = std::bit_width(us) - 1;
+    return std::min((msb - 1) * 4 + ((us >> (msb - 2)) & 3), buckets - 1);
+  }
+  static uint64_t bucket_floor(std::size_t b) {
+    return b < 4 ? b : (4 + b % 4) << (b / 4 - 1);
+  }
+
+  void record(uint64_t us) {
+    counts[bucket(us)].fetch_add(1, std::memory_order_relaxed);
+    if (total.fetch_add(1, std::memory_order_relaxed) + 1 == decay_at) {
+      for (auto &c : counts)
+        c.store(c.load(std::memory_order_relaxed) / 2,
+                std::memory_order_relaxed);
+      total.fetch_sub(decay_at / 2, std::memory_order_relaxed);
+    }
+  }
+  // Upper edge of the bucket holding quantile `q`; 0 with too few samples.
+  uint64_t percentile_us(double q) const {
+    uint64_t n = 0;
+    for (auto &c : counts)
+      n += c.load(std::memory_order_relaxed);
+    if (n < min_samples)
+      return 0;
+    auto want = static_cast<uint64_t>(q * static_cast<double>(n));
+    uint64_t seen = 0;
+    for (std::size_t b = 0; b + 1 < buckets; ++b) {
+      seen += counts[b].load(std::memory_order_relaxed);
+      if (seen > want)
+        return bucket_floor(b + 1);
+    }
+    return bucket_floor(buckets - 1);
+  }
+};
+
+// Sharded, byte-bounded cache behind get(). Each shard is an LRU list with
+// TinyLFU admission: a count-min sketch tracks how often keys are asked for,
+// and a new key only displaces LRU victims that are asked for less often,
+// so a scan over cold keys cannot flush the hot set.
+struct SmartClient::NearCache {
+  using Clock = std::chrono::steady_clock;
+  using Bytes = std::shared_ptr<const std::vector<uint8_t>>;
+  static constexpr std::size_t entry_overhead = 96; // Node, index, strings
+
+  struct Lookup {
+    Bytes value;        // Fresh hit, or the expired value to revalidate
+    std::string etag;   // Set when the expired value may be revalidated
+    bool fresh = false;
+    uint64_t epoch = 0; // Hand back to fill()/revalidated()
+  };
+
+  // Four rows of saturating 4-bit counters, halved every `sample` additions
+  // so old popularity fades.
+  struct Sketch {
+    static constexpr std::size_t width = 1024; // Power of two
+    static constexpr uint32_t sample = 10 * width;
+    std::array<std::array<uint8_t, width>, 4> rows{};
+    uint32_t added = 0;
+
+    static std::size_t slot(uint64_t hash, std::size_t row) {
+      hash *= 0x9E3779B97F4A7C15ull + 2 * row;
+      return (hash >> 32) & (width - 1);
+    }
+    void add(uint64_t hash) {
+      for (std::size_t r = 0; r < rows.size(); ++r) {
+        auto &c = rows[r][slot(hash, r)];
+        if (c < 15)
+          ++c;
+      }
+      if (++added == sample) {
+        for (auto &row : rows)
+          for (auto &c : row)
+            c /= 2;
+        added = sample / 2;
+      }
+    }
+    uint8_t estimate(uint64_t hash) const {
+      uint8_t n = 15;
+      for (std::size_t r = 0; r < rows.size(); ++r)
+        n = std::min(n, rows[r][slot(hash, r)]);
+      return n;
+    }
+  };
+
+  struct Entry {
+    std::string key;
+    uint64_t hash;
+    Bytes value;
+    std::string etag;
+    Clock::time_point expires;
+    std::size_t bytes;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::list<Entry> lru; // Most recently used first
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+    std::size_t used = 0;
+    std::size_t budget = 0;
+    uint64_t epoch = 0; // Bumped by every invalidation
+    Sketch sketch;
+  };
+
+  explicit NearCache(const NearCacheOptions &o)
+      : ttl(o.ttl), revalidate(o.revalidate),
+        shards(std::max<std::size_t>(o.shards, 1)) {
+    for (auto &s : shards)
+      s.budget = o.max_bytes / shards.size();
+  }
+
+  Lookup find(std::string_view key) {
+    auto hash = std::hash<std::string_view>{}(key);
+    auto &s = shard(hash);
+    std::lock_guard lock(s.mutex);
+    s.sketch.add(hash);
+    Lookup out;
+    out.epoch = s.epoch;
+    auto it = s.index.find(key);
+    if (it != s.index.end()) {
+      auto e = it->second;
+      if (ttl.count() == 0 || Clock::now() < e->expires) {
+        s.lru.splice(s.lru.begin(), s.lru, e);
+        hits.fetch_add(1, std::memory_order_relaxed);
+        out.value = e->value;
+        out.fresh = true;
+        return out;
+      }
+      if (revalidate && !e->etag.empty()) {
+        out.value = e->value;
+        out.etag = e->etag;
+      }
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    return out;
+  }
+
+  // Caches a fetched value, unless a local write invalidated the shard
+  // since the find() that returned `epoch`: the fetch may predate it.
+  void fill(std::string_view key, Bytes value, std::string etag,
+            uint64_t epoch) {
+    auto hash = std::hash<std::string_view>{}(key);
+    auto bytes = key.size() + value->size() + entry_overhead;
+    auto &s = shard(hash);
+    std::lock_guard lock(s.mutex);
+    if (s.epoch != epoch || bytes > s.budget)
+      return;
+    auto expires = Clock::now() + ttl;
+
+    if (auto it = s.index.find(key); it != s.index.end()) {
+      auto e = it->second;
+      s.used = s.used - e->bytes + bytes;
+      e->value = std::move(value);
+      e->etag = std::move(etag);
+      e->expires = expires;
+      e->bytes = bytes;
+      s.lru.splice(s.lru.begin(), s.lru, e);
+      while (s.used > s.budget && s.lru.size() > 1)
+        evict_lru(s);
+      return;
+    }
+
+    // Admission: every entry that would have to go must be colder.
+    auto heat = s.sketch.estimate(hash);
+    std::size_t freed = 0;
+    for (auto v = s.lru.rbegin(); s.used - freed + bytes > s.budget; ++v) {
+      if (s.sketch.estimate(v->hash) > heat)
+        return;
+      freed += v->bytes;
+    }
+    while (s.used + bytes > s.budget)
+      evict_lru(s);
+
+    s.lru.push_front(
+        {std::string(key), hash, std::move(value), std::move(etag), expires,
+         bytes});
+    s.index.emplace(s.lru.front().key, s.lru.begin());
+    s.used += bytes;
+  }
+
+  // A 304 answered the revalidation of the entry find() returned.
+  void revalidated(std::string_view key, uint64_t epoch) {
+    revalidations.fetch_add(1, std::memory_order_relaxed);
+    auto hash = std::hash<std::string_view>{}(key);
+    auto &s = shard(hash);
+    std::lock_guard lock(s.mutex);
+    if (s.epoch != epoch)
+      return;
+    if (auto it = s.index.find(key); it != s.index.end())
+      it->second->expires = Clock::now() + ttl;
+  }
+
+  void invalidate(std::string_view key) {
+    invalidations.fetch_add(1, std::memory_order_relaxed);
+    auto &s = shard(std::hash<std::string_view>{}(key));
+    std::lock_guard lock(s.mutex);
+    ++s.epoch;
+    if (auto it = s.index.find(key); it != s.index.end()) {
+      auto e = it->second;
+      s.used -= e->bytes;
+      s.index.erase(it);
+      s.lru.erase(e);
+    }
+  }
+
+  NearCacheStats stats() {
+    NearCacheStats out;
+    out.hits = hits.load(std::memory_order_relaxed);
+    out.misses = misses.load(std::memory_order_relaxed);
+    out.revalidated = revalidations.load(std::memory_order_relaxed);
+    out.evictions = evictions.load(std::memory_order_relaxed);
+    out.invalidations = invalidations.load(std::memory_order_relaxed);
+    for (auto &s : shards) {
+      std::lock_guard lock(s.mutex);
+      out.entries += s.lru.size();
+      out.bytes += s.used;
+    }
+    return out;
+  }
+
+  Shard &shard(uint64_t hash) { return shards[hash % shards.size()]; }
+
+  void evict_lru(Shard &s) {
+    auto &victim = s.lru.back();
+    s.used -= victim.bytes;
+    s.index.erase(victim.key);
+    s.lru.pop_back();
+    evictions.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  const std::chrono::milliseconds ttl;
+  const bool revalidate;
+  std::vector<Shard> shards;
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+  std::atomic<uint64_t> revalidations{0};
+  std::atomic<uint64_t> evictions{0};
+  std::atomic<uint64_t> invalidations{0};
+};
+
+// Threads for hedged reads, scan pages and the per-node groups of batches,
+// started on demand up to a cap
+// and kept until shutdown(), so the read path does not pay for a thread
+// per attempt. A task runs with `stopping` set once shutdown() has begun
+// and must then only clean up; tasks posted after that run at once, on the
+// poster's thread.
+class WorkerPool {
+public:
+  using Task = std::function<void(bool stopping)>;
+
+  explicit WorkerPool(std::size_t max_threads) : max_threads_(max_threads) {}
+  ~WorkerPool() { shutdown(); }
+
+  void post(Task task) {
+    std::unique_lock lock(mutex_);
+    if (stopping_) {
+      lock.unlock();
+      task(true);
+      return;
+    }
+    queue_.push_back(std::move(task));
+    if (queue_.size() > idle_ && threads_.size() < max_threads_)
+      threads_.emplace_back([this] { run(); });
+    else
+      wake_.notify_one();
+  }
+
+  // Runs task(i, stopping) for each i < n and returns once all have: i = 0
+  // on the calling thread, the rest on the pool.
+  void run_all(std::size_t n,
+               const std::function<void(std::size_t, bool)> &task) {
+    if (n == 0)
+      return;
+    std::mutex mutex;
+    std::condition_variable done;
+    std::size_t running = n - 1;
+    for (std::size_t i = 1; i < n; ++i)
+      post([&, i](bool stopping) {
+        task(i, stopping);
+        std::lock_guard lock(mutex);
+        if (--running == 0)
+          done.notify_one(); // Under the lock: `done` is on the caller's stack
+      });
+    task(0, false);
+    std::unique_lock lock(mutex);
+    done.wait(lock, [&] { return running == 0; });
+  }
+
+  // Waits for the running tasks, then runs what is queued as stopping.
+  void shutdown() {
+    {
+      std::lock_guard lock(mutex_);
+      if (stopping_)
+        return;
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto &t : threads_)
+      t.join();
+  }
+
+private:
+  void run() {
+    std::unique_lock lock(mutex_);
+    for (;;) {
+      ++idle_;
+      wake_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+      --idle_;
+      if (queue_.empty())
+        return;
+      auto task = std::move(queue_.front());
+      queue_.pop_front();
+      const bool stopping = stopping_;
+      lock.unlock();
+      task(stopping);
+      lock.lock();
+    }
+  }
+
+  const std::size_t max_threads_;
+  std::mutex mutex_; // Everything below
+  std::condition_variable wake_;
+  std::deque<Task> queue_;
+  std::size_t idle_ = 0; // Threads waiting for a task
+  bool stopping_ = false;
+  std::vector<std::thread> threads_; // Only grows until shutdown()
+};
+
+// Pending writes per key, swapped out wholesale by each flush. `bytes`
+// counts keys being flushed as well, so the budget bounds both.
+struct SmartClient::WriteBehind {
+  using Clock = std::chrono::steady_clock;
+
+  struct Pending {
+    std::optional<std::string> value; // Latest put, sent before the sets
+    std::map<std::string, int64_t, std::less<>> sets; // Latest per field
+    std::size_t bytes = 0;
+  };
+  using Buffer =
+      std::unordered_map<std::string, Pending, StringHash, std::equal_to<>>;
+
+  WriteBehind(SmartClient &client, WriteBehindOptions options)
+      : owner(client), opts(options), flusher([this] { run(); }) {}
+
+  ~WriteBehind() {
+    {
+      std::lock_guard lock(mutex);
+      stop = true;
+    }
+    wake.notify_all();
+    flusher.join();
+    flush();
+  }
+
+  Result<void> put(std::string_view key, std::string_view value,
+                   Deadline deadline) {
+    const auto size = key.size() + value.size();
+    std::unique_lock lock(mutex);
+    if (!make_room(lock, limit(deadline), [&] {
+          auto it = pending.find(key);
+          const auto old = it == pending.end() ? 0 : it->second.bytes;
+          return size > old ? size - old : 0;
+        }))
+      return full();
+    auto &p = entry(key);
+    if (p.value)
+      p.value->assign(value);
+    else
+      p.value.emplace(value);
+    p.sets.clear();
+    resize(p, size);
+    return Result<void>();
+  }
+
+  Result<void> set_int(std::string_view key, std::string_view field,
+                       int64_t value, Deadline deadline) {
+    const auto size = field.size() + sizeof value;
+    std::unique_lock lock(mutex);
+    if (!make_room(lock, limit(deadline), [&] {
+          auto it = pending.find(key);
+          if (it == pending.end())
+            return key.size() + size;
+          return it->second.sets.contains(field) ? 0 : size;
+        }))
+      return full();
+    auto &p = entry(key);
+    if (auto it = p.sets.find(field); it != p.sets.end()) {
+      it->second = value;
+    } else {
+      p.sets.emplace(std::string(field), value);
+      resize(p, p.bytes + size);
+    }
+    return Result<void>();
+  }
+
+  // Removes `key`'s buffered writes, first waiting out a flush that may be
+  // sending older ones.
+  std::optional<Pending> take(std::string_view key) {
+    std::unique_lock lock(mutex);
+    if (!pending.contains(key) && !inflight.contains(key))
+      return std::nullopt;
+    lock.unlock();
+    std::lock_guard serial(flush_mutex);
+    lock.lock();
+    auto it = pending.find(key);
+    if (it == pending.end())
+      return std::nullopt;
+    auto p = std::move(it->second);
+    pending.erase(it);
+    bytes -= p.bytes;
+    lock.unlock();
+    space.notify_all();
+    return p;
+  }
+
+  Result<void> flush() {
+    std::lock_guard serial(flush_mutex);
+    {
+      std::lock_guard lock(mutex);
+      inflight.swap(pending);
+      starved = false;
+    }
+    auto res = send(inflight);
+    std::size_t sent = 0;
+    for (const auto &[key, p] : inflight)
+      sent += p.bytes;
+    {
+      std::lock_guard lock(mutex);
+      bytes -= sent;
+      inflight.clear();
+    }
+    space.notify_all();
+    return res;
+  }
+
+  // Puts go out pipelined per node (see run_batch()); patches follow, one
+  // node's in sequence and nodes in parallel. A key whose put failed skips
+  // its patch.
+  Result<void> send(const Buffer &batch) {
+    Result<void> first;
+    auto note = [&](const Error &e) {
+      failed.fetch_add(1, std::memory_order_relaxed);
+      if (first)
+        first = e;
+    };
+
+    std::vector<PipelineOp> puts;
+    for (const auto &[key, p] : batch)
+      if (p.value)
+        puts.push_back(PipelineOp::put(key, *p.value));
+    std::unordered_set<std::string_view> lost;
+    if (!puts.empty()) {
+      auto results = owner.run_batch(puts);
+      for (std::size_t i = 0; i < results.size(); ++i)
+        if (!results[i]) {
+          lost.insert(puts[i].key);
+          note(results[i].error());
+        }
+    }
+
+    std::vector<std::pair<std::string_view, PatchBatch>> patches;
+    for (const auto &[key, p] : batch) {
+      if (p.sets.empty() || lost.contains(key))
+        continue;
+      PatchBatch b;
+      for (const auto &[field, value] : p.sets)
+        b.set_int(field, value);
+      patches.emplace_back(key, std::move(b));
+    }
+    auto snap = owner.routing_.load(std::memory_order_acquire);
+    std::vector<std::vector<std::size_t>> by_node(snap->nodes.size());
+    std::vector<Result<void>> patched(patches.size());
+    for (std::size_t i = 0; i < patches.size(); ++i) {
+      auto slot = owner.route_slot(*snap, patches[i].first);
+      if (slot == snap->nodes.size())
+        patched[i] = Error{ErrorCode::NetworkError, "No nodes available"};
+      else
+        by_node[slot].push_back(i);
+    }
+    std::vector<std::size_t> busy; // Slots with patches to send
+    for (std::size_t slot = 0; slot < by_node.size(); ++slot)
+      if (!by_node[slot].empty())
+        busy.push_back(slot);
+    owner.workers_->run_all(busy.size(), [&](std::size_t n, bool stopping) {
+      const auto slot = busy[n];
+      for (auto i : by_node[slot])
+        patched[i] =
+            stopping
+                ? Result<void>(Error{ErrorCode::NetworkError,
+                                     "SmartClient destroyed"})
+                : owner.observe(snap->nodes[slot]->patch(patches[i].first,
+                                                         patches[i].second));
+    });
+    for (auto &res : patched)
+      if (!res)
+        note(res.error());
+
+    requests.fetch_add(puts.size() + patches.size(),
+                       std::memory_order_relaxed);
+    if (owner.near_cache_)
+      for (const auto &[key, p] : batch)
+        owner.near_cache_->invalidate(key);
+    return first;
+  }
+
+  WriteBehindStats stats() {
+    WriteBehindStats out;
+    out.writes = writes.load(std::memory_order_relaxed);
+    out.coalesced = coalesced.load(std::memory_order_relaxed);
+    out.requests = requests.load(std::memory_order_relaxed);
+    out.failed = failed.load(std::memory_order_relaxed);
+    std::lock_guard lock(mutex);
+    out.keys = pending.size();
+    out.bytes = bytes;
+    return out;
+  }
+
+private:
+  void run() {
+    std::unique_lock lock(mutex);
+    while (!stop) {
+      wake.wait_for(lock, opts.window, [&] { return stop || starved; });
+      if (stop)
+        break; // The destructor flushes what is left
+      if (pending.empty()) {
+        starved = false; // Only a flush under way holds the bytes
+        continue;
+      }
+      lock.unlock();
+      flush();
+      lock.lock();
+    }
+  }
+
+  // A writer's own Deadline, else ClientOptions::request_timeout from now.
+  Clock::time_point limit(Deadline deadline) const {
+    if (deadline != Deadline{})
+      return deadline;
+    const auto timeout = owner.options_.request_timeout;
+    return timeout.count() > 0 ? Clock::now() + timeout
+                               : Clock::time_point::max();
+  }
+
+  // Waits until `growth()` more bytes fit. An entry larger than the whole
+  // budget still gets in once nothing else is buffered.
+  template <typename Growth>
+  bool make_room(std::unique_lock<std::mutex> &lock,
+                 Clock::time_point deadline, Growth growth) {
+    while (bytes > 0 && bytes + growth() > opts.max_bytes) {
+      starved = true;
+      wake.notify_one();
+      if (deadline == Clock::time_point::max())
+        space.wait(lock);
+      else if (space.wait_until(lock, deadline) == std::cv_status::timeout)
+        return bytes == 0 || bytes + growth() <= opts.max_bytes;
+    }
+    return true;
+  }
+
+  Pending &entry(std::string_view key) {
+    writes.fetch_add(1, std::memory_order_relaxed);
+    if (auto it = pending.find(key); it != pending.end()) {
+      coalesced.fetch_add(1, std::memory_order_relaxed);
+      return it->second;
+    }
+    auto &p = pending.emplace(std::string(key), Pending{}).first->second;
+    resize(p, key.size());
+    return p;
+  }
+
+  void resize(Pending &p, std::size_t size) {
+    bytes = bytes - p.bytes + size;
+    p.bytes = size;
+  }
+
+  static Error full() {
+    return Error{ErrorCode::Timeout, "Write-behind buffer full"};
+  }
+
+  SmartClient &owner;
+  const WriteBehindOptions opts;
+  std::mutex flush_mutex; // One flush at a time; taken before `mutex`
+  std::mutex mutex;       // Everything below
+  std::condition_variable wake;  // stop or starved
+  std::condition_variable space; // A flush finished or a key was taken
+  Buffer pending;
+  Buffer inflight; // Being sent; only its flush changes it
+  std::size_t bytes = 0;
+  bool starved = false; // A writer waits for room: flush early
+  bool stop = false;
+  std::atomic<uint64_t> writes{0};
+  std::atomic<uint64_t> coalesced{0};
+  std::atomic<uint64_t> requests{0};
+  std::atomic<uint64_t> failed{0};
+  std::thread flusher; // Last: runs on everything above
+};
+
+namespace {
+std::atomic<uint64_t> next_instance_id{1};
+constexpr std::size_t max_replicas = 8;
+// Hedged attempts and scan pages beyond this many at once wait their turn.
+constexpr std::size_t max_worker_threads = 64;
+
+// Nodes a read may use. The cluster map names owners only, so any other
+// node may not hold the key, and reading there costs a 307 hop or a wasted
+// NotFound; until the map names replica sets, reads stay on the owner.
+constexpr std::size_t known_replicas = 1;
+
+bool connection_failed(const Error &e) {
+  return e.code == ErrorCode::NetworkError ||
+         e.code == ErrorCode::ConnectionRefused;
+}
+
+// Whether a replica's failed read settles it. Replicas are chosen by node
+// ID, not by where the cluster copies keys, so a NotFound from anyone but
+// the owner only means "ask the next one".
+bool final_error(const Error &e, bool owner) {
+  return !connection_failed(e) && (owner || e.code != ErrorCode::NotFound);
+}
+
+std::string_view as_chars(const lite3cpp::Buffer &buf) {
+  return {reinterpret_cast<const char *>(buf.data()), buf.size()};
+}
+
+// /cluster/map, parsed from either encoding.
+struct ClusterMap {
+  struct Node {
+    uint32_t id;
+    std::string host;
+    int port;
+  };
+  uint64_t epoch = 0; // 0: the seed does not number its maps
+  std::vector<Node> nodes;
+};
+
+// Binary /cluster/map (?format=binary), integers little-endian:
+//   "L3TM", u8 version (1), u8 0, u16 0, u64 epoch, u32 node count,
+//   then per node: u32 id, u16 http_port, u16 host length, host
+// Seeds that ignore the query answer JSON, told apart by the magic.
+constexpr std::string_view binary_map_magic = "L3TM";
+
+template <class Int> Int load_le(const uint8_t *in) {
+  Int v = 0;
+  for (std::size_t i = 0; i < sizeof(Int); ++i)
+    v |= static_cast<Int>(in[i]) << (8 * i);
+  return v;
+}
+
+bool is_binary_map(std::span<const uint8_t> body) {
+  return body.size() >= binary_map_magic.size() &&
+         std::equal(binary_map_magic.begin(), binary_map_magic.end(),
+                    body.begin());
+}
+
+std::optional<ClusterMap> parse_binary_map(std::span<const uint8_t> body) {
+  constexpr std::size_t header = 20, node_header = 8;
+  if (body.size() < header || body[4] != 1)
+    return std::nullopt;
+  ClusterMap map;
+  map.epoch = load_le<uint64_t>(&body[8]);
+  auto count = load_le<uint32_t>(&body[16]);
+  if (count > (body.size() - header) / node_header)
+    return std::nullopt;
+  map.nodes.reserve(count);
+  std::size_t at = header;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (body.size() - at < node_header)
+      return std::nullopt;
+    auto id = load_le<uint32_t>(&body[at]);
+    auto port = load_le<uint16_t>(&body[at + 4]);
+    auto host_len = load_le<uint16_t>(&body[at + 6]);
+    at += node_header;
+    if (body.size() - at < host_len)
+      return std::nullopt;
+    map.nodes.push_back(
+        {id, std::string(reinterpret_cast<const char *>(&body[at]), host_len),
+         port});
+    at += host_len;
+  }
+  return map;
+}
+
+// {"epoch": N, "peers": [{"id", "host", "http_port"}, ...]}; epoch is
+// optional. Throws on malformed JSON.
+ClusterMap parse_json_map(std::span<const uint8_t> body) {
+  json j = json::parse(body.begin(), body.end());
+  ClusterMap map;
+  map.epoch = j.value("epoch", uint64_t{0});
+  if (j.contains("peers") && j["peers"].is_array()) {
+    map.nodes.reserve(j["peers"].size());
+    for (auto &p : j["peers"])
+      map.nodes.push_back({p.value("id", 0u), p.value("host", "127.0.0.1"),
+                           p.value("http_port", 8080)});
+  }
+  return map;
+}
+
+// What a hedged attempt, which may outlive the call, holds of its key.
+template <typename Key> struct OwnedKey {
+  using type = std::string;
+};
+template <> struct OwnedKey<KeyRef> {
+  using type = KeyRef;
+};
+
+} // namespace
+
+SmartClient::SmartClient(std::string_view seed_host, int seed_port,
+                         ClientOptions options, ReplicaOptions replicas,
+                         NearCacheOptions near_cache,
+                         WriteBehindOptions write_behind)
+    : seed_host_(seed_host), seed_port_(seed_port), options_(options),
+      replicas_(replicas), read_latency_(std::make_shared<ReadLatency>()),
+      workers_(std::make_shared<WorkerPool>(max_worker_threads)),
+      near_cache_(near_cache.max_bytes
+                      ? std::make_unique<NearCache>(near_cache)
+                      : nullptr),
+      endpoints_(Client::make_endpoint_cache(options, nullptr)),
+      routing_(std::make_shared<RoutingSnapshot>()),
+      instance_id_(next_instance_id.fetch_add(1)) {
+  if (write_behind.window.count() > 0)
+    write_behind_ = std::make_unique<WriteBehind>(*this, write_behind);
+}
+
+SmartClient::SmartClient(net::io_context &ioc, std::string_view seed_host,
+                         int seed_port, ClientOptions options,
+                         ReplicaOptions replicas, NearCacheOptions near_cache,
+                         WriteBehindOptions write_behind)
+    : seed_host_(seed_host), seed_port_(seed_port), options_(options),
+      replicas_(replicas), read_latency_(std::make_shared<ReadLatency>()),
+      workers_(std::make_shared<WorkerPool>(max_worker_threads)),
+      near_cache_(near_cache.max_bytes
+                      ? std::make_unique<NearCache>(near_cache)
+                      : nullptr),
+      ioc_(&ioc), endpoints_(Client::make_endpoint_cache(options, &ioc)),
+      routing_(std::make_shared<RoutingSnapshot>()),
+      instance_id_(next_instance_id.fetch_add(1)) {
+  if (write_behind.window.count() > 0)
+    write_behind_ = std::make_unique<WriteBehind>(*this, write_behind);
+}
+
+SmartClient::~SmartClient() {
+  write_behind_.reset(); // Flushes while routing still works
+  {
+    std::lock_guard lock(refresher_mutex_);
+    refresher_stop_ = true;
+  }
+  refresher_cv_.notify_all();
+  if (refresher_.joinable())
+    refresher_.join();
+  // Node requests still running may report redirects to on_redirect().
+  workers_->shutdown();
+
+  // Released after the lock: closing connections takes a while.
+  std::vector<std::shared_ptr<RoutingSnapshot>> cached;
+  std::lock_guard lock(ThreadRoutes::mutex());
+  for (auto *routes : ThreadRoutes::all())
+    if (routes->instance.load(std::memory_order_relaxed) == instance_id_) {
+      cached.push_back(std::move(routes->snap));
+      routes->instance.store(0, std::memory_order_relaxed);
+    }
+}
 
 Result<void> SmartClient::connect() {
-  std::unique_lock lock(mutex_);
-  return refresh_topology_unsafe();
+  if (replicas_.replication_factor > known_replicas)
+    log(LogLevel::Warning,
+        "SmartClient: replication_factor " +
+            std::to_string(replicas_.replication_factor) +
+            " ignored; the cluster map does not name replica sets, so reads "
+            "go to the owner");
+  return refresh_topology();
+}
+
+void SmartClient::start_background_refresh(std::chrono::milliseconds interval,
+                                           std::chrono::milliseconds min_gap) {
+  if (refresher_.joinable())
+    return;
+  refresher_ = std::thread([this, interval, min_gap] {
+    refresh_loop(interval, min_gap);
+  });
+}
+
+void SmartClient::request_refresh() {
+  {
+    std::lock_guard lock(refresher_mutex_);
+    if (!refresher_.joinable() || refresh_requested_)
+      return;
+    refresh_requested_ = true;
+  }
+  refresher_cv_.notify_all();
+}
+
+void SmartClient::refresh_loop(std::chrono::milliseconds interval,
+                               std::chrono::milliseconds min_gap) {
+  std::unique_lock lock(refresher_mutex_);
+  auto woken = [this] { return refresher_stop_ || refresh_requested_; };
+  while (!refresher_stop_) {
+    if (interval.count() > 0)
+      refresher_cv_.wait_for(lock, interval, woken);
+    else
+      refresher_cv_.wait(lock, woken);
+    if (refresher_stop_)
+      break;
+    refresh_requested_ = false;
+
+    lock.unlock();
+    refresh_topology();
+    lock.lock();
+
+    // Debounce: a burst of errors from every thread costs one fetch.
+    refresher_cv_.wait_for(lock, min_gap, [this] { return refresher_stop_; });
+  }
+}
+
+void SmartClient::set_logger(Logger logger) { logger_ = std::move(logger); }
+
+void SmartClient::log(LogLevel level, std::string_view message) const {
+  if (logger_)
+    logger_(level, message);
+}
+
+uint64_t SmartClient::topology_epoch() const {
+  return routing_.load(std::memory_order_acquire)->epoch;
 }
 
-Result<void> SmartClient::refresh_topology_unsafe() {
-  // Connect to seed
+// Fetches and parses the map off to the side, then publishes the new
+// snapshot with one atomic store. Readers keep routing on the old snapshot
+// until then. The ring is only touched for nodes that joined or left.
+Result<void> SmartClient::refresh_topology() {
+  std::lock_guard refresh(refresh_mutex_);
   try {
-    Client seed(seed_host_, seed_port_);
-
-    // We need a way to do a raw GET request that isn't key-value based.
-    // The current Client interface exposes put/get/del for KV only.
-    // However, we can use the 'get' method with a special key if we hack it,
-    // OR we add a proper raw method to Client.
-    // HACK: The client::get appends "/kv/" to key.
-    // We need "/cluster/map".
-    // Let's rely on the implementation detail that we can path traverse?
-    // "/kv/../cluster/map" -> "/cluster/map" ?
-    // If server normalizes, maybe.
-
-    // BETTER: Add `Client::raw_get(path)` ?
-    // OR: Inherit Client logic.
-
-    // Let's assume we can add raw_get to Client later. For now, let's use the
-    // hack "ignore the prefix" if we can, but we can't easily. Since I am
-    // editing liblite3client anyway, I will add `raw_get` to Client.
-
-    // Wait, I can't invoke `refresh_topology_unsafe` without that change.
-    // I'll proceed assuming I adding `raw_get` to `Client` in the next step.
-
-    auto res = seed.impl_raw_get("/cluster/map"); // Need to expose this
-    if (!res)
+    // Connect to seed
+    Client seed(endpoints_, seed_host_, seed_port_);
+    auto res = seed.tagged_raw_get(binary_map_declined_
+                                       ? "/cluster/map"
+                                       : "/cluster/map?format=binary",
+                                   map_etag_, {});
+    if (!res && !binary_map_declined_ &&
+        (res.error().code == ErrorCode::BadRequest ||
+         res.error().code == ErrorCode::NotFound)) {
+      binary_map_declined_ = true;
+      res = seed.tagged_raw_get("/cluster/map", map_etag_, {});
+    }
+    if (!res) {
+      log(LogLevel::Warning,
+          "SmartClient: cluster map fetch failed: " + res.error().message);
       return res.error();
+    }
+    if (res->not_modified)
+      return Result<void>();
+
+    std::optional<ClusterMap> map;
+    if (is_binary_map(res->body))
+      map = parse_binary_map(res->body);
+    else
+      map = parse_json_map(res->body);
+    if (!map) {
+      log(LogLevel::Warning, "SmartClient: malformed binary cluster map");
+      return Error{ErrorCode::SerializationError,
+                   "Malformed binary cluster map"};
+    }
+
+    auto old = routing_.load(std::memory_order_acquire);
+    if (map->epoch != 0 && map->epoch == old->epoch) {
+      map_etag_ = std::move(res->etag);
+      return Result<void>();
+    }
+
+    // Nodes whose ID and endpoint are unchanged keep their existing Client.
+    auto next = std::make_shared<RoutingSnapshot>();
+    next->epoch = map->epoch;
+    std::map<uint32_t, Replica> nodes; // Sorted by ID
+    std::vector<WarmTarget> added;
+
+    for (auto &node : map->nodes) {
+      if (node.id == 0)
+        continue;
+      std::string endpoint = node.host + ":" + std::to_string(node.port);
+      std::size_t known = old->nodes.size();
+      auto it = old->endpoint_ids.find(endpoint);
+      if (it != old->endpoint_ids.end() && it->second == node.id)
+        known = old->slot_of(node.id);
+      if (known != old->nodes.size()) {
+        nodes[node.id] = {old->nodes[known], old->load[known]};
+      } else {
+        nodes[node.id] = {make_node_client(node.host, node.port),
+                          std::make_shared<NodeLoad>()};
+        added.push_back({node.id, endpoint, nodes[node.id].client.get()});
+        log(LogLevel::Info, "SmartClient: added node " +
+                                std::to_string(node.id) + " (" + endpoint +
+                                ")");
+      }
+      next->endpoint_ids[std::move(endpoint)] = node.id;
+    }
+
+    // New nodes connect before the snapshot routes anything to them.
+    if (options_.warmup.on_connect) {
+      std::sort(added.begin(), added.end(),
+                [](const auto &a, const auto &b) { return a.id < b.id; });
+      auto failed = warm(added, {});
+      std::lock_guard lock(unreachable_mutex_);
+      unreachable_ = std::move(failed);
+    }
 
-    auto body = res.value();
-    std::string json_str(body.begin(), body.end());
-    json j = json::parse(json_str);
-
-    // Rebuild ring
-    ring_ = lite3::ConsistentHash();
-    clients_.clear();
-
-    if (j.contains("peers") && j["peers"].is_array()) {
-      for (auto &p : j["peers"]) {
-        uint32_t id = p.value("id", 0u);
-        std::string host = p.value("host", "127.0.0.1");
-        int port = p.value("http_port", 8080);
-
-        if (id != 0) {
-          ring_.add_node(id);
-          clients_[id] = std::make_shared<Client>(host, port);
-          std::cout << "SmartClient: Added node " << id << " (" << host << ":"
-                    << port << ")\n";
+    next->ids.reserve(nodes.size());
+    next->nodes.reserve(nodes.size());
+    next->load.reserve(nodes.size());
+    for (auto &[id, node] : nodes) {
+      next->ids.push_back(id);
+      next->nodes.push_back(std::move(node.client));
+      next->load.push_back(std::move(node.load));
+    }
+
+    // Both ID lists are sorted, so one merge finds who joined and left.
+    if (next->ids == old->ids) {
+      next->ring = old->ring;
+    } else {
+      auto ring = std::make_shared<lite3::ConsistentHash>(*old->ring);
+      auto was = old->ids.begin(), is = next->ids.begin();
+      while (was != old->ids.end() || is != next->ids.end()) {
+        if (is == next->ids.end() || (was != old->ids.end() && *was < *is)) {
+          ring->remove_node(*was);
+          log(LogLevel::Info,
+              "SmartClient: removed node " + std::to_string(*was));
+          ++was;
+        } else if (was == old->ids.end() || *is < *was) {
+          ring->add_node(*is++);
+        } else {
+          ++was, ++is;
         }
       }
+      next->ring = std::move(ring);
     }
+
+    routing_.store(std::move(next), std::memory_order_release);
+    routing_version_.fetch_add(1, std::memory_order_release);
+    map_etag_ = std::move(res->etag);
+    // Pools of nodes that left close once no snapshot refers to them.
+    old.reset();
+    Client::prune_endpoint_cache(*endpoints_);
     return Result<void>();
   } catch (const std::exception &e) {
+    log(LogLevel::Warning,
+        std::string("SmartClient: cluster map refresh failed: ") + e.what());
     return Error{ErrorCode::NetworkError, e.what()};
   }
 }
 
+std::vector<UnreachableNode> SmartClient::warm_up(Deadline deadline) {
+  auto snap = routing_.load(std::memory_order_acquire);
+  std::vector<WarmTarget> targets;
+  for (const auto &[endpoint, id] : snap->endpoint_ids)
+    targets.push_back({id, endpoint, snap->nodes[snap->slot_of(id)].get()});
+  std::sort(targets.begin(), targets.end(),
+            [](const auto &a, const auto &b) { return a.id < b.id; });
+  auto failed = warm(targets, deadline);
+  std::lock_guard lock(unreachable_mutex_);
+  unreachable_ = failed;
+  return failed;
+}
+
+std::vector<UnreachableNode> SmartClient::unreachable_nodes() const {
+  std::lock_guard lock(unreachable_mutex_);
+  return unreachable_;
+}
+
+// Workers claim targets in order, so at most max_parallel handshakes are in
+// flight at once.
+std::vector<UnreachableNode>
+SmartClient::warm(std::span<const WarmTarget> targets, Deadline deadline) {
+  std::vector<std::optional<Error>> errors(targets.size());
+  if (!targets.empty()) {
+    std::atomic<std::size_t> next{0};
+    auto worker = [&] {
+      for (std::size_t i; (i = next.fetch_add(1)) < targets.size();) {
+        auto res = targets[i].client->warm_up(deadline);
+        if (!res)
+          errors[i] = res.error();
+      }
+    };
+    auto threads = std::clamp<std::size_t>(options_.warmup.max_parallel, 1,
+                                           targets.size());
+    std::vector<std::future<void>> pending;
+    for (std::size_t t = 1; t < threads; ++t)
+      pending.push_back(std::async(std::launch::async, worker));
+    worker();
+    for (auto &f : pending)
+      f.get();
+  }
+
+  std::vector<UnreachableNode> failed;
+  for (std::size_t i = 0; i < targets.size(); ++i)
+    if (errors[i])
+      failed.push_back(
+          {targets[i].id, targets[i].endpoint, std::move(*errors[i])});
+  return failed;
+}
+
+// Connection-level failures usually mean the topology moved.
+template <typename T> Result<T> SmartClient::observe(Result<T> res) {
+  if (!res && connection_failed(res.error()))
+    request_refresh();
+  return res;
+}
+
+std::shared_ptr<Client> SmartClient::make_node_client(const std::string &host,
+                                                      int port) {
+  std::shared_ptr<Client> client(new Client(endpoints_, host, port));
+  client->set_redirect_observer(
+      [this](std::string_view target, std::string_view to_host, int to_port) {
+        on_redirect(target, to_host, to_port);
+      });
+  return client;
+}
+
+// A 307 means our ring disagrees with the server about who owns the key,
+// so it asks for a refresh (debounced by min_gap), and until that lands
+// the owner it named is remembered so the next request for the key skips
+// the extra hop. The hint goes into the current snapshot's table in place: no
+// copy, and thread caches and KeyRef routes stay valid.
+void SmartClient::on_redirect(std::string_view target, std::string_view host,
+                              int port) {
+  constexpr std::string_view prefix = "/kv/";
+  if (target.substr(0, prefix.size()) != prefix)
+    return;
+  auto key = target.substr(prefix.size());
+  key = key.substr(0, key.find('?'));
+
+  std::string endpoint(host);
+  endpoint += ':';
+  endpoint += std::to_string(port);
+
+  request_refresh();
+  // A hint racing a refresh lands in the snapshot being replaced, whose
+  // new map makes it moot.
+  auto snap = routing_.load(std::memory_order_acquire);
+  auto it = snap->endpoint_ids.find(endpoint);
+  if (it == snap->endpoint_ids.end())
+    return; // Not a node we know; only the new map can help
+  snap->hint(key, snap->slot_of(it->second));
+}
+
+// Each thread caches the published snapshot and only reloads it when the
+// version moves, so steady-state routing does no atomic read-modify-write on
+// a shared cache line. The reference stays valid until this thread's next
+// call, so callers must not hold it across a request.
+SmartClient::RoutingSnapshot &SmartClient::snapshot() {
+  thread_local ThreadRoutes cached;
+
+  const uint64_t version = routing_version_.load(std::memory_order_acquire);
+  if (cached.instance.load(std::memory_order_relaxed) != instance_id_ ||
+      cached.version != version) {
+    auto snap = routing_.load(std::memory_order_acquire);
+    std::lock_guard lock(ThreadRoutes::mutex());
+    cached.snap.swap(snap); // The old one is released after the lock
+    cached.instance.store(instance_id_, std::memory_order_relaxed);
+    cached.version = version;
+  }
+  return *cached.snap;
+}
+
 std::shared_ptr<Client> SmartClient::get_client_for_key(std::string_view key) {
-  std::shared_lock lock(mutex_);
-  uint32_t node = ring_.get_node(key);
-  auto it = clients_.find(node);
-  if (it != clients_.end())
-    return it->second;
+  auto &snap = snapshot();
+  auto slot = route_slot(snap, key);
+  if (slot == snap.nodes.size())
+    return nullptr;
+  return snap.nodes[slot];
+}
+
+std::shared_ptr<Client> SmartClient::get_client_for_key(const KeyRef &key) {
+  auto &snap = snapshot();
+  auto slot = route_slot(snap, key);
+  if (slot == snap.nodes.size())
+    return nullptr;
+  return snap.nodes[slot];
+}
+
+// Dense node slot for `key`, or nodes.size() when there are no nodes.
+std::size_t SmartClient::route_slot(RoutingSnapshot &snap,
+                                    std::string_view key) {
+  auto slot = snap.hint_of(key);
+  return slot != snap.nodes.size() ? slot : snap.owner_of(key);
+}
+
+// The cached ring owner while `snap` is the one it was computed under.
+// Hints come and go within a snapshot, so they are looked up first.
+std::size_t SmartClient::route_slot(RoutingSnapshot &snap, const KeyRef &key) {
+  if (auto slot = snap.hint_of(key.key()); slot != snap.nodes.size())
+    return slot;
+  constexpr uint64_t slot_bits = 16, slot_mask = (1u << slot_bits) - 1;
+  const auto cached = key.route_.load(std::memory_order_relaxed);
+  if (cached >> slot_bits == snap.stamp &&
+      (cached & slot_mask) < snap.nodes.size())
+    return cached & slot_mask;
+
+  auto slot = snap.owner_of(key.key());
+  if (slot < slot_mask)
+    key.route_.store(snap.stamp << slot_bits | slot,
+                     std::memory_order_relaxed);
+  return slot;
+}
+
+// Fills `out` with the key's replicas, best first, and returns how many.
+// The owner wins ties, so an idle cluster reads from owners.
+std::size_t SmartClient::replicas_for(std::string_view key,
+                                      std::span<Replica> out) {
+  auto &snap = snapshot();
+  return replicas_from(snap, route_slot(snap, key), out);
+}
+
+std::size_t SmartClient::replicas_for(const KeyRef &key,
+                                      std::span<Replica> out) {
+  auto &snap = snapshot();
+  return replicas_from(snap, route_slot(snap, key), out);
+}
+
+std::size_t SmartClient::replicas_from(RoutingSnapshot &snap,
+                                       std::size_t owner,
+                                       std::span<Replica> out) {
+  if (owner == snap.nodes.size())
+    return 0;
 
-  // Fallback?
-  if (!clients_.empty())
-    return clients_.begin()->second;
-  return nullptr;
+  const auto n = std::max<std::size_t>(
+      1, std::min({replicas_.replication_factor, known_replicas,
+                   snap.nodes.size(), out.size()}));
+  std::array<uint64_t, max_replicas> score{};
+  for (std::size_t i = 0; i < n; ++i) {
+    auto slot = (owner + i) % snap.nodes.size();
+    out[i] = {snap.nodes[slot], snap.load[slot], i == 0};
+    // Nodes whose circuit is open go last: they would only fail fast.
+    score[i] = out[i].client->accepting() ? out[i].load->score()
+                                          : UINT64_MAX;
+  }
+  for (std::size_t i = 1; i < n; ++i) // Insertion sort; n is tiny
+    for (std::size_t j = i; j > 0 && score[j] < score[j - 1]; --j) {
+      std::swap(score[j], score[j - 1]);
+      std::swap(out[j], out[j - 1]);
+    }
+  return n;
+}
+
+std::chrono::microseconds SmartClient::hedge_delay() const {
+  if (replicas_.hedge_delay.count() > 0)
+    return replicas_.hedge_delay;
+  std::chrono::microseconds p95(read_latency_->percentile_us(0.95));
+  if (p95.count() == 0)
+    return p95; // Too few samples to judge what "slow" is yet
+  return std::max(p95, replicas_.min_hedge_delay);
+}
+
+template <typename T, typename Key, typename Op>
+Result<T> SmartClient::timed_read(const Replica &r, ReadLatency &latency,
+                                  const Key &key, Op &op) {
+  r.load->inflight.fetch_add(1, std::memory_order_relaxed);
+  auto start = std::chrono::steady_clock::now();
+  Result<T> res = op(*r.client, key);
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start)
+                .count();
+  r.load->inflight.fetch_sub(1, std::memory_order_relaxed);
+  // Connection failures say nothing about how fast the node answers.
+  if (res || !connection_failed(res.error())) {
+    r.load->record(static_cast<uint64_t>(us));
+    latency.record(static_cast<uint64_t>(us));
+  }
+  return res;
 }
 
-Result<void> SmartClient::put(std::string_view key, std::string_view value) {
+// Reads from the best replica, moving on to the next when one cannot be
+// reached or, not being the owner, does not have the key. With hedging on,
+// attempts run on the worker pool so the caller can stop waiting on a slow
+// one; losers finish in the background and their answers are dropped, and
+// losers still queued never start.
+template <typename T, typename Key, typename Op>
+Result<T> SmartClient::replicated_read(const Key &key, Op op) {
+  std::array<Replica, max_replicas> replicas;
+  const auto n = replicas_for(key, replicas);
+  if (n == 0)
+    return Error{ErrorCode::NetworkError, "No nodes available"};
+
+  const auto delay = replicas_.hedge_reads && n > 1
+                         ? hedge_delay()
+                         : std::chrono::microseconds(0);
+  if (delay.count() == 0) {
+    Result<T> res;
+    for (std::size_t i = 0; i < n; ++i) {
+      res = observe(timed_read<T>(replicas[i], *read_latency_, key, op));
+      if (res || final_error(res.error(), replicas[i].owner))
+        break;
+    }
+    return res;
+  }
+
+  struct Race {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::optional<Result<T>> answer; // First final result
+    std::optional<Result<T>> last_error;
+    std::size_t running = 0;
+  };
+  auto race = std::make_shared<Race>();
+  std::unique_lock lock(race->mutex);
+  // Posts unlocked: once the pool is shut down, the task runs right here.
+  auto launch = [&, owned_key =
+                        typename OwnedKey<Key>::type(key)](const Replica &r) {
+    ++race->running;
+    lock.unlock();
+    workers_->post([race, latency = read_latency_, r, owned_key,
+                    op](bool stopping) mutable {
+      std::optional<Result<T>> res;
+      if (stopping) {
+        res.emplace(Error{ErrorCode::NetworkError, "SmartClient destroyed"});
+      } else {
+        {
+          std::lock_guard lock(race->mutex);
+          if (race->answer) {
+            --race->running;
+            return;
+          }
+        }
+        res.emplace(timed_read<T>(r, *latency, owned_key, op));
+      }
+      std::lock_guard lock(race->mutex);
+      --race->running;
+      if (race->answer)
+        return;
+      if (*res || final_error(res->error(), r.owner))
+        race->answer.emplace(std::move(*res));
+      else
+        race->last_error.emplace(std::move(*res));
+      race->cv.notify_all();
+    });
+    lock.lock();
+  };
+
+  auto settled = [&] { return race->answer || race->running == 0; };
+  launch(replicas[0]);
+  std::size_t next = 1;
+  for (;;) {
+    if (next == 1) // Only the first follow-up is a timed hedge
+      race->cv.wait_for(lock, delay, settled);
+    else
+      race->cv.wait(lock, settled);
+    if (race->answer)
+      return observe(std::move(*race->answer));
+    if (next < n) { // Hedge timer fired, or every attempt so far failed
+      launch(replicas[next++]);
+      continue;
+    }
+    if (race->running == 0)
+      return observe(std::move(*race->last_error));
+  }
+}
+
+Result<void> SmartClient::put(std::string_view key, std::string_view value,
+                              Deadline deadline) {
+  if (write_behind_)
+    return write_behind_->put(key, value, deadline);
   auto client = get_client_for_key(key);
   if (!client)
     return Error{ErrorCode::NetworkError, "No nodes available"};
-  return client->put(key, value);
+  return observe(invalidated(key, client->put(key, value, deadline)));
 }
 
-Result<void> SmartClient::put(std::string_view key,
-                              const lite3cpp::Buffer &buf) {
+Result<void> SmartClient::put(std::string_view key, const lite3cpp::Buffer &buf,
+                              Deadline deadline) {
+  if (write_behind_)
+    return write_behind_->put(key, as_chars(buf), deadline);
   auto client = get_client_for_key(key);
   if (!client)
     return Error{ErrorCode::NetworkError, "No nodes available"};
-  return client->put(key, buf);
+  return observe(invalidated(key, client->put(key, buf, deadline)));
 }
 
-Result<lite3cpp::Buffer> SmartClient::get(std::string_view key) {
+Result<lite3cpp::Buffer> SmartClient::get(std::string_view key,
+                                          Deadline deadline) {
+  if (near_cache_)
+    return cached_get(key, deadline);
+  return replicated_read<lite3cpp::Buffer>(
+      key, [deadline](Client &c, std::string_view k) {
+        return c.get(k, deadline);
+      });
+}
+
+Result<lite3cpp::Buffer> SmartClient::cached_get(std::string_view key,
+                                                 Deadline deadline) {
+  auto hit = near_cache_->find(key);
+  if (hit.fresh)
+    return lite3cpp::Buffer(std::vector<uint8_t>(*hit.value));
+  auto res = replicated_read<Client::TaggedBody>(
+      key, [deadline, etag = hit.etag](Client &c, std::string_view k) {
+        return c.tagged_get(k, etag, deadline);
+      });
+  if (!res)
+    return res.error();
+  auto &tagged = res.value();
+  if (tagged.not_modified) {
+    near_cache_->revalidated(key, hit.epoch);
+    return lite3cpp::Buffer(std::vector<uint8_t>(*hit.value));
+  }
+  auto bytes =
+      std::make_shared<const std::vector<uint8_t>>(std::move(tagged.body));
+  near_cache_->fill(key, bytes, std::move(tagged.etag), hit.epoch);
+  return lite3cpp::Buffer(std::vector<uint8_t>(*bytes));
+}
+
+// Write paths invalidate after the server answered, failed or not: the
+// write may have applied either way.
+template <typename T>
+Result<T> SmartClient::invalidated(std::string_view key, Result<T> res) {
+  if (near_cache_)
+    near_cache_->invalidate(key);
+  return res;
+}
+
+// Writes that bypass the write-behind buffer send the key's buffered
+// writes first, so both land in call order; del just drops them. If the
+// buffered writes fail, so does the write that bypassed them, unsent.
+Result<void> SmartClient::settle(std::string_view key, bool discard) {
+  if (!write_behind_)
+    return Result<void>();
+  auto pending = write_behind_->take(key);
+  if (!pending || discard)
+    return Result<void>();
+  WriteBehind::Buffer one;
+  one.emplace(std::string(key), std::move(*pending));
+  return write_behind_->send(one);
+}
+
+Result<void> SmartClient::flush() {
+  if (!write_behind_)
+    return Result<void>();
+  return write_behind_->flush();
+}
+
+Result<PooledBuffer> SmartClient::get_pooled(std::string_view key,
+                                             Deadline deadline) {
+  return replicated_read<PooledBuffer>(
+      key, [deadline](Client &c, std::string_view k) {
+        return c.get_pooled(k, deadline);
+      });
+}
+
+Result<void> SmartClient::del(std::string_view key, Deadline deadline) {
+  settle(key, true);
   auto client = get_client_for_key(key);
   if (!client)
     return Error{ErrorCode::NetworkError, "No nodes available"};
-  return client->get(key);
+  return observe(invalidated(key, client->del(key, deadline)));
 }
 
-Result<void> SmartClient::del(std::string_view key) {
+Result<void> SmartClient::put(const KeyRef &key, std::string_view value,
+                              Deadline deadline) {
+  if (write_behind_)
+    return write_behind_->put(key.key(), value, deadline);
   auto client = get_client_for_key(key);
   if (!client)
     return Error{ErrorCode::NetworkError, "No nodes available"};
-  return client->del(key);
+  return observe(invalidated(key.key(), client->put(key, value, deadline)));
+}
+
+Result<void> SmartClient::put(const KeyRef &key, const lite3cpp::Buffer &buf,
+                              Deadline deadline) {
+  if (write_behind_)
+    return write_behind_->put(key.key(), as_chars(buf), deadline);
+  auto client = get_client_for_key(key);
+  if (!client)
+    return Error{ErrorCode::NetworkError, "No nodes available"};
+  return observe(invalidated(key.key(), client->put(key, buf, deadline)));
+}
+
+Result<lite3cpp::Buffer> SmartClient::get(const KeyRef &key,
+                                          Deadline deadline) {
+  if (near_cache_)
+    return cached_get(key.key(), deadline);
+  return replicated_read<lite3cpp::Buffer>(
+      key, [deadline](Client &c, const KeyRef &k) {
+        return c.get(k, deadline);
+      });
+}
+
+Result<PooledBuffer> SmartClient::get_pooled(const KeyRef &key,
+                                             Deadline deadline) {
+  return replicated_read<PooledBuffer>(
+      key, [deadline](Client &c, const KeyRef &k) {
+        return c.get_pooled(k, deadline);
+      });
+}
+
+Result<void> SmartClient::del(const KeyRef &key, Deadline deadline) {
+  settle(key.key(), true);
+  auto client = get_client_for_key(key);
+  if (!client)
+    return Error{ErrorCode::NetworkError, "No nodes available"};
+  return observe(invalidated(key.key(), client->del(key, deadline)));
 }
 
 Result<void> SmartClient::patch_int(std::string_view key,
-                                    std::string_view field, int64_t value) {
+                                    std::string_view field, int64_t value,
+                                    Deadline deadline) {
+  if (write_behind_)
+    return write_behind_->set_int(key, field, value, deadline);
   auto client = get_client_for_key(key);
   if (!client)
     return Error{ErrorCode::NetworkError, "No nodes available"};
-  return client->patch_int(key, field, value);
+  return observe(
+      invalidated(key, client->patch_int(key, field, value, deadline)));
 }
 
 Result<void> SmartClient::patch_str(std::string_view key,
                                     std::string_view field,
-                                    std::string_view value) {
+                                    std::string_view value,
+                                    Deadline deadline) {
+  if (auto settled = settle(key); !settled)
+    return settled;
   auto client = get_client_for_key(key);
   if (!client)
     return Error{ErrorCode::NetworkError, "No nodes available"};
-  return client->patch_str(key, field, value);
+  return observe(
+      invalidated(key, client->patch_str(key, field, value, deadline)));
+}
+
+Result<uint64_t> SmartClient::get_to(std::string_view key,
+                                     const ChunkSink &sink,
+                                     Deadline deadline) {
+  auto client = get_client_for_key(key);
+  if (!client)
+    return Error{ErrorCode::NetworkError, "No nodes available"};
+  return observe(client->get_to(key, sink, deadline));
+}
+
+Result<void> SmartClient::put_from(std::string_view key,
+                                   const ChunkSource &source, uint64_t size,
+                                   Deadline deadline) {
+  if (auto settled = settle(key); !settled)
+    return settled;
+  auto client = get_client_for_key(key);
+  if (!client)
+    return Error{ErrorCode::NetworkError, "No nodes available"};
+  return observe(
+      invalidated(key, client->put_from(key, source, size, deadline)));
+}
+
+Result<void> SmartClient::put_file(std::string_view key,
+                                   const std::string &path,
+                                   Deadline deadline) {
+  if (auto settled = settle(key); !settled)
+    return settled;
+  auto client = get_client_for_key(key);
+  if (!client)
+    return Error{ErrorCode::NetworkError, "No nodes available"};
+  return observe(invalidated(key, client->put_file(key, path, deadline)));
+}
+
+Result<FieldValue> SmartClient::get_field(std::string_view key,
+                                         std::string_view field,
+                                         Deadline deadline) {
+  return replicated_read<FieldValue>(
+      key, [deadline, field = std::string(field)](Client &c,
+                                                  std::string_view k) {
+        return c.get_field(k, field, deadline);
+      });
+}
+
+Result<std::vector<FieldValue>>
+SmartClient::get_fields(std::string_view key,
+                        std::span<const std::string_view> fields,
+                        Deadline deadline) {
+  // Hedged attempts may outlive the call, so they get their own copy.
+  std::vector<std::string> owned(fields.begin(), fields.end());
+  return replicated_read<std::vector<FieldValue>>(
+      key, [deadline, owned = std::move(owned)](Client &c,
+                                                std::string_view k) {
+        std::vector<std::string_view> names(owned.begin(), owned.end());
+        return c.get_fields(k, names, deadline);
+      });
+}
+
+Result<void> SmartClient::patch(std::string_view key, const PatchBatch &batch,
+                                Deadline deadline) {
+  if (auto settled = settle(key); !settled)
+    return settled;
+  auto client = get_client_for_key(key);
+  if (!client)
+    return Error{ErrorCode::NetworkError, "No nodes available"};
+  return observe(invalidated(key, client->patch(key, batch, deadline)));
+}
+
+// --- Batch Operations ---
+
+std::vector<Result<lite3cpp::Buffer>>
+SmartClient::run_batch(std::span<const PipelineOp> ops) {
+  struct NodeBatch {
+    std::shared_ptr<Client> client;
+    std::vector<PipelineOp> ops;
+    std::vector<std::size_t> index; // Position of each op in `ops`
+  };
+
+  std::vector<Result<lite3cpp::Buffer>> out(
+      ops.size(), Result<lite3cpp::Buffer>(
+                      Error{ErrorCode::NetworkError, "No nodes available"}));
+
+  // Group by owner against one snapshot for the whole batch.
+  std::vector<NodeBatch> batches;
+  auto &snap = snapshot();
+  std::vector<std::size_t> batch_of(snap.nodes.size(), ops.size());
+  for (std::size_t i = 0; i < ops.size(); ++i) {
+    auto slot = route_slot(snap, ops[i].key);
+    if (slot == snap.nodes.size())
+      continue;
+    if (batch_of[slot] == ops.size()) {
+      batch_of[slot] = batches.size();
+      batches.push_back({snap.nodes[slot], {}, {}});
+    }
+    batches[batch_of[slot]].ops.push_back(ops[i]);
+    batches[batch_of[slot]].index.push_back(i);
+  }
+  if (batches.empty())
+    return out;
+
+  // One node group runs on this thread, the rest on the worker pool.
+  workers_->run_all(batches.size(), [&](std::size_t b, bool stopping) {
+    auto &batch = batches[b];
+    if (stopping) {
+      for (auto i : batch.index)
+        out[i] = Error{ErrorCode::NetworkError, "SmartClient destroyed"};
+      return;
+    }
+    auto results = batch.client->pipeline(batch.ops);
+    for (std::size_t j = 0; j < results.size(); ++j)
+      out[batch.index[j]] = std::move(results[j]);
+  });
+  for (auto &res : out)
+    res = observe(std::move(res));
+  return out;
+}
+
+std::vector<Result<lite3cpp::Buffer>>
+SmartClient::multi_get(std::span<const std::string_view> keys) {
+  std::vector<PipelineOp> ops;
+  ops.reserve(keys.size());
+  for (auto key : keys)
+    ops.push_back(PipelineOp::get(key));
+  return run_batch(ops);
+}
+
+std::vector<Result<void>> SmartClient::multi_put(
+    std::span<const std::pair<std::string_view, std::string_view>> items) {
+  std::vector<Result<void>> out(items.size());
+  std::vector<PipelineOp> ops;
+  std::vector<std::size_t> index; // Position of each op in `items`
+  ops.reserve(items.size());
+  index.reserve(items.size());
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    const auto &[key, value] = items[i];
+    if (auto settled = settle(key); !settled) {
+      out[i] = settled;
+      continue;
+    }
+    ops.push_back(PipelineOp::put(key, value));
+    index.push_back(i);
+  }
+
+  auto results = run_batch(ops);
+  if (near_cache_)
+    for (const auto &[key, value] : items)
+      near_cache_->invalidate(key);
+  for (std::size_t j = 0; j < results.size(); ++j)
+    if (!results[j])
+      out[index[j]] = results[j].error();
+  return out;
+}
+
+// --- Scans ---
+
+// Shared by a KeyScan and its page fetches. Each fetch is one worker pool
+// task for one page of one node; a node whose page does not fit is parked
+// until next() makes room, so no pool thread ever waits on the caller.
+struct KeyScan::State {
+  std::mutex mutex;
+  std::condition_variable ready; // A page arrived or a node finished
+  std::deque<Result<std::vector<ScanEntry>>> pages;
+  std::size_t capacity = 1;        // Pages waiting, over all nodes
+  std::size_t running = 0;         // Nodes not done yet, parked or not
+  std::vector<std::size_t> parked; // Nodes waiting for room
+  bool cancelled = false;
+
+  // Set up by SmartClient::scan(), then only read.
+  std::weak_ptr<WorkerPool> workers; // Expires with the SmartClient
+  std::vector<std::shared_ptr<Client>> nodes;
+  std::function<std::size_t(std::string_view)> owner_of; // Null: keep all
+  std::string prefix;
+  ScanOptions options;
+  std::vector<std::string> after; // Per node; only its fetch touches it
+
+  static void post(const std::shared_ptr<State> &self, std::size_t slot) {
+    if (auto pool = self->workers.lock())
+      pool->post([self, slot](bool stopping) { fetch(self, slot, stopping); });
+    else
+      fetch(self, slot, true);
+  }
+
+  // Fetches the node's next page and queues the one after, unless the
+  // page did not fit. With `stopping` the node only reports that its
+  // SmartClient is gone.
+  static void fetch(const std::shared_ptr<State> &self, std::size_t slot,
+                    bool stopping) {
+    Result<std::vector<ScanEntry>> page =
+        Error{ErrorCode::NetworkError, "SmartClient destroyed"};
+    bool more = false;
+    if (!stopping) {
+      {
+        std::lock_guard lock(self->mutex);
+        if (self->cancelled)
+          return;
+      }
+      const auto &o = self->options;
+      page = self->nodes[slot]->scan_page(self->prefix, self->after[slot],
+                                          o.page_size, o.values);
+      more = page && page->size() == o.page_size;
+      if (page && !page->empty())
+        self->after[slot] = page->back().key;
+      if (page && self->owner_of)
+        std::erase_if(*page, [&](const ScanEntry &e) {
+          return self->owner_of(e.key) != slot;
+        });
+    }
+
+    std::unique_lock lock(self->mutex);
+    if (self->cancelled)
+      return;
+    if (!page || !page->empty())
+      self->pages.push_back(std::move(page));
+    if (!more) {
+      --self->running;
+    } else if (self->pages.size() >= self->capacity) {
+      self->parked.push_back(slot);
+      more = false;
+    }
+    lock.unlock();
+    self->ready.notify_all();
+    if (more)
+      post(self, slot);
+  }
+};
+
+KeyScan::KeyScan(std::shared_ptr<State> state) : state_(std::move(state)) {}
+
+KeyScan::KeyScan(KeyScan &&) noexcept = default;
+
+// The old scan is cancelled when `other` goes.
+KeyScan &KeyScan::operator=(KeyScan &&other) noexcept {
+  state_.swap(other.state_);
+  page_.swap(other.page_);
+  std::swap(pos_, other.pos_);
+  return *this;
+}
+
+// Fetches under way finish their request and drop the page; parked nodes
+// are never resumed.
+KeyScan::~KeyScan() {
+  if (!state_)
+    return;
+  std::lock_guard lock(state_->mutex);
+  state_->cancelled = true;
+}
+
+Result<std::optional<ScanEntry>> KeyScan::next() {
+  while (pos_ == page_.size()) {
+    if (!state_)
+      return std::optional<ScanEntry>();
+    std::unique_lock lock(state_->mutex);
+    state_->ready.wait(lock, [&] {
+      return !state_->pages.empty() || state_->running == 0;
+    });
+    if (state_->pages.empty())
+      return std::optional<ScanEntry>();
+    auto page = std::move(state_->pages.front());
+    state_->pages.pop_front();
+    std::vector<std::size_t> resume;
+    while (!state_->parked.empty() &&
+           state_->pages.size() + resume.size() < state_->capacity) {
+      resume.push_back(state_->parked.back());
+      state_->parked.pop_back();
+    }
+    lock.unlock();
+    for (auto slot : resume)
+      State::post(state_, slot);
+    if (!page)
+      return page.error();
+    page_ = std::move(page).value();
+    pos_ = 0;
+  }
+  return std::optional<ScanEntry>(std::move(page_[pos_++]));
+}
+
+// Pages every node of the current snapshot, which the scan keeps alive, on
+// the worker pool. A scan may outlive the SmartClient: ~SmartClient waits
+// for pages being fetched, and nodes not done by then report an error.
+KeyScan SmartClient::scan(std::string_view prefix, ScanOptions options) {
+  auto snap = routing_.load(std::memory_order_acquire);
+  auto state = std::make_shared<KeyScan::State>();
+  if (snap->nodes.empty()) {
+    state->pages.emplace_back(
+        Error{ErrorCode::NetworkError, "No nodes available"});
+    return KeyScan(std::move(state));
+  }
+
+  options.page_size = std::max<std::size_t>(1, options.page_size);
+  state->capacity =
+      std::max<std::size_t>(1, options.prefetch) * snap->nodes.size();
+  state->running = snap->nodes.size();
+  state->workers = workers_;
+  state->nodes = snap->nodes;
+  if (replicas_.replication_factor > 1 && snap->nodes.size() > 1)
+    state->owner_of = [snap](std::string_view key) {
+      return snap->owner_of(key);
+    };
+  state->prefix = prefix;
+  state->options = options;
+  state->after.resize(snap->nodes.size());
+  for (std::size_t slot = 0; slot < snap->nodes.size(); ++slot)
+    KeyScan::State::post(state, slot);
+  return KeyScan(std::move(state));
+}
+
+// --- Metrics ---
+
+ClientStats SmartClient::stats() const {
+  auto out = Client::endpoint_cache_stats(*endpoints_);
+  if (near_cache_)
+    out.near_cache = near_cache_->stats();
+  if (write_behind_)
+    out.write_behind = write_behind_->stats();
+  return out;
+}
+
+// --- Asynchronous Operations ---
+// Routing is the same as the blocking API. The shared_ptr keeps the node's
+// Client alive across suspension even if the topology is refreshed.
+
+net::awaitable<Result<void>> SmartClient::async_put(std::string_view key,
+                                                    std::string_view value) {
+  auto client = get_client_for_key(key);
+  if (!client)
+    co_return Error{ErrorCode::NetworkError, "No nodes available"};
+  co_return observe(invalidated(key, co_await client->async_put(key, value)));
+}
+
+net::awaitable<Result<void>>
+SmartClient::async_put(std::string_view key, const lite3cpp::Buffer &buf) {
+  auto client = get_client_for_key(key);
+  if (!client)
+    co_return Error{ErrorCode::NetworkError, "No nodes available"};
+  co_return observe(invalidated(key, co_await client->async_put(key, buf)));
+}
+
+// Replica choice and failover as for get(); not hedged.
+net::awaitable<Result<lite3cpp::Buffer>>
+SmartClient::async_get(std::string_view key) {
+  std::array<Replica, max_replicas> replicas;
+  const auto n = replicas_for(key, replicas);
+  if (n == 0)
+    co_return Error{ErrorCode::NetworkError, "No nodes available"};
+
+  Result<lite3cpp::Buffer> res;
+  for (std::size_t i = 0; i < n; ++i) {
+    auto &load = *replicas[i].load;
+    load.inflight.fetch_add(1, std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    res = observe(co_await replicas[i].client->async_get(key));
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+    load.inflight.fetch_sub(1, std::memory_order_relaxed);
+    if (res || !connection_failed(res.error())) {
+      load.record(static_cast<uint64_t>(us));
+      read_latency_->record(static_cast<uint64_t>(us));
+    }
+    if (res || final_error(res.error(), replicas[i].owner))
+      break;
+  }
+  co_return res;
+}
+
+net::awaitable<Result<void>> SmartClient::async_del(std::string_view key) {
+  auto client = get_client_for_key(key);
+  if (!client)
+    co_return Error{ErrorCode::NetworkError, "No nodes available"};
+  co_return observe(invalidated(key, co_await client->async_del(key)));
+}
+
+net::awaitable<Result<void>>
+SmartClient::async_patch_int(std::string_view key, std::string_view field,
+                             int64_t value) {
+  auto client = get_client_for_key(key);
+  if (!client)
+    co_return Error{ErrorCode::NetworkError, "No nodes available"};
+  auto res = co_await client->async_patch_int(key, field, value);
+  co_return observe(invalidated(key, std::move(res)));
+}
+
+net::awaitable<Result<void>>
+SmartClient::async_patch_str(std::string_view key, std::string_view field,
+                             std::string_view value) {
+  auto client = get_client_for_key(key);
+  if (!client)
+    co_return Error{ErrorCode::NetworkError, "No nodes available"};
+  auto res = co_await client->async_patch_str(key, field, value);
+  co_return observe(invalidated(key, std::move(res)));
+}
+
+// --- std::future Overloads ---
+
+namespace {
+
+net::awaitable<Result<void>> owned_put(SmartClient &c, std::string key,
+                                       std::string value) {
+  co_return co_await c.async_put(key, value);
+}
+
+net::awaitable<Result<void>> owned_put_buf(SmartClient &c, std::string key,
+                                           lite3cpp::Buffer buf) {
+  co_return co_await c.async_put(key, buf);
+}
+
+net::awaitable<Result<lite3cpp::Buffer>> owned_get(SmartClient &c,
+                                                   std::string key) {
+  co_return co_await c.async_get(key);
+}
+
+net::awaitable<Result<void>> owned_del(SmartClient &c, std::string key) {
+  co_return co_await c.async_del(key);
+}
+
+net::awaitable<Result<void>> owned_patch_int(SmartClient &c, std::string key,
+                                             std::string field,
+                                             int64_t value) {
+  co_return co_await c.async_patch_int(key, field, value);
+}
+
+net::awaitable<Result<void>> owned_patch_str(SmartClient &c, std::string key,
+                                             std::string field,
+                                             std::string value) {
+  co_return co_await c.async_patch_str(key, field, value);
+}
+
+// Without an io_context the node clients reject async calls, so the system
+// executor is only used to report that error through the future.
+net::any_io_executor spawn_executor(net::io_context *ioc) {
+  if (ioc)
+    return ioc->get_executor();
+  return net::system_executor();
+}
+
+} // namespace
+
+std::future<Result<void>> SmartClient::async_put(std::string_view key,
+                                                 std::string_view value,
+                                                 net::use_future_t<>) {
+  return net::co_spawn(spawn_executor(ioc_),
+                       owned_put(*this, std::string(key), std::string(value)),
+                       net::use_future);
+}
+
+std::future<Result<void>> SmartClient::async_put(std::string_view key,
+                                                 lite3cpp::Buffer buf,
+                                                 net::use_future_t<>) {
+  return net::co_spawn(spawn_executor(ioc_),
+                       owned_put_buf(*this, std::string(key), std::move(buf)),
+                       net::use_future);
+}
+
+std::future<Result<lite3cpp::Buffer>>
+SmartClient::async_get(std::string_view key, net::use_future_t<>) {
+  return net::co_spawn(spawn_executor(ioc_),
+                       owned_get(*this, std::string(key)), net::use_future);
+}
+
+std::future<Result<void>> SmartClient::async_del(std::string_view key,
+                                                 net::use_future_t<>) {
+  return net::co_spawn(spawn_executor(ioc_),
+                       owned_del(*this, std::string(key)), net::use_future);
+}
+
+std::future<Result<void>>
+SmartClient::async_patch_int(std::string_view key, std::string_view field,
+                             int64_t value, net::use_future_t<>) {
+  return net::co_spawn(
+      spawn_executor(ioc_),
+      owned_patch_int(*this, std::string(key), std::string(field), value),
+      net::use_future);
+}
+
+std::future<Result<void>>
+SmartClient::async_patch_str(std::string_view key, std::string_view field,
+                             std::string_view value, net::use_future_t<>) {
+  return net::co_spawn(spawn_executor(ioc_),
+                       owned_patch_str(*this, std::string(key),
+                                       std::string(field), std::string(value)),
+                       net::use_future);
 }
 
 } // namespace lite3
@@ -0,0 +1,854 @@
+// Behaviour tests of Client against in-process mock nodes (mock_node.hpp).
+// Standalone like client_test_simple: each test prints its name, the first
+// failed check exits non-zero.
+
+#include "lite3/smart_client.hpp"
+#include "mock_node.hpp"
+
+#ifdef LITE3CLIENT_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using mock::assert_true;
+using mock::eventually;
+
+mock::MockNode *start_node() {
+  auto *node = new mock::MockNode(); // Leaked, see MockNode
+  node->start(mock::json_map({node}));
+  return node;
+}
+
+mock::MockNode *start_binary_node() {
+  auto *node = start_node();
+  node->accept_binary();
+  return node;
+}
+
+lite3::Client binary_client(mock::MockNode *node) {
+  lite3::ClientOptions options;
+  options.protocol = lite3::Protocol::Binary;
+  return lite3::Client("127.0.0.1", node->port(), options);
+}
+
+// Upgrade requests, one per binary session.
+std::size_t upgrades(mock::MockNode *node) {
+  auto log = node->requests();
+  return std::count_if(log.begin(), log.end(), [](const auto &r) {
+    return r.target == "/kv";
+  });
+}
+
+std::string error_of(const lite3::Result<void> &res) {
+  return res ? std::string() : res.error().message;
+}
+
+// A default Deadline means "request_timeout from now", for warm-up as for
+// every other call, and a hostname has to be resolved first.
+void test_warm_up_hostname() {
+  std::cout << "[Test] Warm-up of a hostname endpoint" << std::endl;
+  auto *node = start_node();
+  lite3::ClientOptions options;
+  options.pool.min_connections = 2;
+  lite3::Client client("localhost", node->port(), options);
+  auto res = client.warm_up();
+  assert_true(bool(res), "warm_up failed: " +
+                             (res ? std::string() : res.error().message));
+  assert_true(eventually([&] { return node->connections() == 2; }),
+              "warm_up did not open 2 connections");
+  assert_true(bool(client.put("warm", "v")), "put after warm_up failed");
+  assert_true(node->connections() == 2, "put did not reuse a warm connection");
+}
+
+void test_smart_warm_up_on_connect() {
+  std::cout << "[Test] SmartClient warm-up on connect" << std::endl;
+  auto *node = new mock::MockNode();
+  node->start("{\"peers\":[{\"id\":1,\"host\":\"localhost\",\"http_port\":" +
+              std::to_string(node->port()) + "}]}");
+  lite3::ClientOptions options;
+  options.warmup.on_connect = true;
+  lite3::SmartClient smart("127.0.0.1", node->port(), options);
+  assert_true(bool(smart.connect()), "connect failed");
+  assert_true(smart.unreachable_nodes().empty(),
+              "a reachable node was reported unreachable");
+  assert_true(smart.warm_up().empty(), "warm_up() reported a failure");
+}
+
+// Expired addresses keep serving while they are looked up again in the
+// background; Clients may go away with a lookup still queued.
+void test_dns_refresh() {
+  std::cout << "[Test] Background DNS refresh" << std::endl;
+  auto *node = start_node();
+  lite3::ClientOptions options;
+  options.dns_ttl = std::chrono::milliseconds(1);
+  for (int round = 0; round < 20; ++round) {
+    lite3::Client client("localhost", node->port(), options);
+    for (int i = 0; i < 10; ++i) {
+      auto res = client.put("dns", "v");
+      assert_true(bool(res), "put with expiring addresses failed: " +
+                                 (res ? std::string() : res.error().message));
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+}
+
+// A server that drops the connection mid-window answers some requests;
+// pipeline() resends only the rest, on a new connection.
+void test_pipeline_resend() {
+  std::cout << "[Test] Pipeline resend after a mid-window close" << std::endl;
+  auto *node = start_node();
+  node->close_after(3);
+  lite3::ClientOptions options;
+  options.pool.pipeline_depth = 8;
+  lite3::Client client("127.0.0.1", node->port(), options);
+
+  std::vector<std::string> keys;
+  for (char tens = '0'; tens < '2'; ++tens)
+    for (char ones = '0'; ones <= '9'; ++ones)
+      keys.push_back({'p', '-', tens, ones}); // No key prefixes another
+  std::vector<lite3::PipelineOp> ops;
+  for (const auto &key : keys)
+    ops.push_back(lite3::PipelineOp::put(key, key));
+  auto results = client.pipeline(ops);
+  assert_true(results.size() == keys.size(), "pipeline lost results");
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    assert_true(bool(results[i]), "pipelined put failed: " + keys[i]);
+    assert_true(node->count(mock::http::verb::put, "/kv/" + keys[i]) == 1,
+                "an answered put was resent: " + keys[i]);
+    assert_true(node->value(keys[i]) == keys[i], "pipelined put was lost");
+  }
+  assert_true(node->connections() >= 7, "the server's closes were not seen");
+
+  ops.clear();
+  for (const auto &key : keys)
+    ops.push_back(lite3::PipelineOp::get(key));
+  results = client.pipeline(ops);
+  for (std::size_t i = 0; i < keys.size(); ++i)
+    assert_true(results[i] && results[i]->size() == keys[i].size(),
+                "pipelined get failed after a close: " + keys[i]);
+}
+
+// A 307 is followed only when its scheme matches the Client's TLS setting.
+void test_redirect_scheme() {
+  std::cout << "[Test] Redirect Location schemes" << std::endl;
+  auto *target = start_node();
+  auto *node = start_node();
+  const auto port = std::to_string(target->port());
+  node->set_hook([port](const mock::MockNode::Request &req,
+                        mock::MockNode::Response &res) {
+    res.result(mock::http::status::temporary_redirect);
+    auto scheme = req.target.starts_with("/kv/tls") ? "https" : "http";
+    res.set(mock::http::field::location,
+            std::string(scheme) + "://localhost:" + port + req.target);
+    return true;
+  });
+  lite3::Client client("127.0.0.1", node->port());
+  assert_true(bool(client.put("plain", "v")), "http:// redirect failed");
+  assert_true(target->value("plain") == "v", "redirect target missed put");
+  auto res = client.put("tls", "v");
+  assert_true(!res && res.error().message == "Invalid Redirect Location",
+              "https:// redirect followed without TLS");
+}
+
+// get, put and del go as frames over one upgraded connection.
+void test_binary_upgrade() {
+  std::cout << "[Test] Binary protocol upgrade" << std::endl;
+  auto *node = start_binary_node();
+  auto client = binary_client(node);
+  for (int i = 0; i < 3; ++i) {
+    auto res = client.put("bin", "v" + std::to_string(i));
+    assert_true(bool(res), "binary put failed: " + error_of(res));
+  }
+  auto got = client.get_pooled("bin");
+  assert_true(got && got->view() == "v2",
+              "binary get did not return the last put");
+  assert_true(bool(client.del("bin")), "binary del failed");
+  auto gone = client.get("bin");
+  assert_true(!gone && gone.error().code == lite3::ErrorCode::NotFound,
+              "NotFound status not reported as NotFound");
+  assert_true(upgrades(node) == 1, "binary session was not reused");
+  auto log = node->requests();
+  assert_true(std::count_if(log.begin(), log.end(),
+                            [](const auto &r) { return r.framed; }) == 6,
+              "requests after the upgrade were not all frames");
+}
+
+// A node that answers the upgrade with anything but 101 is served over
+// HTTP from then on, without being asked again.
+void test_binary_fallback() {
+  std::cout << "[Test] Binary protocol fallback to HTTP" << std::endl;
+  auto *node = start_node();
+  auto client = binary_client(node);
+  for (int i = 0; i < 3; ++i) {
+    auto res = client.put("fallback", "v");
+    assert_true(bool(res), "put after a declined upgrade failed: " +
+                               error_of(res));
+  }
+  auto got = client.get_pooled("fallback");
+  assert_true(got && got->view() == "v",
+              "get after a declined upgrade failed");
+  assert_true(upgrades(node) == 1, "declined upgrade was asked again");
+  assert_true(node->count(mock::http::verb::put, "/kv/fallback") == 3,
+              "puts did not fall back to HTTP");
+  auto log = node->requests();
+  assert_true(std::none_of(log.begin(), log.end(),
+                           [](const auto &r) { return r.framed; }),
+              "a frame reached a node that declined the upgrade");
+}
+
+// Responses carry the request ID, so a fast request is answered while a
+// slow one ahead of it on the same connection is still outstanding.
+void test_binary_out_of_order() {
+  std::cout << "[Test] Binary protocol out-of-order responses" << std::endl;
+  auto *node = start_binary_node();
+  node->store("slow", "s");
+  node->store("fast", "f");
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  node->set_hook([released](const mock::MockNode::Request &req,
+                            mock::MockNode::Response &) {
+    if (req.target == "/kv/slow")
+      released.wait_for(std::chrono::seconds(2));
+    return false;
+  });
+  auto client = binary_client(node);
+  std::atomic<bool> slow_done{false};
+  std::optional<lite3::Result<lite3::PooledBuffer>> slow;
+  std::thread slow_thread([&] {
+    slow.emplace(client.get_pooled("slow"));
+    slow_done = true;
+  });
+  assert_true(eventually([&] {
+                return node->count(mock::http::verb::get, "/kv/slow") == 1;
+              }),
+              "slow request never arrived");
+  auto fast = client.get_pooled("fast");
+  const bool overtook = !slow_done;
+  release.set_value();
+  slow_thread.join();
+  assert_true(fast && fast->view() == "f",
+              "fast get failed");
+  assert_true(overtook, "fast response waited for the slow one");
+  assert_true(*slow && (*slow)->view() == "s",
+              "slow get failed");
+  assert_true(upgrades(node) == 1, "requests used more than one session");
+}
+
+// Moved names the owner as "host:port"; it is followed like a 307.
+void test_binary_moved() {
+  std::cout << "[Test] Binary protocol Moved status" << std::endl;
+  auto *target = start_binary_node();
+  auto *node = start_binary_node();
+  const auto owner = "127.0.0.1:" + std::to_string(target->port());
+  node->set_hook([owner](const mock::MockNode::Request &req,
+                         mock::MockNode::Response &res) {
+    if (!req.framed)
+      return false;
+    res.result(mock::http::status::temporary_redirect);
+    const std::string to = req.target == "/kv/bad" ? "127.0.0.1" : owner;
+    res.body().assign(to.begin(), to.end());
+    return true;
+  });
+  auto client = binary_client(node);
+  auto res = client.put("moved", "v");
+  assert_true(bool(res), "put answered with Moved failed: " + error_of(res));
+  assert_true(target->value("moved") == "v", "Moved target missed the put");
+  assert_true(target->requests().back().framed,
+              "Moved was not followed over the binary protocol");
+  const auto stats = client.stats();
+  auto self = std::find_if(
+      stats.endpoints.begin(), stats.endpoints.end(), [&](const auto &e) {
+        return e.endpoint == "127.0.0.1:" + std::to_string(node->port());
+      });
+  assert_true(self != stats.endpoints.end() && self->redirects == 1,
+              "Moved was not counted as a redirect");
+  auto bad = client.put("bad", "v");
+  assert_true(!bad && bad.error().message == "Invalid Redirect Location",
+              "Moved without a port was followed");
+}
+
+// A response longer than HTTP would accept fails the session and whatever
+// is waiting on it; the next request gets a new session.
+void test_binary_frame_limit() {
+  std::cout << "[Test] Binary protocol frame size limit" << std::endl;
+  constexpr std::size_t limit = 8 * 1024 * 1024;
+  auto *node = start_binary_node();
+  node->store("edge", std::string(limit, 'e'));
+  node->store("big", std::string(limit + 1, 'b'));
+  auto client = binary_client(node);
+  auto edge = client.get("edge");
+  assert_true(edge && edge->size() == limit, "frame at the limit failed");
+  auto big = client.get("big");
+  assert_true(!big && big.error().code == lite3::ErrorCode::NetworkError,
+              "frame over the limit was accepted");
+  auto again = client.get("edge");
+  assert_true(again && again->size() == limit,
+              "get after an oversized frame failed");
+  assert_true(upgrades(node) == 2, "oversized frame did not end the session");
+}
+
+lite3::ClientOptions retrying(std::size_t attempts) {
+  lite3::ClientOptions options;
+  options.retry.max_attempts = attempts;
+  options.retry.base_backoff = std::chrono::milliseconds(1);
+  options.breaker.failure_threshold = 0;
+  return options;
+}
+
+// Unanswered requests are resent after a jittered backoff that is capped
+// by max_backoff, and never sleeps past the call's deadline.
+void test_retry_backoff() {
+  std::cout << "[Test] Retry backoff" << std::endl;
+  auto *node = start_node();
+  auto options = retrying(3);
+  options.retry.base_backoff = std::chrono::hours(1);
+  options.retry.max_backoff = std::chrono::milliseconds(1);
+  lite3::Client client("127.0.0.1", node->port(), options);
+  node->drop(2);
+  const auto start = std::chrono::steady_clock::now();
+  auto res = client.put("retry", "v");
+  assert_true(bool(res), "put was not retried: " + error_of(res));
+  assert_true(std::chrono::steady_clock::now() - start <
+                  std::chrono::seconds(5),
+              "backoff was not capped by max_backoff");
+  assert_true(node->count(mock::http::verb::put, "/kv/retry") == 3,
+              "put was not sent once per attempt");
+  assert_true(client.stats().endpoints.front().retries == 2,
+              "retries were not counted");
+
+  // A backoff of up to an hour does not fit a 200ms deadline.
+  options.retry.max_backoff = std::chrono::hours(1);
+  lite3::Client patient("127.0.0.1", node->port(), options);
+  node->clear_log();
+  node->drop(1);
+  auto late = patient.put("late", "v", std::chrono::steady_clock::now() +
+                                           std::chrono::milliseconds(200));
+  assert_true(!late && late.error().code == lite3::ErrorCode::NetworkError,
+              "retry slept past the deadline");
+  assert_true(node->count(mock::http::verb::put, "/kv/late") == 1,
+              "retry was sent past the deadline");
+}
+
+// Failed attempts spend a token each and answers refund budget_ratio of
+// one; retries stop while half the bucket or less is left.
+void test_retry_budget() {
+  std::cout << "[Test] Retry budget" << std::endl;
+  auto *node = start_node();
+  auto options = retrying(10);
+  options.retry.budget_tokens = 4;
+  options.retry.budget_ratio = 0.5;
+  lite3::Client client("127.0.0.1", node->port(), options);
+  node->drop(100);
+  assert_true(!client.put("spent", "v"), "dropped put succeeded");
+  assert_true(node->count(mock::http::verb::put, "/kv/spent") == 2,
+              "retries went on past the budget");
+  assert_true(!client.put("empty", "v"), "dropped put succeeded");
+  assert_true(node->count(mock::http::verb::put, "/kv/empty") == 1,
+              "an exhausted budget still allowed a retry");
+
+  node->drop(0);
+  for (int i = 0; i < 6; ++i)
+    assert_true(bool(client.put("refill", "v")), "put failed");
+  node->drop(1);
+  auto res = client.put("refilled", "v");
+  assert_true(bool(res), "answers did not refill the budget: " +
+                             error_of(res));
+  assert_true(node->count(mock::http::verb::put, "/kv/refilled") == 2,
+              "refilled budget did not allow one retry");
+}
+
+// A lost patch may have been applied, so it is resent only when
+// retry_patches says so.
+void test_no_retry_non_idempotent() {
+  std::cout << "[Test] Patches are not retried" << std::endl;
+  auto *node = start_node();
+  lite3::Client client("127.0.0.1", node->port(), retrying(3));
+  node->drop(1);
+  assert_true(!client.patch_int("counter", "n", 1), "dropped patch succeeded");
+  assert_true(node->count(mock::http::verb::post, "/kv/counter") == 1,
+              "a patch was retried");
+  auto res = client.put("counter", "v");
+  assert_true(bool(res), "put after a dropped patch failed: " +
+                             error_of(res));
+
+  auto options = retrying(3);
+  options.retry.retry_patches = true;
+  lite3::Client opted("127.0.0.1", node->port(), options);
+  node->clear_log();
+  node->drop(1);
+  res = opted.patch_int("counter", "n", 1);
+  assert_true(bool(res), "patch with retry_patches was not retried: " +
+                             error_of(res));
+  assert_true(node->count(mock::http::verb::post, "/kv/counter") == 2,
+              "patch with retry_patches was not resent once");
+}
+
+// Consecutive connect failures open the circuit, which fails calls without
+// connecting; after open_for one probe may connect, and its failure
+// reopens the circuit while its success closes it.
+void test_circuit_breaker() {
+  std::cout << "[Test] Circuit breaker" << std::endl;
+  unsigned short port;
+  {
+    mock::net::io_context ioc;
+    mock::tcp::acceptor probe(ioc, {mock::net::ip::make_address("127.0.0.1"),
+                                    0});
+    port = probe.local_endpoint().port(); // Refused once closed
+  }
+  lite3::ClientOptions options;
+  options.breaker.failure_threshold = 2;
+  options.breaker.open_for = std::chrono::milliseconds(300);
+  lite3::Client client("127.0.0.1", port, options);
+  auto open = [&] { return client.stats().endpoints.front().circuit_open; };
+  for (int i = 0; i < 2; ++i) {
+    auto res = client.put("cb", "v");
+    assert_true(!res && res.error().code ==
+                            lite3::ErrorCode::ConnectionRefused,
+                "connect to a closed port did not fail");
+  }
+  assert_true(open() && client.stats().endpoints.front().circuit_opens == 1,
+              "circuit did not open at the threshold");
+
+  auto fails_fast = [&] {
+    auto res = client.put("cb", "v");
+    return !res && res.error().message.find("Circuit open") !=
+                       std::string::npos;
+  };
+  assert_true(fails_fast(), "open circuit did not fail the call");
+
+  // Open for 150-300ms; the probe after it fails and reopens the circuit
+  // for twice as long.
+  std::this_thread::sleep_for(std::chrono::milliseconds(350));
+  auto probe = client.put("cb", "v");
+  assert_true(!probe && probe.error().code ==
+                            lite3::ErrorCode::ConnectionRefused,
+              "no probe was let through after open_for");
+  assert_true(open() && fails_fast(), "failed probe did not reopen");
+
+  auto *node = new mock::MockNode(port); // Leaked, see MockNode
+  node->start(mock::json_map({node}));
+  assert_true(fails_fast() && node->connections() == 0,
+              "open circuit still connected");
+  std::this_thread::sleep_for(std::chrono::milliseconds(650));
+  auto res = client.put("cb", "v");
+  assert_true(bool(res), "probe after the reopen failed: " + error_of(res));
+  assert_true(!open(), "successful probe did not close the circuit");
+  assert_true(client.stats().endpoints.front().circuit_opens == 1,
+              "a reopen was counted as a new opening");
+  assert_true(bool(client.put("cb", "w")), "put after the probe failed");
+}
+
+// --- Query Encoding ---
+
+// RFC 3986 percent-encoding, one byte at a time.
+std::string encoded(std::string_view s) {
+  static constexpr char hex[] = "0123456789ABCDEF";
+  std::string out;
+  for (unsigned char c : s) {
+    if (std::isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~') {
+      out += static_cast<char>(c);
+    } else {
+      out += '%';
+      out += hex[c >> 4];
+      out += hex[c & 15];
+    }
+  }
+  return out;
+}
+
+// Query values are percent-encoded whether the unreserved run ends inside
+// a 16-byte block, on its edge or in the scalar tail; values too long or
+// not printable ASCII go in a PatchBatch body instead.
+void test_query_encoding() {
+  std::cout << "[Test] Query value encoding" << std::endl;
+  auto *node = start_node();
+  lite3::Client client("127.0.0.1", node->port());
+  auto target = [&](std::string_view field, std::string_view value) {
+    auto res = client.patch_str("doc", field, value);
+    assert_true(bool(res), "patch_str failed: " + error_of(res));
+    return node->requests().back().target;
+  };
+  auto expect = [&](std::string_view field, std::string_view value,
+                    const std::string &query) {
+    const auto got = target(field, value);
+    assert_true(got == "/kv/doc?op=set_str&" + query,
+                "unexpected target " + got);
+  };
+
+  expect("f", "a&b=c d~e", "field=f&val=a%26b%3Dc%20d~e");
+  expect("f", "", "field=f&val=");
+  // Each byte around the unreserved ranges, inside one 16-byte block.
+  expect("f", "AZaz09-._~/,:@[`{",
+         "field=f&val=AZaz09-._~%2F%2C%3A%40%5B%60%7B");
+  expect("f", "0123456789abcdef&", "field=f&val=0123456789abcdef%26");
+  expect("f", "0123456789abcde&", "field=f&val=0123456789abcde%26");
+  const std::string tail = std::string(35, 'x') + " =~";
+  expect("f", tail, "field=f&val=" + encoded(tail));
+  const std::string field = "caf\xC3\xA9 name-over-sixteen-bytes";
+  expect(field, "v", "field=caf%C3%A9%20name-over-sixteen-bytes&val=v");
+
+  std::string longest;
+  while (longest.size() < 512)
+    longest += "k=v&sp ace~";
+  longest.resize(512);
+  expect("f", longest, "field=f&val=" + encoded(longest));
+
+  // Into a PatchBatch body: over 512 bytes, or outside printable ASCII.
+  for (const auto &value : {longest + "x", std::string("caf\xC3\xA9")}) {
+    assert_true(target("f", value) == "/kv/doc?op=patch",
+                "value unfit for a query was not sent as a PatchBatch");
+    assert_true(!node->requests().back().body.empty(),
+                "PatchBatch fallback sent no body");
+  }
+
+  const std::vector<std::string_view> names = {"a b", "x&y", "~z"};
+  (void)client.get_fields("doc", names);
+  assert_true(node->requests().back().target ==
+                  "/kv/doc?op=get_fields&fields=a%20b,x%26y,~z",
+              "field list was not encoded item by item");
+}
+
+// --- Batched Patches ---
+
+struct DecodedOp {
+  int kind;
+  std::string field;
+  int64_t number = 0; // SetInt, AddInt
+  std::string text;   // SetStr
+};
+
+// Decodes a PatchBatch body as the server does, failing on any byte out of
+// place.
+std::vector<DecodedOp> decode_patch(const std::vector<uint8_t> &body) {
+  std::size_t at = 0;
+  auto take = [&](std::size_t bytes) {
+    assert_true(at + bytes <= body.size(), "PatchBatch body truncated");
+    uint64_t v = 0;
+    for (std::size_t i = 0; i < bytes; ++i)
+      v |= uint64_t(body[at + i]) << (8 * i);
+    at += bytes;
+    return v;
+  };
+  auto take_bytes = [&](std::size_t n) {
+    assert_true(at + n <= body.size(), "PatchBatch body truncated");
+    std::string out(body.begin() + at, body.begin() + at + n);
+    at += n;
+    return out;
+  };
+  std::vector<DecodedOp> ops(take(4));
+  for (auto &op : ops) {
+    op.kind = static_cast<int>(take(1));
+    op.field = take_bytes(take(2));
+    if (op.kind == 2)
+      op.text = take_bytes(take(4));
+    else
+      op.number = static_cast<int64_t>(take(8));
+  }
+  assert_true(at == body.size(), "PatchBatch body has trailing bytes");
+  return ops;
+}
+
+// Client::patch() sends the batch as one POST whose body follows the
+// documented layout: counts, lengths and integers little-endian.
+void test_patch_batch_encoding() {
+  std::cout << "[Test] PatchBatch wire encoding" << std::endl;
+  auto *node = start_node();
+  lite3::Client client("127.0.0.1", node->port());
+  const std::string long_field(300, 'f'); // Length needs both u16 bytes
+  const std::string long_text(70000, 't'); // ... and three u32 bytes
+  lite3::PatchBatch batch;
+  batch.set_int("n", -2)
+      .set_str(long_field, long_text)
+      .add_int("delta", std::numeric_limits<int64_t>::min())
+      .set_str("empty", "");
+  for (int i = 0; i < 300; ++i) // Count needs both low bytes
+    batch.add_int("c" + std::to_string(i), i);
+  auto res = client.patch("doc", batch);
+  assert_true(bool(res), "patch failed: " + error_of(res));
+
+  const auto req = node->requests().back();
+  assert_true(req.method == mock::http::verb::post &&
+                  req.target == "/kv/doc?op=patch",
+              "patch was not one POST ?op=patch");
+  auto ops = decode_patch(req.body);
+  assert_true(ops.size() == 304, "op count mismatch");
+  assert_true(ops[0].kind == 1 && ops[0].field == "n" && ops[0].number == -2,
+              "set_int mis-encoded");
+  assert_true(ops[1].kind == 2 && ops[1].field == long_field &&
+                  ops[1].text == long_text,
+              "set_str mis-encoded");
+  assert_true(ops[2].kind == 3 && ops[2].field == "delta" &&
+                  ops[2].number == std::numeric_limits<int64_t>::min(),
+              "add_int mis-encoded");
+  assert_true(ops[3].kind == 2 && ops[3].field == "empty" &&
+                  ops[3].text.empty(),
+              "empty set_str mis-encoded");
+  for (int i = 0; i < 300; ++i)
+    assert_true(ops[4 + i].kind == 3 &&
+                    ops[4 + i].field == "c" + std::to_string(i) &&
+                    ops[4 + i].number == i,
+                "op order was not kept");
+
+  // Fields the u16 length cannot carry fail the batch before it is sent.
+  node->clear_log();
+  for (const auto &field : {std::string(), std::string(65536, 'f')}) {
+    lite3::PatchBatch bad;
+    bad.set_int("ok", 1).set_int(field, 1);
+    auto rejected = client.patch("doc", bad);
+    assert_true(!rejected &&
+                    rejected.error().code == lite3::ErrorCode::BadRequest,
+                "invalid field was not rejected");
+  }
+  assert_true(node->requests().empty(), "an invalid batch was sent");
+}
+
+// --- Compression ---
+
+#ifdef LITE3CLIENT_WITH_ZLIB
+
+// gzip, or a zlib stream, which names `dict` when one is given.
+std::vector<uint8_t> deflated(std::string_view in, bool gzip = true,
+                              std::string_view dict = {}) {
+  z_stream zs{};
+  deflateInit2(&zs, 6, Z_DEFLATED, gzip ? 15 + 16 : 15, 8,
+               Z_DEFAULT_STRATEGY);
+  if (!dict.empty())
+    deflateSetDictionary(&zs, reinterpret_cast<const Bytef *>(dict.data()),
+                         static_cast<uInt>(dict.size()));
+  std::vector<uint8_t> out(deflateBound(&zs, in.size()));
+  zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+  zs.avail_in = static_cast<uInt>(in.size());
+  zs.next_out = out.data();
+  zs.avail_out = static_cast<uInt>(out.size());
+  deflate(&zs, Z_FINISH);
+  out.resize(zs.total_out);
+  deflateEnd(&zs);
+  return out;
+}
+
+// Decodes gzip or zlib; nullopt if the stream is corrupt or needs a
+// dictionary other than `dict`.
+std::optional<std::string> inflated(const std::vector<uint8_t> &in,
+                                    std::string_view dict = {}) {
+  z_stream zs{};
+  inflateInit2(&zs, 15 + 32);
+  std::string out(1 << 20, '\0');
+  zs.next_in = const_cast<Bytef *>(in.data());
+  zs.avail_in = static_cast<uInt>(in.size());
+  zs.next_out = reinterpret_cast<Bytef *>(out.data());
+  zs.avail_out = static_cast<uInt>(out.size());
+  int rc = inflate(&zs, Z_FINISH);
+  if (rc == Z_NEED_DICT && !dict.empty() &&
+      inflateSetDictionary(&zs, reinterpret_cast<const Bytef *>(dict.data()),
+                           static_cast<uInt>(dict.size())) == Z_OK)
+    rc = inflate(&zs, Z_FINISH);
+  out.resize(zs.total_out);
+  inflateEnd(&zs);
+  if (rc != Z_STREAM_END)
+    return std::nullopt;
+  return out;
+}
+
+std::string repetitive(std::size_t size) {
+  std::string out;
+  while (out.size() < size)
+    out += "field=value;" + std::to_string(out.size() % 7) + ";";
+  out.resize(size);
+  return out;
+}
+
+lite3::ClientOptions compressing(std::size_t min_size) {
+  lite3::ClientOptions options;
+  options.compression.enabled = true;
+  options.compression.min_size = min_size;
+  return options;
+}
+
+// Bodies from min_size up go out gzip-encoded when that makes them
+// smaller; the rest go out as they are.
+void test_compressed_requests() {
+  std::cout << "[Test] Compressed requests" << std::endl;
+  auto *node = start_node();
+  lite3::Client client("127.0.0.1", node->port(), compressing(256));
+  auto sent = [&](std::string_view key) {
+    for (const auto &r : node->requests())
+      if (r.target == "/kv/" + std::string(key))
+        return r;
+    mock::fail(std::string(key) + " was not sent");
+    return mock::MockNode::Request{};
+  };
+
+  const auto big = repetitive(4096);
+  assert_true(bool(client.put("big", big)), "compressed put failed");
+  auto req = sent("big");
+  assert_true(req.headers[mock::http::field::content_encoding] == "gzip",
+              "large body was not gzip-encoded");
+  assert_true(req.body.size() < big.size() && inflated(req.body) == big,
+              "gzip body does not decode to the value");
+  assert_true(req.headers[mock::http::field::accept_encoding] ==
+                  "gzip, deflate",
+              "compressed request did not accept compressed responses");
+
+  const auto small = repetitive(255);
+  assert_true(bool(client.put("small", small)), "small put failed");
+  req = sent("small");
+  assert_true(req.headers.find(mock::http::field::content_encoding) ==
+                      req.headers.end() &&
+                  std::string(req.body.begin(), req.body.end()) == small,
+              "body under min_size was compressed");
+
+  std::string noise(4096, '\0');
+  uint32_t x = 1;
+  for (auto &c : noise) {
+    x = x * 1664525 + 1013904223;
+    c = static_cast<char>(x >> 24);
+  }
+  assert_true(bool(client.put("noise", noise)), "incompressible put failed");
+  req = sent("noise");
+  assert_true(req.headers.find(mock::http::field::content_encoding) ==
+                  req.headers.end(),
+              "body that did not shrink was sent compressed");
+
+  const auto stats = client.stats().endpoints.front();
+  assert_true(stats.compressed_raw_bytes == big.size() &&
+                  stats.compressed_wire_bytes == sent("big").body.size(),
+              "compression was not counted");
+}
+
+// Responses are decoded by their Content-Encoding: gzip and deflate (a
+// zlib stream), up to max_decompressed.
+void test_compressed_responses() {
+  std::cout << "[Test] Compressed responses" << std::endl;
+  auto *node = start_node();
+  const auto value = repetitive(8192);
+  node->set_hook([value](const mock::MockNode::Request &req,
+                         mock::MockNode::Response &res) {
+    if (req.method != mock::http::verb::get)
+      return false;
+    res.result(mock::http::status::ok);
+    if (req.target == "/kv/gzip") {
+      res.set(mock::http::field::content_encoding, "gzip");
+      res.body() = deflated(value);
+    } else if (req.target == "/kv/deflate") {
+      res.set(mock::http::field::content_encoding, "deflate");
+      res.body() = deflated(value, false);
+    } else {
+      res.set(mock::http::field::content_encoding, "gzip");
+      res.body().assign(value.begin(), value.end()); // Not gzip at all
+    }
+    return true;
+  });
+  auto options = compressing(1024);
+  lite3::Client client("127.0.0.1", node->port(), options);
+  for (const auto *key : {"gzip", "deflate"}) {
+    auto res = client.get_pooled(key);
+    assert_true(res && res->view() == value,
+                std::string(key) + " response was not decoded");
+  }
+  auto corrupt = client.get("corrupt");
+  assert_true(!corrupt && corrupt.error().code ==
+                              lite3::ErrorCode::SerializationError,
+              "corrupt gzip response was accepted");
+
+  options.compression.max_decompressed = value.size() - 1;
+  lite3::Client capped("127.0.0.1", node->port(), options);
+  auto over = capped.get("gzip");
+  assert_true(!over && over.error().code ==
+                           lite3::ErrorCode::SerializationError,
+              "response inflating past max_decompressed was accepted");
+}
+
+// With a preset dictionary, small values that resemble it compress, sent
+// as deflate naming the dictionary; responses may name it too.
+void test_compression_dictionary() {
+  std::cout << "[Test] Compression with a preset dictionary" << std::endl;
+  const std::string dict =
+      "{\"name\":\"\",\"email\":\"@example.com\",\"active\":true}";
+  const std::string value =
+      "{\"name\":\"ada\",\"email\":\"ada@example.com\",\"active\":true}";
+  auto *node = start_node();
+  node->set_hook([dict, value](const mock::MockNode::Request &req,
+                               mock::MockNode::Response &res) {
+    if (req.method != mock::http::verb::get)
+      return false;
+    res.result(mock::http::status::ok);
+    res.set(mock::http::field::content_encoding, "deflate");
+    res.body() = deflated(value, false, dict);
+    return true;
+  });
+  auto options = compressing(16);
+  options.compression.dictionary.assign(dict.begin(), dict.end());
+  lite3::Client client("127.0.0.1", node->port(), options);
+  assert_true(bool(client.put("doc", value)), "put with a dictionary failed");
+  const auto req = node->requests().back();
+  assert_true(req.headers[mock::http::field::content_encoding] == "deflate",
+              "body compressed with a dictionary was not sent as deflate");
+  assert_true(req.body.size() < value.size() &&
+                  inflated(req.body, dict) == value,
+              "deflate body does not decode with the dictionary");
+  assert_true(!inflated(req.body), "deflate body did not name a dictionary");
+
+  auto got = client.get_pooled("doc");
+  assert_true(got && got->view() == value,
+              "response naming the dictionary was not decoded");
+}
+
+#else
+
+// Without zlib a call asking for compression fails instead of sending raw.
+void test_compression_unavailable() {
+  std::cout << "[Test] Compression without zlib" << std::endl;
+  auto *node = start_node();
+  lite3::ClientOptions options;
+  options.compression.enabled = true;
+  lite3::Client client("127.0.0.1", node->port(), options);
+  auto res = client.put("raw", "v");
+  assert_true(!res && res.error().code == lite3::ErrorCode::BadRequest,
+              "compression without zlib did not fail the call");
+  assert_true(node->requests().empty(), "the call still reached the node");
+}
+
+#endif // LITE3CLIENT_WITH_ZLIB
+
+} // namespace
+
+int main() {
+  test_warm_up_hostname();
+  test_smart_warm_up_on_connect();
+  test_dns_refresh();
+  test_pipeline_resend();
+  test_redirect_scheme();
+  test_binary_upgrade();
+  test_binary_fallback();
+  test_binary_out_of_order();
+  test_binary_moved();
+  test_binary_frame_limit();
+  test_retry_backoff();
+  test_retry_budget();
+  test_no_retry_non_idempotent();
+  test_circuit_breaker();
+  test_query_encoding();
+  test_patch_batch_encoding();
+#ifdef LITE3CLIENT_WITH_ZLIB
+  test_compressed_requests();
+  test_compressed_responses();
+  test_compression_dictionary();
+#else
+  test_compression_unavailable();
+#endif
+  std::cout << "[PASS] All tests passed!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,485 @@
+// In-process lite3 node for the behaviour tests, grown from the bench's
+// MockNode: /kv/<key> GET/PUT/DELETE, POST ?op=... patches (logged, not
+// applied), ?op=scan pages, and /cluster/map in JSON and, when given, the
+// binary encoding. When told to, it also accepts the Protocol::Binary
+// upgrade and serves /kv frames. Every request is logged, and a hook can
+// answer any of them first. One detached thread per connection, so nodes
+// are never destroyed; they live until the process exits.
+
+#pragma once
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace mock {
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+
+inline void fail(const std::string &msg) {
+  std::cerr << "[FAIL] " << msg << std::endl;
+  std::exit(1);
+}
+
+inline void assert_true(bool cond, const std::string &msg) {
+  if (!cond)
+    fail(msg);
+}
+
+// The mock serves on its own threads, so its counters trail the client.
+template <typename Pred> bool eventually(Pred pred) {
+  for (int i = 0; i < 200 && !pred(); ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  return pred();
+}
+
+class MockNode {
+public:
+  struct Request {
+    http::verb method;
+    std::string target;
+    std::vector<uint8_t> body;
+    bool framed = false; // Arrived as a Protocol::Binary frame
+    http::fields headers = {}; // HTTP only
+  };
+  using Response = http::response<http::vector_body<uint8_t>>;
+  // Returns true when it answered the request itself.
+  using Hook = std::function<bool(const Request &, Response &)>;
+
+  // Zero: any free port.
+  explicit MockNode(unsigned short port = 0)
+      : acceptor_(ioc_, {net::ip::make_address("127.0.0.1"), port}) {}
+
+  int port() const { return acceptor_.local_endpoint().port(); }
+
+  // An empty `binary_map` answers ?format=binary with 404, as old seeds do.
+  void start(std::string cluster_map, std::string binary_map = {}) {
+    {
+      std::lock_guard lock(mutex_);
+      cluster_map_ = std::move(cluster_map);
+      binary_map_ = std::move(binary_map);
+    }
+    std::thread([this] { accept_loop(); }).detach();
+  }
+
+  void set_cluster_map(std::string cluster_map, std::string binary_map = {}) {
+    std::lock_guard lock(mutex_);
+    cluster_map_ = std::move(cluster_map);
+    binary_map_ = std::move(binary_map);
+  }
+
+  void set_hook(Hook hook) {
+    std::lock_guard lock(mutex_);
+    hook_ = std::move(hook);
+  }
+
+  // Answers "Upgrade: lite3-binary/1" with 101 and serves frames on the
+  // connection from then on; otherwise the upgrade gets a 404, as from a
+  // node that predates the protocol. Frame requests reach the hook and the
+  // store like HTTP ones; a 307 answers Moved, its body the "host:port".
+  void accept_binary() {
+    std::lock_guard lock(mutex_);
+    binary_ = true;
+  }
+
+  // Each connection is closed, without a Connection: close, after this
+  // many responses; requests already sent on it go unanswered. Zero:
+  // never.
+  void close_after(std::size_t responses) {
+    std::lock_guard lock(mutex_);
+    close_after_ = responses;
+  }
+
+  // The next `requests` are logged, then their connections closed without
+  // an answer, as by a node that crashed mid-request.
+  void drop(std::size_t requests) {
+    std::lock_guard lock(mutex_);
+    drop_ = requests;
+  }
+
+  void store(std::string_view key, std::string_view value) {
+    std::lock_guard lock(mutex_);
+    store_[std::string(key)].assign(value.begin(), value.end());
+  }
+
+  std::optional<std::string> value(std::string_view key) {
+    std::lock_guard lock(mutex_);
+    auto it = store_.find(std::string(key));
+    if (it == store_.end())
+      return std::nullopt;
+    return std::string(it->second.begin(), it->second.end());
+  }
+
+  std::vector<Request> requests() {
+    std::lock_guard lock(mutex_);
+    return log_;
+  }
+
+  // Logged requests with `method` whose target starts with `prefix`.
+  std::size_t count(http::verb method, std::string_view prefix) {
+    std::lock_guard lock(mutex_);
+    return std::count_if(log_.begin(), log_.end(), [&](const Request &r) {
+      return r.method == method && r.target.starts_with(prefix);
+    });
+  }
+
+  std::size_t connections() { // Accepted so far
+    std::lock_guard lock(mutex_);
+    return connections_;
+  }
+
+  std::size_t open_connections() {
+    std::lock_guard lock(mutex_);
+    return open_;
+  }
+
+  void clear_log() {
+    std::lock_guard lock(mutex_);
+    log_.clear();
+  }
+
+private:
+  void accept_loop() {
+    for (;;) {
+      tcp::socket socket(ioc_);
+      beast::error_code ec;
+      acceptor_.accept(socket, ec);
+      if (ec)
+        continue;
+      {
+        std::lock_guard lock(mutex_);
+        ++connections_;
+        ++open_;
+      }
+      std::thread([this, s = std::move(socket)]() mutable {
+        serve(std::move(s));
+        std::lock_guard lock(mutex_);
+        --open_;
+      }).detach();
+    }
+  }
+
+  void serve(tcp::socket socket) {
+    socket.set_option(tcp::no_delay(true));
+    beast::flat_buffer buffer;
+    beast::error_code ec;
+    for (std::size_t answered = 0;; ++answered) {
+      {
+        std::unique_lock lock(mutex_);
+        if (close_after_ && answered == close_after_) {
+          lock.unlock();
+          linger(socket);
+          return;
+        }
+      }
+      http::request_parser<http::vector_body<uint8_t>> parser;
+      parser.body_limit(64 * 1024 * 1024);
+      http::read(socket, buffer, parser, ec);
+      if (ec)
+        return;
+      auto req = parser.release();
+      {
+        std::lock_guard lock(mutex_);
+        if (drop_) {
+          --drop_;
+          log_.push_back({req.method(), std::string(req.target()),
+                          std::move(req.body())});
+          return;
+        }
+      }
+      if (req[http::field::upgrade] == "lite3-binary/1" && binary()) {
+        {
+          std::lock_guard lock(mutex_);
+          log_.push_back({req.method(), std::string(req.target()), {}});
+        }
+        Response res{http::status::switching_protocols, 11};
+        res.set(http::field::connection, "Upgrade");
+        res.set(http::field::upgrade, "lite3-binary/1");
+        http::write(socket, res, ec);
+        if (!ec)
+          serve_frames(std::move(socket), buffer);
+        return;
+      }
+
+      Response res;
+      res.version(11);
+      res.keep_alive(req.keep_alive());
+      handle({req.method(), std::string(req.target()), std::move(req.body()),
+              false, static_cast<const http::fields &>(req)},
+             res);
+      res.prepare_payload();
+      http::write(socket, res, ec);
+      if (ec || !res.keep_alive())
+        return;
+    }
+  }
+
+  bool binary() {
+    std::lock_guard lock(mutex_);
+    return binary_;
+  }
+
+  // Frames as described at BinaryStatus in client.cpp. Each request is
+  // answered on its own thread, so a hook that holds one up lets the ones
+  // behind it overtake it, as on a real node.
+  void serve_frames(tcp::socket socket, beast::flat_buffer &buffer) {
+    struct Writer {
+      explicit Writer(tcp::socket s) : socket(std::move(s)) {}
+      tcp::socket socket;
+      std::mutex mutex; // Whole frames only
+    };
+    auto writer = std::make_shared<Writer>(std::move(socket));
+    auto fill = [&](std::size_t n) {
+      while (buffer.size() < n)
+        buffer.commit(writer->socket.read_some(buffer.prepare(16 * 1024)));
+    };
+    auto load = [](const uint8_t *in, int bytes) {
+      uint32_t v = 0;
+      for (int i = bytes - 1; i >= 0; --i)
+        v = (v << 8) | in[i];
+      return v;
+    };
+    try {
+      for (;;) {
+        fill(12);
+        std::array<uint8_t, 12> header;
+        net::buffer_copy(net::buffer(header), buffer.data());
+        const uint32_t id = load(header.data(), 4);
+        const uint32_t key_size = load(header.data() + 6, 2);
+        const uint32_t value_size = load(header.data() + 8, 4);
+        fill(12 + key_size + value_size);
+        buffer.consume(12);
+        std::string key(key_size, '\0');
+        buffer.consume(net::buffer_copy(net::buffer(key), buffer.data()));
+        std::vector<uint8_t> value(value_size);
+        buffer.consume(net::buffer_copy(net::buffer(value), buffer.data()));
+
+        const http::verb method = header[4] == 1   ? http::verb::get
+                                  : header[4] == 2 ? http::verb::put
+                                  : header[4] == 3 ? http::verb::delete_
+                                                   : http::verb::unknown;
+        std::thread([this, writer, id, method, key = std::move(key),
+                     value = std::move(value)]() mutable {
+          Response res;
+          handle({method, "/kv/" + key, std::move(value), true}, res);
+          uint8_t status = 3; // ServerError
+          switch (res.result()) {
+          case http::status::ok: status = 0; break;
+          case http::status::not_found: status = 1; break;
+          case http::status::bad_request: status = 2; break;
+          case http::status::temporary_redirect: status = 4; break;
+          default: break;
+          }
+          std::array<uint8_t, 12> out{};
+          const auto size = static_cast<uint32_t>(res.body().size());
+          for (int i = 0; i < 4; ++i) {
+            out[i] = static_cast<uint8_t>(id >> (8 * i));
+            out[8 + i] = static_cast<uint8_t>(size >> (8 * i));
+          }
+          out[4] = status;
+          const std::array<net::const_buffer, 2> frame = {
+              net::buffer(out), net::buffer(res.body())};
+          std::lock_guard lock(writer->mutex);
+          beast::error_code ec;
+          net::write(writer->socket, frame, ec);
+        }).detach();
+      }
+    } catch (const std::exception &) {
+      // The client went away
+    }
+  }
+
+  // Closes like a server ending keep-alive: a bare close with unread
+  // requests would reset the connection and could drop the responses the
+  // client has not read yet.
+  static void linger(tcp::socket &socket) {
+    beast::error_code ec;
+    socket.shutdown(tcp::socket::shutdown_send, ec);
+    char sink[4096];
+    while (!ec)
+      socket.read_some(net::buffer(sink), ec);
+  }
+
+  void handle(Request req, Response &res) {
+    Hook hook;
+    {
+      std::lock_guard lock(mutex_);
+      log_.push_back(req);
+      hook = hook_;
+    }
+    if (hook && hook(req, res))
+      return;
+
+    std::lock_guard lock(mutex_);
+    if (req.target == "/cluster/map") {
+      res.result(http::status::ok);
+      res.body().assign(cluster_map_.begin(), cluster_map_.end());
+      return;
+    }
+    if (req.target == "/cluster/map?format=binary") {
+      res.result(binary_map_.empty() ? http::status::not_found
+                                     : http::status::ok);
+      res.body().assign(binary_map_.begin(), binary_map_.end());
+      return;
+    }
+    if (!req.target.starts_with("/kv/")) {
+      res.result(http::status::not_found);
+      return;
+    }
+    auto query = req.target.find('?');
+    auto key = req.target.substr(
+        4, query == std::string::npos ? query : query - 4);
+    auto params = parse_query(query == std::string::npos
+                                  ? std::string_view()
+                                  : std::string_view(req.target).substr(
+                                        query + 1));
+
+    switch (req.method) {
+    case http::verb::get: {
+      if (params.count("op") && params["op"] == "scan") {
+        scan(key, params, res);
+        break;
+      }
+      auto it = store_.find(key);
+      if (it == store_.end()) {
+        res.result(http::status::not_found);
+      } else {
+        res.result(http::status::ok);
+        res.body() = it->second;
+      }
+      break;
+    }
+    case http::verb::put:
+      store_[key] = std::move(req.body);
+      res.result(http::status::ok);
+      break;
+    case http::verb::post:
+      res.result(http::status::ok); // Patches are only logged
+      break;
+    case http::verb::delete_:
+      res.result(store_.erase(key) ? http::status::ok
+                                   : http::status::not_found);
+      break;
+    default:
+      res.result(http::status::bad_request);
+    }
+  }
+
+  // Keys after `after` starting with `prefix`, in key order: per entry a
+  // u32 length and the key, then with values=1 the same for the value.
+  void scan(const std::string &prefix,
+            std::map<std::string, std::string> &params, Response &res) {
+    std::size_t limit = 0;
+    auto &l = params["limit"];
+    std::from_chars(l.data(), l.data() + l.size(), limit);
+    const bool values = params["values"] == "1";
+    auto append = [&](std::string_view s) {
+      auto n = static_cast<uint32_t>(s.size());
+      for (int i = 0; i < 4; ++i)
+        res.body().push_back(static_cast<uint8_t>(n >> (8 * i)));
+      res.body().insert(res.body().end(), s.begin(), s.end());
+    };
+    std::size_t n = 0;
+    for (auto it = store_.upper_bound(params["after"]);
+         it != store_.end() && n < limit; ++it) {
+      if (!it->first.starts_with(prefix))
+        continue;
+      append(it->first);
+      if (values)
+        append({reinterpret_cast<const char *>(it->second.data()),
+                it->second.size()});
+      ++n;
+    }
+    res.result(http::status::ok);
+  }
+
+  // Test keys and values are unreserved, so nothing needs decoding.
+  static std::map<std::string, std::string> parse_query(std::string_view q) {
+    std::map<std::string, std::string> out;
+    while (!q.empty()) {
+      auto amp = q.find('&');
+      auto pair = q.substr(0, amp);
+      auto eq = pair.find('=');
+      out[std::string(pair.substr(0, eq))] =
+          eq == std::string_view::npos ? "" : std::string(pair.substr(eq + 1));
+      q = amp == std::string_view::npos ? "" : q.substr(amp + 1);
+    }
+    return out;
+  }
+
+  net::io_context ioc_;
+  tcp::acceptor acceptor_;
+  std::mutex mutex_; // Everything below
+  std::string cluster_map_;
+  std::string binary_map_;
+  Hook hook_;
+  bool binary_ = false;
+  std::size_t close_after_ = 0;
+  std::size_t drop_ = 0;
+  std::size_t connections_ = 0;
+  std::size_t open_ = 0;
+  std::vector<Request> log_;
+  std::map<std::string, std::vector<uint8_t>> store_; // Ordered for scans
+};
+
+// {"peers": [...]} naming each node by ID 1, 2, ... in order.
+inline std::string json_map(const std::vector<MockNode *> &nodes,
+                            uint64_t epoch = 0) {
+  std::string peers;
+  for (std::size_t i = 0; i < nodes.size(); ++i) {
+    if (i)
+      peers += ',';
+    peers += "{\"id\":" + std::to_string(i + 1) +
+             ",\"host\":\"127.0.0.1\",\"http_port\":" +
+             std::to_string(nodes[i]->port()) + "}";
+  }
+  std::string out = "{";
+  if (epoch)
+    out += "\"epoch\":" + std::to_string(epoch) + ",";
+  return out + "\"peers\":[" + peers + "]}";
+}
+
+// The same map in the binary encoding: "L3TM", version 1, two reserved
+// bytes, u64 epoch, u32 count, then per node u32 id, u16 port, u16 host
+// length and the host; little-endian.
+inline std::string binary_map(const std::vector<MockNode *> &nodes,
+                              uint64_t epoch) {
+  std::string out = "L3TM";
+  auto append = [&out](uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; ++i)
+      out += static_cast<char>(v >> (8 * i));
+  };
+  append(1, 1);
+  append(0, 3);
+  append(epoch, 8);
+  append(nodes.size(), 4);
+  const std::string host = "127.0.0.1";
+  for (std::size_t i = 0; i < nodes.size(); ++i) {
+    append(i + 1, 4);
+    append(nodes[i]->port(), 2);
+    append(host.size(), 2);
+    out += host;
+  }
+  return out;
+}
+
+} // namespace mock
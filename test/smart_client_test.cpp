@@ -0,0 +1,548 @@
+// Behaviour tests of SmartClient against in-process mock nodes
+// (mock_node.hpp). Standalone like client_test_simple: each test prints its
+// name, the first failed check exits non-zero.
+
+#include "lite3/smart_client.hpp"
+#include "mock_node.hpp"
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/use_future.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using mock::assert_true;
+using mock::eventually;
+using mock::http::verb;
+
+// `n` nodes (leaked, see MockNode) that all serve the same JSON map.
+std::vector<mock::MockNode *> start_cluster(std::size_t n) {
+  std::vector<mock::MockNode *> nodes;
+  for (std::size_t i = 0; i < n; ++i)
+    nodes.push_back(new mock::MockNode());
+  for (auto *node : nodes)
+    node->start(mock::json_map(nodes));
+  return nodes;
+}
+
+std::unique_ptr<lite3::SmartClient>
+connect(const std::vector<mock::MockNode *> &nodes,
+        lite3::ReplicaOptions replicas = {},
+        lite3::NearCacheOptions near_cache = {},
+        lite3::WriteBehindOptions write_behind = {}) {
+  auto smart = std::make_unique<lite3::SmartClient>(
+      "127.0.0.1", nodes.front()->port(), lite3::ClientOptions(), replicas,
+      near_cache, write_behind);
+  auto res = smart->connect();
+  assert_true(bool(res), "connect failed");
+  return smart;
+}
+
+std::vector<std::string> drain(lite3::KeyScan &scan) {
+  std::vector<std::string> keys;
+  for (;;) {
+    auto next = scan.next();
+    assert_true(bool(next), "scan failed: " +
+                                (next ? std::string() : next.error().message));
+    if (!*next)
+      return keys;
+    keys.push_back((*next)->key);
+  }
+}
+
+// --- Routing ---
+
+// Threads cache routing snapshots; they must not keep a destroyed
+// SmartClient's connections open.
+void test_destroy_closes_connections() {
+  std::cout << "[Test] Destroying a SmartClient closes its connections"
+            << std::endl;
+  auto nodes = start_cluster(2);
+  auto smart = connect(nodes);
+  for (int i = 0; i < 10; ++i)
+    assert_true(bool(smart->put("c-" + std::to_string(i), "v")),
+                "put failed");
+  assert_true(nodes[0]->open_connections() + nodes[1]->open_connections() > 0,
+              "no connections were opened");
+  smart.reset();
+  assert_true(eventually([&] {
+                return nodes[0]->open_connections() == 0 &&
+                       nodes[1]->open_connections() == 0;
+              }),
+              "connections stayed open after ~SmartClient");
+}
+
+// Every node but the last redirects /kv/hot-* there. After one 307 per
+// key, requests go straight to it, and keep doing so: the hints must not
+// cost a lock per request or stop KeyRef routes from being cached.
+void test_redirect_hints() {
+  std::cout << "[Test] Redirect hints" << std::endl;
+  auto nodes = start_cluster(3);
+  auto *target = nodes.back();
+  const auto location =
+      "http://127.0.0.1:" + std::to_string(target->port());
+  for (auto *node : nodes)
+    if (node != target)
+      node->set_hook([location](const mock::MockNode::Request &req,
+                                mock::MockNode::Response &res) {
+        if (!req.target.starts_with("/kv/hot-"))
+          return false;
+        res.result(mock::http::status::temporary_redirect);
+        res.set(mock::http::field::location, location + req.target);
+        return true;
+      });
+  auto smart = connect(nodes);
+
+  lite3::KeyRef ref("hot-ref");
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 10; ++i)
+      assert_true(bool(smart->put("hot-" + std::to_string(i), "v")),
+                  "redirected put failed");
+    assert_true(bool(smart->put(ref, "v")), "redirected KeyRef put failed");
+  }
+  std::size_t redirected = 0;
+  for (auto *node : nodes)
+    if (node != target)
+      redirected += node->count(verb::put, "/kv/hot-");
+  assert_true(redirected <= 11, "hinted keys were still redirected");
+  assert_true(target->count(verb::put, "/kv/hot-") == 33,
+              "redirect target missed writes");
+
+  // A redirect to a known node still means the ring is stale.
+  const auto fetched = nodes.front()->count(verb::get, "/cluster/map");
+  smart->start_background_refresh(std::chrono::milliseconds(0),
+                                  std::chrono::milliseconds(1));
+  assert_true(bool(smart->put("hot-new", "v")), "redirected put failed");
+  assert_true(eventually([&] {
+                return nodes.front()->count(verb::get, "/cluster/map") >
+                       fetched;
+              }),
+              "a redirect did not request a refresh");
+}
+
+// --- Cluster Map ---
+
+// Both encodings name the same nodes; the epochs tell which was used.
+void test_binary_cluster_map() {
+  std::cout << "[Test] Binary cluster map" << std::endl;
+  std::vector<mock::MockNode *> nodes = {new mock::MockNode(),
+                                         new mock::MockNode()};
+  for (auto *node : nodes)
+    node->start(mock::json_map(nodes, 3), mock::binary_map(nodes, 7));
+  auto smart = connect(nodes);
+  assert_true(smart->topology_epoch() == 7, "the binary map was not used");
+  for (const auto &req : nodes[0]->requests())
+    assert_true(req.target != "/cluster/map",
+                "the JSON map was fetched along with the binary one");
+  for (int i = 0; i < 20; ++i)
+    assert_true(bool(smart->put("m-" + std::to_string(i), "v")), "put failed");
+  assert_true(nodes[0]->count(verb::put, "/kv/m-") > 0 &&
+                  nodes[1]->count(verb::put, "/kv/m-") > 0,
+              "keys were not routed to both nodes of the binary map");
+}
+
+// Seeds that answer ?format=binary with 404 serve JSON; a changed map
+// takes effect on the next fetch.
+void test_json_cluster_map() {
+  std::cout << "[Test] JSON cluster map" << std::endl;
+  std::vector<mock::MockNode *> nodes = {new mock::MockNode(),
+                                         new mock::MockNode()};
+  for (auto *node : nodes)
+    node->start(mock::json_map(nodes, 5));
+  auto smart = connect(nodes);
+  assert_true(smart->topology_epoch() == 5, "the JSON map was not used");
+  for (int i = 0; i < 20; ++i)
+    assert_true(bool(smart->put("j-" + std::to_string(i), "v")), "put failed");
+  assert_true(nodes[0]->count(verb::put, "/kv/j-") > 0 &&
+                  nodes[1]->count(verb::put, "/kv/j-") > 0,
+              "keys were not routed to both nodes of the JSON map");
+
+  nodes[0]->set_cluster_map(mock::json_map({nodes[1]}, 6));
+  assert_true(bool(smart->connect()), "refresh failed");
+  assert_true(smart->topology_epoch() == 6, "the new map was not used");
+  nodes[1]->clear_log();
+  for (int i = 0; i < 10; ++i)
+    assert_true(bool(smart->put("j-" + std::to_string(i), "v")), "put failed");
+  assert_true(nodes[1]->count(verb::put, "/kv/j-") == 10,
+              "keys still went to a node that left the map");
+}
+
+// --- Replicas ---
+
+// The map names owners only, so replication_factor > 1 must not send
+// reads to nodes that may not hold the key.
+void test_replica_reads() {
+  std::cout << "[Test] Replica reads stay on the owner" << std::endl;
+  auto nodes = start_cluster(3);
+  lite3::ReplicaOptions replicas;
+  replicas.replication_factor = 3;
+  auto smart = std::make_unique<lite3::SmartClient>(
+      "127.0.0.1", nodes.front()->port(), lite3::ClientOptions(), replicas);
+  bool warned = false;
+  smart->set_logger([&](lite3::LogLevel level, std::string_view message) {
+    warned |= level == lite3::LogLevel::Warning &&
+              message.find("replication_factor") != std::string_view::npos;
+  });
+  assert_true(bool(smart->connect()), "connect failed");
+  assert_true(warned, "capping replication_factor was not logged");
+  for (int i = 0; i < 20; ++i)
+    assert_true(bool(smart->put("r-" + std::to_string(i), "v")), "put failed");
+  for (int round = 0; round < 3; ++round)
+    for (int i = 0; i < 20; ++i) {
+      auto res = smart->get("r-" + std::to_string(i));
+      assert_true(res && res->size() == 1, "replica read lost a key");
+    }
+  assert_true(smart->get("missing").error().code == lite3::ErrorCode::NotFound,
+              "a missing key was not NotFound");
+
+  replicas.hedge_reads = true;
+  replicas.hedge_delay = std::chrono::milliseconds(1);
+  auto hedged = connect(nodes, replicas);
+  for (int i = 0; i < 20; ++i)
+    assert_true(bool(hedged->get("r-" + std::to_string(i))),
+                "hedged replica read lost a key");
+
+  // async_get reads the same way.
+  boost::asio::io_context ioc;
+  auto work = boost::asio::make_work_guard(ioc);
+  std::thread runner([&] { ioc.run(); });
+  {
+    lite3::SmartClient async_smart(ioc, "127.0.0.1", nodes.front()->port(),
+                                   lite3::ClientOptions(), replicas);
+    assert_true(bool(async_smart.connect()), "connect failed");
+    for (int i = 0; i < 20; ++i) {
+      auto res = async_smart
+                     .async_get("r-" + std::to_string(i),
+                                boost::asio::use_future)
+                     .get();
+      assert_true(res && res->size() == 1, "async replica read lost a key");
+    }
+    auto missing =
+        async_smart.async_get("missing", boost::asio::use_future).get();
+    assert_true(!missing && missing.error().code == lite3::ErrorCode::NotFound,
+                "a missing key was not NotFound from async_get");
+  }
+  work.reset();
+  runner.join();
+
+  for (auto *node : nodes)
+    for (const auto &req : node->requests())
+      if (req.method == verb::get && req.target.starts_with("/kv/r-"))
+        assert_true(bool(node->value(req.target.substr(4))),
+                    "a read went to a node without the key");
+}
+
+// --- Near cache ---
+
+// A put that lands while a get is still fetching the old value must keep
+// that value out of the cache.
+void test_near_cache_invalidation_race() {
+  std::cout << "[Test] Near-cache invalidation racing a fill" << std::endl;
+  auto nodes = start_cluster(1);
+  nodes[0]->store("nc", "old");
+  std::atomic<bool> entered{false};
+  std::atomic<bool> release{false};
+  nodes[0]->set_hook([&](const mock::MockNode::Request &req,
+                         mock::MockNode::Response &res) {
+    if (req.method != verb::get || req.target != "/kv/nc" ||
+        entered.exchange(true))
+      return false;
+    while (!release)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    res.result(mock::http::status::ok);
+    res.body().assign({'o', 'l', 'd'});
+    return true;
+  });
+  lite3::NearCacheOptions near_cache;
+  near_cache.max_bytes = 1 << 20;
+  near_cache.ttl = std::chrono::hours(1);
+  auto smart = connect(nodes, {}, near_cache);
+
+  std::thread reader([&] {
+    assert_true(bool(smart->get("nc")), "racing get failed");
+  });
+  assert_true(eventually([&] { return entered.load(); }),
+              "the racing get never reached the node");
+  assert_true(bool(smart->put("nc", "new")), "put failed");
+  release = true;
+  reader.join();
+
+  auto res = smart->get("nc");
+  assert_true(res && res->size() == 3 &&
+                  std::equal(res->data(), res->data() + 3, "new"),
+              "a fill that raced a put cached the old value");
+  assert_true(nodes[0]->count(verb::get, "/kv/nc") == 2,
+              "the read after the race did not reach the node");
+  assert_true(bool(smart->get("nc")) &&
+                  nodes[0]->count(verb::get, "/kv/nc") == 2,
+              "the value read after the race was not cached");
+  nodes[0]->set_hook({});
+}
+
+// --- Batches ---
+
+// Each node's share of a batch goes to that node alone, the groups running
+// at once, and results come back in the order of the batch.
+void test_batch_across_nodes() {
+  std::cout << "[Test] Batches split across nodes" << std::endl;
+  auto nodes = start_cluster(3);
+  auto smart = connect(nodes);
+  std::vector<std::string> keys, values;
+  for (int i = 0; i < 60; ++i) {
+    keys.push_back("b-" + std::to_string(i));
+    values.push_back("v-" + std::to_string(i));
+  }
+  for (int round = 0; round < 5; ++round) {
+    std::vector<std::pair<std::string_view, std::string_view>> items;
+    for (std::size_t i = 0; i < keys.size(); ++i)
+      items.emplace_back(keys[i], values[i]);
+    for (auto &res : smart->multi_put(items))
+      assert_true(bool(res), "multi_put failed");
+    std::vector<std::string_view> names(keys.begin(), keys.end());
+    auto got = smart->multi_get(names);
+    assert_true(got.size() == keys.size(), "multi_get lost results");
+    for (std::size_t i = 0; i < keys.size(); ++i)
+      assert_true(got[i] && got[i]->size() == values[i].size() &&
+                      std::equal(got[i]->data(),
+                                 got[i]->data() + got[i]->size(),
+                                 values[i].begin()),
+                  "multi_get result out of order for " + keys[i]);
+  }
+  for (const auto &key : keys) {
+    const auto holders = std::count_if(
+        nodes.begin(), nodes.end(),
+        [&](auto *node) { return node->value(key).has_value(); });
+    assert_true(holders == 1, key + " was sent to more than one node");
+  }
+  for (auto *node : nodes)
+    assert_true(node->count(verb::put, "/kv/b-") > 0,
+                "a node got no share of the batch");
+}
+
+// --- Write-behind ---
+
+lite3::WriteBehindOptions write_behind(std::chrono::milliseconds window) {
+  lite3::WriteBehindOptions options;
+  options.window = window;
+  return options;
+}
+
+// Writes to a key within one window reach its node as one put and one
+// patch, carrying the last value of each.
+void test_write_behind_coalescing() {
+  std::cout << "[Test] Write-behind coalescing" << std::endl;
+  auto nodes = start_cluster(1);
+  auto smart = connect(nodes, {}, {}, write_behind(std::chrono::hours(1)));
+  for (int i = 0; i < 10; ++i) {
+    assert_true(bool(smart->put("wb-a", "v" + std::to_string(i))),
+                "buffered put failed");
+    assert_true(bool(smart->patch_int("wb-a", "n", i)),
+                "buffered patch_int failed");
+  }
+  assert_true(bool(smart->put("wb-b", "x")), "buffered put failed");
+  assert_true(nodes[0]->count(verb::put, "/kv/wb-") == 0,
+              "a buffered write went out before its flush");
+
+  auto stats = *smart->stats().write_behind;
+  assert_true(stats.writes == 21 && stats.coalesced == 19 && stats.keys == 2,
+              "write-behind stats did not count the coalescing");
+  assert_true(bool(smart->flush()), "flush failed");
+  assert_true(nodes[0]->count(verb::put, "/kv/wb-a") == 1 &&
+                  nodes[0]->count(verb::put, "/kv/wb-b") == 1,
+              "coalesced puts were not sent once per key");
+  assert_true(nodes[0]->count(verb::post, "/kv/wb-a") == 1,
+              "coalesced patch_int sets were not sent as one patch");
+  assert_true(nodes[0]->value("wb-a") == "v9", "the last put did not win");
+  assert_true(smart->stats().write_behind->keys == 0,
+              "flush left keys buffered");
+
+  // A window flushes on its own.
+  auto timed =
+      connect(nodes, {}, {}, write_behind(std::chrono::milliseconds(20)));
+  assert_true(bool(timed->put("wb-timed", "v")), "buffered put failed");
+  assert_true(eventually([&] { return nodes[0]->value("wb-timed") == "v"; }),
+              "the background flush did not send a buffered put");
+}
+
+// A flush sends each node its own keys' puts and patches, nodes at once.
+void test_write_behind_across_nodes() {
+  std::cout << "[Test] Write-behind flush across nodes" << std::endl;
+  auto nodes = start_cluster(3);
+  auto smart = connect(nodes, {}, {}, write_behind(std::chrono::hours(1)));
+  for (int i = 0; i < 30; ++i) {
+    const auto key = "wbn-" + std::to_string(i);
+    assert_true(bool(smart->put(key, "v")), "buffered put failed");
+    assert_true(bool(smart->patch_int(key, "n", i)),
+                "buffered patch_int failed");
+  }
+  assert_true(bool(smart->flush()), "flush failed");
+  for (int i = 0; i < 30; ++i) {
+    const auto target = "/kv/wbn-" + std::to_string(i) + "?";
+    std::size_t holders = 0, patches = 0;
+    for (auto *node : nodes) {
+      holders += node->value("wbn-" + std::to_string(i)).has_value();
+      patches += node->count(verb::post, target);
+    }
+    assert_true(holders == 1 && patches == 1,
+                "a key was not flushed to exactly one node");
+  }
+  for (auto *node : nodes)
+    assert_true(node->count(verb::post, "/kv/wbn-") > 0,
+                "a node got no share of the flush");
+}
+
+// A write that bypasses the buffer sends the key's buffered writes first,
+// and fails unsent when they fail.
+void test_write_behind_settle() {
+  std::cout << "[Test] Write-behind settles bypassing writes" << std::endl;
+  auto nodes = start_cluster(1);
+  nodes[0]->set_hook([](const mock::MockNode::Request &req,
+                        mock::MockNode::Response &res) {
+    if (req.method != verb::put || !req.target.starts_with("/kv/wb-fail"))
+      return false;
+    res.result(mock::http::status::internal_server_error);
+    return true;
+  });
+  auto smart = connect(nodes, {}, {}, write_behind(std::chrono::hours(1)));
+
+  assert_true(bool(smart->put("wb-ok", "v")), "buffered put failed");
+  assert_true(bool(smart->patch_str("wb-ok", "f", "s")), "patch_str failed");
+  auto log = nodes[0]->requests();
+  std::vector<verb> order;
+  for (const auto &req : log)
+    if (req.target.starts_with("/kv/wb-ok"))
+      order.push_back(req.method);
+  assert_true(order == std::vector<verb>{verb::put, verb::post},
+              "the buffered put did not precede patch_str");
+
+  assert_true(bool(smart->put("wb-fail", "v")), "buffered put failed");
+  assert_true(!smart->patch_str("wb-fail", "f", "s"),
+              "patch_str succeeded after its buffered put failed");
+  assert_true(nodes[0]->count(verb::post, "/kv/wb-fail") == 0,
+              "patch_str was sent after its buffered put failed");
+
+  assert_true(bool(smart->put("wb-fail-m", "v")), "buffered put failed");
+  std::vector<std::pair<std::string_view, std::string_view>> items = {
+      {"wb-fail-m", "w"}, {"wb-multi", "w"}};
+  auto results = smart->multi_put(items);
+  assert_true(!results[0] && bool(results[1]),
+              "multi_put did not fail only the key whose flush failed");
+  assert_true(nodes[0]->count(verb::put, "/kv/wb-fail-m") == 1,
+              "multi_put sent a key whose buffered put failed");
+  assert_true(nodes[0]->value("wb-multi") == "w", "multi_put lost a key");
+}
+
+// --- Scans ---
+
+void test_scan_paging() {
+  std::cout << "[Test] Scan paging" << std::endl;
+  auto nodes = start_cluster(2);
+  for (int i = 0; i < 7; ++i) {
+    nodes[0]->store("a-" + std::to_string(i), "v");
+    nodes[1]->store("b-" + std::to_string(i), "v");
+  }
+  nodes[0]->store("other", "v");
+  auto smart = connect(nodes);
+
+  lite3::ScanOptions options;
+  options.page_size = 3;
+  options.prefetch = 1;
+  auto scan = smart->scan("", options);
+  auto keys = drain(scan);
+  assert_true(keys.size() == 15, "scan did not return every key");
+  assert_true(std::set<std::string>(keys.begin(), keys.end()).size() == 15,
+              "scan repeated a key");
+  // 8 keys: 3 + 3 + 2; 7 keys: 3 + 3 + 1.
+  assert_true(nodes[0]->count(verb::get, "/kv/?op=scan") == 3,
+              "node 1 was not paged 3 times");
+  assert_true(nodes[1]->count(verb::get, "/kv/?op=scan") == 3,
+              "node 2 was not paged 3 times");
+
+  auto prefixed = smart->scan("a-", options);
+  assert_true(drain(prefixed).size() == 7, "prefix scan mismatch");
+}
+
+// With replicas, every node holds every key; each comes from its owner.
+void test_scan_owner_filtering() {
+  std::cout << "[Test] Scan owner filtering" << std::endl;
+  auto nodes = start_cluster(3);
+  for (int i = 0; i < 50; ++i)
+    for (auto *node : nodes)
+      node->store("k-" + std::to_string(i), "v");
+  lite3::ReplicaOptions replicas;
+  replicas.replication_factor = 3;
+  auto smart = connect(nodes, replicas);
+
+  lite3::ScanOptions options;
+  options.page_size = 8;
+  auto scan = smart->scan("k-", options);
+  auto keys = drain(scan);
+  assert_true(keys.size() == 50, "owner filtering lost or repeated keys");
+  assert_true(std::set<std::string>(keys.begin(), keys.end()).size() == 50,
+              "scan repeated a key");
+}
+
+// Pages stop once the scan is dropped or its SmartClient is destroyed.
+void test_scan_lifetime() {
+  std::cout << "[Test] Scan outliving its SmartClient" << std::endl;
+  auto nodes = start_cluster(2);
+  for (int i = 0; i < 100; ++i)
+    nodes[i % 2]->store("s-" + std::to_string(i), "v");
+  auto smart = connect(nodes);
+
+  lite3::ScanOptions options;
+  options.page_size = 1;
+  options.prefetch = 1;
+  {
+    auto dropped = smart->scan("s-", options);
+    assert_true(bool(dropped.next()), "first entry failed");
+  }
+  auto scan = smart->scan("s-", options);
+  assert_true(bool(scan.next()), "first entry failed");
+  smart.reset();
+
+  std::size_t entries = 1;
+  std::size_t errors = 0;
+  for (;;) {
+    auto next = scan.next();
+    if (!next) {
+      // Each node reports once; the rest may follow.
+      assert_true(++errors <= nodes.size(), "a node reported twice");
+      continue;
+    }
+    if (!*next)
+      break;
+    ++entries;
+  }
+  assert_true(entries == 100 || errors > 0,
+              "an unfinished scan did not fail");
+}
+
+} // namespace
+
+int main() {
+  test_destroy_closes_connections();
+  test_redirect_hints();
+  test_binary_cluster_map();
+  test_json_cluster_map();
+  test_replica_reads();
+  test_near_cache_invalidation_race();
+  test_batch_across_nodes();
+  test_write_behind_coalescing();
+  test_write_behind_across_nodes();
+  test_write_behind_settle();
+  test_scan_paging();
+  test_scan_owner_filtering();
+  test_scan_lifetime();
+  std::cout << "[PASS] All tests passed!" << std::endl;
+  return 0;
+}